@@ -230,6 +230,7 @@ int create_server(int32_t specified_port, uint16_t port, socket_type_t socket_ty
 
 /**
  * Handle a port absent message being received rom a federate via the RIT.
+ * This also handles MSG_TYPE_PORT_ABSENT_UNTIL, which has the same layout.
  * 
  * This function assumes the caller does not hold the mutex.
  */
@@ -359,11 +360,16 @@ void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
         // Need to wait here.
         pthread_cond_wait(&_RTI.sent_start_time, &_RTI.rti_mutex);
     }
+    // The message length may be longer than the buffer,
+    // in which case we have to handle it in chunks.
+    // Cork the socket meanwhile so that the chunks go out in full segments.
+    bool chunked = bytes_read < total_bytes_to_read;
+    if (chunked) {
+        set_socket_cork(destination_socket, true);
+    }
     write_to_socket_errexit(destination_socket, bytes_read, buffer,
             "RTI failed to forward message to federate %d.", federate_id);
 
-    // The message length may be longer than the buffer,
-    // in which case we have to handle it in chunks.
     size_t total_bytes_read = bytes_read;
     while (total_bytes_read < total_bytes_to_read) {
         DEBUG_PRINT("Forwarding message in chunks.");
@@ -382,6 +388,9 @@ void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
         write_to_socket_errexit(destination_socket, bytes_to_read, buffer,
                 "RTI failed to send message chunks.");
     }
+    if (chunked) {
+        set_socket_cork(destination_socket, false);
+    }
     pthread_mutex_unlock(&_RTI.rti_mutex);
 }
 
@@ -574,9 +583,9 @@ void send_provisional_tag_advance_grant(federate_t* fed, tag_t tag) {
  * all upstream federates of the "after" delay plus the most recently
  * received LTC from that federate. If M is greater than the
  * most recently sent TAG to fed or greater than or equal to the most
- * recently sent PTAG, then send a TAG(M) to fed and return.
+ * recently sent PTAG, then send a TAG(M) to fed.
  *
- * If the above conditions do not result in sending a TAG, then find the
+ * Then, unless all upstream federates are done, find the
  * minimum M of the earliest possible future message from upstream federates.
  * This is calculated by transitively looking at the most recently received
  * NET message from upstream federates.
@@ -615,12 +624,17 @@ bool send_advance_grant_if_safe(federate_t* fed) {
             "(adjusted by after delay).",
             fed->id,
             min_upstream_completed.time - start_time, min_upstream_completed.microstep);
+    bool result = false;
     if (compare_tags(min_upstream_completed, fed->last_granted) > 0) {
     	send_tag_advance_grant(fed, min_upstream_completed);
-    	return true;
+    	result = true;
     }
 
-    // Can't make progress based only on upstream LTCs.
+    // Upstream LTCs may lag far behind upstream NETs, for example when
+    // upstream federates have themselves been granted tags ahead of their
+    // current tag. Rather than making the federate come back with another
+    // NET, also check whether the upstream next events allow it to advance
+    // further than the LTCs do.
     // If all (transitive) upstream federates of the federate
     // have earliest event tags such that the
     // federate can now advance its tag, then send it a TAG message.
@@ -666,6 +680,8 @@ bool send_advance_grant_if_safe(federate_t* fed) {
     LOG_PRINT("Earliest next event upstream has tag (%lld, %u).",
             t_d.time - start_time, t_d.microstep);
 
+    free(visited);
+
     if (compare_tags(t_d, FOREVER_TAG) == 0) {
     	// Upstream federates are all done.
         LOG_PRINT("Upstream federates are all done. Granting tag advance.");
@@ -689,7 +705,7 @@ bool send_advance_grant_if_safe(federate_t* fed) {
 
     	send_provisional_tag_advance_grant(fed, t_d);
     }
-	return false;
+	return result;
 }
 
 /**
@@ -1445,6 +1461,7 @@ void* federate_thread_TCP(void* fed) {
                 handle_stop_request_reply(my_fed);
                 break;
             case MSG_TYPE_PORT_ABSENT:
+            case MSG_TYPE_PORT_ABSENT_UNTIL:
                 handle_port_absent_message(my_fed, buffer);
                 break;
             default:
@@ -1764,6 +1781,8 @@ void connect_to_federates(int socket_descriptor) {
                 continue;
             }
         }
+        // Tag advance grants are small and latency critical, so send them without delay.
+        set_socket_no_delay(socket_id);
 
         // The first message from the federate should contain its ID and the federation ID.
         int32_t fed_id = receive_and_check_fed_id_message(socket_id, (struct sockaddr_in*)&client_fd);
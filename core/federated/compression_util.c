@@ -0,0 +1,239 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Compression of messages between federates in the LZ4 block format.
+ * @see compression_util.h
+ *
+ * A block is a sequence of sequences. Each sequence has a token byte whose
+ * high four bits are the number of literal bytes and whose low four bits are
+ * the length of the match minus LZ4_MIN_MATCH. A value of 15 means that more
+ * bytes follow, each added to the length, until one is less than 255. Then
+ * come the literals, then two bytes, little endian, with the distance back
+ * to the start of the match, then the extra bytes of the match length.
+ * The last sequence has only literals.
+ */
+
+#include "compression_util.h"
+#include <stdint.h>
+#include <string.h>     // Defines memcpy()
+
+/** Shortest match that is encoded. */
+#define LZ4_MIN_MATCH 4
+
+/** Number of bytes at the end of the input that are always literals. */
+#define LZ4_LAST_LITERALS 5
+
+/** A match cannot start within this number of bytes of the end of the input. */
+#define LZ4_MATCH_LIMIT 12
+
+/** Largest distance to the start of a match. */
+#define LZ4_MAX_OFFSET 65535
+
+/** Number of bits in the hash of four bytes, which gives the size of the hash table. */
+#define LZ4_HASH_LOG 12
+
+/** Return the four bytes at the specified address. */
+static uint32_t _lz4_read32(const unsigned char* address) {
+    uint32_t result;
+    memcpy(&result, address, sizeof(result));
+    return result;
+}
+
+/** Return the index in the hash table of the specified four bytes. */
+static uint32_t _lz4_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+/**
+ * Write the specified length, beyond the 15 that fit in the token, as a
+ * sequence of bytes and return the address after them.
+ */
+static unsigned char* _lz4_write_length(unsigned char* output, size_t length) {
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (unsigned char)length;
+    return output;
+}
+
+/**
+ * Read a length that continues after the token, add it to the specified
+ * length, and return it, or return (size_t)-1 if the block ends first or
+ * the length exceeds the specified limit.
+ */
+static size_t _lz4_read_length(const unsigned char** input, const unsigned char* end,
+        size_t length, size_t limit) {
+    unsigned char byte;
+    do {
+        if (*input >= end) {
+            return (size_t)-1;
+        }
+        byte = *(*input)++;
+        length += byte;
+        if (length > limit) {
+            return (size_t)-1;
+        }
+    } while (byte == 255);
+    return length;
+}
+
+size_t compress_lz4_block(const unsigned char* source, size_t source_size,
+        unsigned char* destination, size_t capacity) {
+    // Positions in the source of the last occurrence of each hash.
+    uint32_t table[1 << LZ4_HASH_LOG] = {0};
+    const unsigned char* input = source;
+    const unsigned char* anchor = source;    // Start of the pending literals.
+    const unsigned char* end = source + source_size;
+    unsigned char* output = destination;
+    unsigned char* output_end = destination + capacity;
+
+    if (source_size > LZ4_MATCH_LIMIT && source_size <= UINT32_MAX) {
+        const unsigned char* match_limit = end - LZ4_MATCH_LIMIT;
+        const unsigned char* match_end_limit = end - LZ4_LAST_LITERALS;
+        while (input < match_limit) {
+            uint32_t sequence = _lz4_read32(input);
+            uint32_t hash = _lz4_hash(sequence);
+            const unsigned char* match = source + table[hash];
+            table[hash] = (uint32_t)(input - source);
+            if (match >= input || input - match > LZ4_MAX_OFFSET
+                    || _lz4_read32(match) != sequence) {
+                input++;
+                continue;
+            }
+            // Extend the match backwards over the pending literals.
+            while (input > anchor && match > source && input[-1] == match[-1]) {
+                input--;
+                match--;
+            }
+            // Extend the match forwards.
+            const unsigned char* match_end = input + LZ4_MIN_MATCH;
+            const unsigned char* reference = match + LZ4_MIN_MATCH;
+            while (match_end < match_end_limit && *match_end == *reference) {
+                match_end++;
+                reference++;
+            }
+            size_t literal_length = input - anchor;
+            size_t match_length = match_end - input - LZ4_MIN_MATCH;
+            if ((size_t)(output_end - output) < 1 + literal_length / 255 + 1 + literal_length
+                    + 2 + match_length / 255 + 1) {
+                return 0;
+            }
+            unsigned char* token = output++;
+            *token = (unsigned char)(((literal_length < 15) ? literal_length : 15) << 4);
+            if (literal_length >= 15) {
+                output = _lz4_write_length(output, literal_length - 15);
+            }
+            memcpy(output, anchor, literal_length);
+            output += literal_length;
+            size_t offset = input - match;
+            *output++ = (unsigned char)(offset & 0xff);
+            *output++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)((match_length < 15) ? match_length : 15);
+            if (match_length >= 15) {
+                output = _lz4_write_length(output, match_length - 15);
+            }
+            input = match_end;
+            anchor = input;
+        }
+    }
+
+    // The last sequence has the remaining literals.
+    size_t literal_length = end - anchor;
+    if ((size_t)(output_end - output) < 1 + literal_length / 255 + 1 + literal_length) {
+        return 0;
+    }
+    unsigned char* token = output++;
+    *token = (unsigned char)(((literal_length < 15) ? literal_length : 15) << 4);
+    if (literal_length >= 15) {
+        output = _lz4_write_length(output, literal_length - 15);
+    }
+    memcpy(output, anchor, literal_length);
+    output += literal_length;
+    return output - destination;
+}
+
+ssize_t decompress_lz4_block(const unsigned char* source, size_t source_size,
+        unsigned char* destination, size_t capacity) {
+    const unsigned char* input = source;
+    const unsigned char* end = source + source_size;
+    unsigned char* output = destination;
+    while (input < end) {
+        unsigned char token = *input++;
+        size_t available = capacity - (output - destination);
+
+        // Copy the literals.
+        size_t length = token >> 4;
+        if (length == 15) {
+            length = _lz4_read_length(&input, end, length, available);
+        }
+        if (length > available || length > (size_t)(end - input)) {
+            return -1;
+        }
+        memcpy(output, input, length);
+        output += length;
+        input += length;
+        available -= length;
+        if (input == end) {
+            // This was the last sequence.
+            break;
+        }
+
+        // Copy the match.
+        if (end - input < 2) {
+            return -1;
+        }
+        size_t offset = input[0] | ((size_t)input[1] << 8);
+        input += 2;
+        if (offset == 0 || offset > (size_t)(output - destination)) {
+            return -1;
+        }
+        length = token & 15;
+        if (length == 15) {
+            length = _lz4_read_length(&input, end, length, available);
+            if (length == (size_t)-1) {
+                return -1;
+            }
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > available) {
+            return -1;
+        }
+        const unsigned char* match = output - offset;
+        if (offset >= length) {
+            memcpy(output, match, length);
+        } else {
+            // The match overlaps the bytes being written, which repeats them.
+            for (size_t i = 0; i < length; i++) {
+                output[i] = match[i];
+            }
+        }
+        output += length;
+    }
+    return output - destination;
+}
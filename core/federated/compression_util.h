@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Header file for a fast compressor for messages between federates.
+ * The compressed data is in the LZ4 block format, so it can be inspected and
+ * decompressed with other implementations of that format, but no external
+ * library is needed. The compressor finds matches greedily with a small hash
+ * table, trading compression ratio for speed, as LZ4 does at its default level.
+ *
+ * These functions do not allocate memory or acquire any mutexes and can be
+ * called concurrently.
+ */
+
+#ifndef COMPRESSION_UTIL_H
+#define COMPRESSION_UTIL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Largest number of bytes that compress_lz4_block() produces for an input
+ * of the specified number of bytes, reached if the input is incompressible.
+ */
+#define LZ4_BLOCK_BOUND(size) ((size) + (size) / 255 + 16)
+
+/**
+ * Compress the specified bytes into an LZ4 block.
+ * @param source The bytes to compress.
+ * @param source_size The number of bytes to compress.
+ * @param destination The buffer into which to put the block.
+ * @param capacity The size of the destination buffer. To get a block only
+ *  if it is smaller than the input, give a capacity less than source_size.
+ * @return The size of the block, or 0 if it does not fit in the capacity.
+ */
+size_t compress_lz4_block(const unsigned char* source, size_t source_size,
+        unsigned char* destination, size_t capacity);
+
+/**
+ * Decompress the specified LZ4 block. This checks every length and offset in
+ * the block, so a malformed block results in an error, not an access outside
+ * of the buffers.
+ * @param source The block.
+ * @param source_size The size of the block.
+ * @param destination The buffer into which to put the decompressed bytes.
+ * @param capacity The size of the destination buffer.
+ * @return The number of decompressed bytes, or -1 if the block is malformed
+ *  or decompresses to more than capacity bytes.
+ */
+ssize_t decompress_lz4_block(const unsigned char* source, size_t source_size,
+        unsigned char* destination, size_t capacity);
+
+#endif /* COMPRESSION_UTIL_H */
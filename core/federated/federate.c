@@ -41,20 +41,35 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <strings.h>    // Defines bzero().
 #include <assert.h>
 #include <signal.h>     // Defines sigaction.
+#ifdef __linux__
+#include <sys/epoll.h>  // Defines epoll_create1(), epoll_ctl(), and epoll_wait().
+#include <fcntl.h>      // Defines fcntl() and O_NONBLOCK.
+#endif
 #include "net_util.c"   // Defines network functions.
 #include "net_common.h" // Defines message types, etc.
 #include "../reactor.h"    // Defines instant_t.
 #include "../platform.h"
 #include "clock-sync.c" // Defines clock synchronization functions.
 #include "federate.h"   // Defines federate_instance_t
+#ifdef LF_FEDERATED_SHM
+#include "shm_util.c"   // Defines shared memory ring functions.
+#endif
+#ifdef LF_FEDERATED_COMPRESSION
+#include "compression_util.c" // Defines compress_lz4_block() and decompress_lz4_block().
+#endif
 
 // Error messages.
 char* ERROR_SENDING_HEADER = "ERROR sending header information to federate via RTI";
 char* ERROR_SENDING_MESSAGE = "ERROR sending message to federate via RTI";
 
-// Mutex lock held while performing socket write and close operations.
+// Mutex lock held while performing write and close operations on the socket to the RTI.
+// Sockets to other federates have their own locks in _fed.outbound_p2p_socket_mutexes.
 lf_mutex_t outbound_socket_mutex;
-lf_cond_t port_status_changed;
+
+// Condition variables, one for each network input port, used by control reactions
+// to wait for the status of their port. These are created on first use.
+lf_cond_t* port_status_changed = NULL;
+int port_status_changed_size = 0;
 
 /**
  * The state of this federate instance.
@@ -83,6 +98,576 @@ federate_instance_t _fed = {
         .trigger_for_network_output_control_reactions = NULL
 };
 
+#ifdef LF_FEDERATED_SHM
+/**
+ * Write the specified buffers, in order, to the specified destination. If messages
+ * to the destination go through shared memory, write them to its ring, and otherwise
+ * to the specified socket. If an error occurs, then if the format string is non-null,
+ * unlock the specified mutex, report an error, and exit, as
+ * write_vector_to_socket_errexit_with_mutex() does.
+ * @param destination The ID of the federate to which the socket is connected, or
+ *  a negative number or NUMBER_OF_FEDERATES if it is connected to the RTI.
+ * @param socket The socket ID.
+ * @param vector The buffers to write. This array may be modified.
+ * @param count The number of buffers.
+ * @param mutex If non-NULL, the mutex to unlock before exiting.
+ * @param format A format string for error messages, followed by any number of
+ *  fields that will be used to fill the format string as in printf, or NULL
+ *  to prevent exit on error.
+ * @return The number of bytes written, or 0 or a negative number if an error occurred.
+ */
+ssize_t _lf_write_vector_to_federate_errexit_with_mutex(int destination, int socket,
+        struct iovec* vector, int count, lf_mutex_t* mutex, char* format, ...) {
+    shm_ring_t* ring = (destination >= 0 && destination < NUMBER_OF_FEDERATES) ?
+            _fed.outbound_p2p_rings[destination] : NULL;
+    size_t num_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        num_bytes += vector[i].iov_len;
+    }
+    ssize_t bytes_written;
+    if (ring != NULL) {
+        bytes_written = write_vector_to_shm_ring(ring, vector, count);
+    } else {
+        bytes_written = write_vector_to_socket_errexit_with_mutex(socket, vector, count, NULL, NULL);
+    }
+    if (bytes_written == (ssize_t)num_bytes || format == NULL) {
+        return bytes_written;
+    }
+    int error_code = errno;
+    char description[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(description, sizeof(description), format, args);
+    va_end(args);
+    if (ring == NULL) {
+        shutdown(socket, SHUT_RDWR);
+        close(socket);
+    }
+    if (mutex != NULL) {
+        lf_mutex_unlock(mutex);
+    }
+    if (ring == NULL) {
+        error_print_and_exit("%s Code %d: %s.", description, error_code, strerror(error_code));
+    }
+    error_print_and_exit("%s Federate %d no longer reads from shared memory.", description, destination);
+    return bytes_written;
+}
+
+/**
+ * Read the specified number of bytes of a message from the specified federate.
+ * If it sends messages through shared memory, read them from its ring, and
+ * otherwise from the specified socket. If an error or an EOF occurs, then if
+ * the format string is non-null, report an error and exit, as
+ * read_from_socket_errexit() does.
+ * @param fed_id The ID of the federate sending the message, or -1 if the RTI.
+ * @param socket The socket ID.
+ * @param num_bytes The number of bytes to read.
+ * @param buffer The buffer into which to put the bytes.
+ * @param format A printf-style format string, followed by arguments to
+ *  fill the string, or NULL to not exit with an error message.
+ * @return The number of bytes read, or 0 if an EOF is received, or
+ *  a negative number for an error.
+ */
+ssize_t _lf_read_from_federate_errexit(int fed_id, int socket,
+        size_t num_bytes, unsigned char* buffer, char* format, ...) {
+    shm_ring_t* ring = (fed_id >= 0) ? _fed.inbound_p2p_rings[fed_id] : NULL;
+    ssize_t bytes_read;
+    if (ring != NULL) {
+        bytes_read = read_from_shm_ring(ring, num_bytes, buffer);
+    } else {
+        // On an EOF, this closes the socket.
+        bytes_read = read_from_socket(socket, num_bytes, buffer);
+    }
+    if (bytes_read == (ssize_t)num_bytes || format == NULL) {
+        return bytes_read;
+    }
+    char description[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(description, sizeof(description), format, args);
+    va_end(args);
+    error_print("Failed to read %zu bytes from federate %d.", num_bytes, fed_id);
+    error_print_and_exit("%s", description);
+    return bytes_read;
+}
+
+/**
+ * Offer the federate at the other end of the specified socket, which has just
+ * accepted this federate's connection, to send the messages on it through a
+ * ring in shared memory. If it accepts, store the ring in _fed.outbound_p2p_rings.
+ * The name of the shared memory object is removed once the remote federate has
+ * responded, so the object is freed when both federates have unmapped it.
+ * @param socket_id The socket connected to the remote federate.
+ * @param remote_federate_id The ID of the remote federate.
+ */
+void _lf_offer_shm_ring(int socket_id, uint16_t remote_federate_id) {
+    char name[SHM_RING_NAME_LENGTH];
+    snprintf(name, sizeof(name), "/lf_%ld_%d_%d", (long)getpid(), _lf_my_fed_id, remote_federate_id);
+    // The nonce makes sure that the remote federate does not open another
+    // object that happens to have the same name on its host.
+    uint64_t nonce = ((uint64_t)get_physical_time() << 16) ^ ((uint64_t)getpid() << 40) ^ (uint64_t)rand();
+    shm_ring_t* ring = create_shm_ring(name, LF_FEDERATED_SHM_CAPACITY, nonce);
+
+    unsigned char buffer[MSG_TYPE_P2P_SHM_OFFER_HEADER_SIZE];
+    buffer[0] = MSG_TYPE_P2P_SHM_OFFER;
+    encode_int64((int64_t)nonce, &buffer[1]);
+    unsigned char name_length = (ring == NULL) ? 0 : (unsigned char)strlen(name);
+    buffer[1 + sizeof(uint64_t)] = name_length;
+    struct iovec vector[2] = {
+        {.iov_base = buffer, .iov_len = MSG_TYPE_P2P_SHM_OFFER_HEADER_SIZE},
+        {.iov_base = name, .iov_len = name_length}
+    };
+    write_vector_to_socket_errexit_with_mutex(socket_id, vector, 2, NULL,
+            "Failed to offer shared memory to federate %d.", remote_federate_id);
+    unsigned char response;
+    read_from_socket_errexit(socket_id, 1, &response,
+            "Failed to read the response of federate %d to the offer of shared memory.",
+            remote_federate_id);
+    if (ring == NULL) {
+        return;
+    }
+    shm_unlink(name);
+    if (response == MSG_TYPE_ACK) {
+        LOG_PRINT("Sending messages to federate %d through shared memory.", remote_federate_id);
+        _fed.outbound_p2p_rings[remote_federate_id] = ring;
+    } else {
+        LOG_PRINT("Federate %d cannot read from shared memory. Using the socket.", remote_federate_id);
+        unmap_shm_ring(ring);
+    }
+}
+
+/**
+ * Read the offer to send messages through shared memory that the federate at
+ * the other end of the specified socket sends once this federate has accepted its
+ * connection, and accept it if the ring can be opened, which is the case if both
+ * federates run on the same host. If the offer is accepted, store the ring in
+ * _fed.inbound_p2p_rings.
+ * @param socket_id The socket connected to the remote federate.
+ * @param remote_fed_id The ID of the remote federate.
+ */
+void _lf_accept_shm_offer(int socket_id, uint16_t remote_fed_id) {
+    unsigned char buffer[MSG_TYPE_P2P_SHM_OFFER_HEADER_SIZE];
+    read_from_socket_errexit(socket_id, MSG_TYPE_P2P_SHM_OFFER_HEADER_SIZE, buffer,
+            "Failed to read the offer of shared memory from federate %d.", remote_fed_id);
+    if (buffer[0] != MSG_TYPE_P2P_SHM_OFFER) {
+        error_print_and_exit("Federate %d did not offer shared memory. Either all federates "
+                "or none must be compiled with LF_FEDERATED_SHM.", remote_fed_id);
+    }
+    uint64_t nonce = (uint64_t)extract_int64(&buffer[1]);
+    unsigned char name_length = buffer[1 + sizeof(uint64_t)];
+    char name[256];
+    read_from_socket_errexit(socket_id, name_length, (unsigned char*)name,
+            "Failed to read the name of the shared memory of federate %d.", remote_fed_id);
+    name[name_length] = '\0';
+
+    shm_ring_t* ring = (name_length > 0) ? open_shm_ring(name, nonce) : NULL;
+    unsigned char response = (ring != NULL) ? MSG_TYPE_ACK : MSG_TYPE_REJECT;
+    write_to_socket_errexit(socket_id, 1, &response,
+            "Failed to respond to the offer of shared memory from federate %d.", remote_fed_id);
+    if (ring != NULL) {
+        LOG_PRINT("Receiving messages from federate %d through shared memory.", remote_fed_id);
+        _fed.inbound_p2p_rings[remote_fed_id] = ring;
+    }
+}
+#else
+#define _lf_write_vector_to_federate_errexit_with_mutex(destination, ...) \
+        write_vector_to_socket_errexit_with_mutex(__VA_ARGS__)
+#ifndef LF_FEDERATED_EPOLL
+#define _lf_read_from_federate_errexit(fed_id, ...) read_from_socket_errexit(__VA_ARGS__)
+#endif
+#endif // LF_FEDERATED_SHM
+
+#ifdef LF_FEDERATED_EPOLL
+/**
+ * Bytes received from a federate that sends messages directly to this one.
+ * The socket is non-blocking, so the listener appends to the buffer whatever
+ * has arrived and handles each message only once all of it has arrived.
+ * While it does, the bytes of the message are read from the buffer.
+ * This is accessed only by the thread running listen_to_federates_epoll().
+ */
+typedef struct inbound_buffer_t {
+    unsigned char* buffer;
+    size_t length;          // Number of bytes received and not yet handled.
+    size_t capacity;        // Size of the buffer.
+    size_t position;        // Position of the next byte of the message being handled.
+    size_t message_end;     // End of the message being handled, or 0 if there is none.
+} inbound_buffer_t;
+
+/** The receive buffers, indexed by the ID of the sending federate. */
+inbound_buffer_t _lf_inbound_buffers[NUMBER_OF_FEDERATES];
+
+/**
+ * Read the specified number of bytes of a message from the specified federate.
+ * If the listener is handling a message from it that it has received in full,
+ * read from that message, and otherwise from the specified socket. If the
+ * message does not have that many bytes left, or if an error or an EOF occurs,
+ * then if the format string is non-null, report an error and exit, as
+ * read_from_socket_errexit() does.
+ * @param fed_id The ID of the federate sending the message, or -1 if the RTI.
+ * @param socket The socket ID.
+ * @param num_bytes The number of bytes to read.
+ * @param buffer The buffer into which to put the bytes.
+ * @param format A printf-style format string, followed by arguments to
+ *  fill the string, or NULL to not exit with an error message.
+ * @return The number of bytes read, or 0 if an EOF is received, or
+ *  a negative number for an error.
+ */
+ssize_t _lf_read_from_federate_errexit(int fed_id, int socket,
+        size_t num_bytes, unsigned char* buffer, char* format, ...) {
+    inbound_buffer_t* inbound = (fed_id >= 0) ? &_lf_inbound_buffers[fed_id] : NULL;
+    ssize_t bytes_read;
+    if (inbound != NULL && inbound->message_end > 0) {
+        size_t available = inbound->message_end - inbound->position;
+        bytes_read = (ssize_t)((num_bytes < available) ? num_bytes : available);
+        memcpy(buffer, &inbound->buffer[inbound->position], (size_t)bytes_read);
+        inbound->position += (size_t)bytes_read;
+    } else {
+        // On an EOF, this closes the socket.
+        bytes_read = read_from_socket(socket, num_bytes, buffer);
+    }
+    if (bytes_read == (ssize_t)num_bytes || format == NULL) {
+        return bytes_read;
+    }
+    char description[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(description, sizeof(description), format, args);
+    va_end(args);
+    error_print("Failed to read %zu bytes from federate %d.", num_bytes, fed_id);
+    error_print_and_exit("%s", description);
+    return bytes_read;
+}
+#endif // LF_FEDERATED_EPOLL
+
+#ifdef LF_FEDERATED_COMPRESSION
+/** Statistics on the compression of the messages sent by this federate. */
+typedef struct compression_stats_t {
+    size_t messages;            // Number of messages sent compressed.
+    size_t message_bytes;       // Total length of those messages.
+    size_t compressed_bytes;    // Total length of their compressed bodies.
+    size_t incompressible;      // Number of messages long enough that did not get smaller.
+} compression_stats_t;
+
+compression_stats_t _lf_compression_stats = {0, 0, 0, 0};
+
+/**
+ * Offer the federate at the other end of the specified socket, which has just
+ * accepted this federate's connection, to compress the messages sent to it,
+ * unless they are sent through shared memory. If it accepts, record that in
+ * _fed.outbound_p2p_compression.
+ * @param socket_id The socket connected to the remote federate.
+ * @param remote_federate_id The ID of the remote federate.
+ */
+void _lf_offer_compression(int socket_id, uint16_t remote_federate_id) {
+#ifdef LF_FEDERATED_SHM
+    if (_fed.outbound_p2p_rings[remote_federate_id] != NULL) {
+        return;
+    }
+#endif
+    unsigned char buffer[MSG_TYPE_P2P_COMPRESSION_OFFER_LENGTH];
+    buffer[0] = MSG_TYPE_P2P_COMPRESSION_OFFER;
+    buffer[1] = COMPRESSION_LZ4_BLOCK;
+    write_to_socket_errexit(socket_id, MSG_TYPE_P2P_COMPRESSION_OFFER_LENGTH, buffer,
+            "Failed to offer compression to federate %d.", remote_federate_id);
+    unsigned char response;
+    read_from_socket_errexit(socket_id, 1, &response,
+            "Failed to read the response of federate %d to the offer of compression.",
+            remote_federate_id);
+    _fed.outbound_p2p_compression[remote_federate_id] = (response == MSG_TYPE_ACK);
+    LOG_PRINT("Federate %d %s compressed messages.", remote_federate_id,
+            (response == MSG_TYPE_ACK) ? "accepts" : "does not accept");
+}
+
+/**
+ * Read the offer to compress messages that the federate at the other end of the
+ * specified socket sends once this federate has accepted its connection, unless
+ * it sends its messages through shared memory, and accept it if the compression
+ * format is known.
+ * @param socket_id The socket connected to the remote federate.
+ * @param remote_fed_id The ID of the remote federate.
+ */
+void _lf_accept_compression_offer(int socket_id, uint16_t remote_fed_id) {
+#ifdef LF_FEDERATED_SHM
+    if (_fed.inbound_p2p_rings[remote_fed_id] != NULL) {
+        return;
+    }
+#endif
+    unsigned char buffer[MSG_TYPE_P2P_COMPRESSION_OFFER_LENGTH];
+    read_from_socket_errexit(socket_id, MSG_TYPE_P2P_COMPRESSION_OFFER_LENGTH, buffer,
+            "Failed to read the offer of compression from federate %d.", remote_fed_id);
+    if (buffer[0] != MSG_TYPE_P2P_COMPRESSION_OFFER) {
+        error_print_and_exit("Federate %d did not offer compression. Either all federates "
+                "or none must be compiled with LF_FEDERATED_COMPRESSION.", remote_fed_id);
+    }
+    unsigned char response = (buffer[1] == COMPRESSION_LZ4_BLOCK) ? MSG_TYPE_ACK : MSG_TYPE_REJECT;
+    write_to_socket_errexit(socket_id, 1, &response,
+            "Failed to respond to the offer of compression from federate %d.", remote_fed_id);
+}
+
+/**
+ * If the specified federate accepts compressed messages and the specified
+ * message is long enough, compress it. If this makes it smaller, change the
+ * message type and length in the specified header of a MSG_TYPE_P2P_MESSAGE or
+ * MSG_TYPE_P2P_TAGGED_MESSAGE to those of the compressed message and return
+ * its body, which must be freed with _lf_free_compressed_body().
+ * @param federate The ID of the destination federate.
+ * @param header The header of the message.
+ * @param message The message.
+ * @param length The length of the message.
+ * @param body_length Where to store the length of the body.
+ * @return The body of the compressed message, or NULL to send the message as is.
+ */
+unsigned char* _lf_compress_message(unsigned short federate, unsigned char* header,
+        unsigned char* message, size_t length, size_t* body_length) {
+    if (!_fed.outbound_p2p_compression[federate]
+            || length < LF_FEDERATED_COMPRESSION_THRESHOLD
+            || length > INT32_MAX) {
+        return NULL;
+    }
+    unsigned char* body = (unsigned char*)_lf_malloc(LF_MEMORY_FEDERATE_BUFFERS, length);
+    if (body == NULL) {
+        return NULL;
+    }
+    // Only a body shorter than the message is useful.
+    size_t block_length = compress_lz4_block(message, length,
+            &body[sizeof(int32_t)], length - sizeof(int32_t) - 1);
+    if (block_length == 0) {
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, body, length);
+        _LF_MEMORY_ADD(&_lf_compression_stats.incompressible, 1);
+        return NULL;
+    }
+    encode_int32((int32_t)length, body);
+    *body_length = sizeof(int32_t) + block_length;
+    header[0] = (header[0] == MSG_TYPE_P2P_MESSAGE) ?
+            MSG_TYPE_P2P_MESSAGE_COMPRESSED : MSG_TYPE_P2P_TAGGED_MESSAGE_COMPRESSED;
+    encode_int32((int32_t)*body_length, &header[1 + sizeof(uint16_t) + sizeof(uint16_t)]);
+    DEBUG_PRINT("Compressed a message of length %zu to %zu bytes.", length, *body_length);
+    _LF_MEMORY_ADD(&_lf_compression_stats.messages, 1);
+    _LF_MEMORY_ADD(&_lf_compression_stats.message_bytes, length);
+    _LF_MEMORY_ADD(&_lf_compression_stats.compressed_bytes, *body_length);
+    _LF_LIVE_METRICS_ADD(bytes_compressed, length);
+    _LF_LIVE_METRICS_ADD(bytes_after_compression, *body_length);
+    return body;
+}
+
+/**
+ * Free the body returned by _lf_compress_message(), if any.
+ * @param body The body, or NULL.
+ * @param length The length of the message that was compressed.
+ */
+void _lf_free_compressed_body(unsigned char* body, size_t length) {
+    if (body != NULL) {
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, body, length);
+    }
+}
+
+/** Report how well the messages sent by this federate have been compressed. */
+void _lf_print_compression_stats() {
+    if (_lf_compression_stats.messages == 0) {
+        return;
+    }
+    info_print("Compressed %zu messages from %zu to %zu bytes (%.1f%%). "
+            "%zu other messages were not compressible.",
+            _lf_compression_stats.messages,
+            _lf_compression_stats.message_bytes,
+            _lf_compression_stats.compressed_bytes,
+            100.0 * _lf_compression_stats.compressed_bytes / _lf_compression_stats.message_bytes,
+            _lf_compression_stats.incompressible);
+}
+#else
+#define _lf_offer_compression(...)
+#define _lf_accept_compression_offer(...)
+#define _lf_compress_message(...) NULL
+#define _lf_free_compressed_body(...)
+#define _lf_print_compression_stats(...)
+#endif // LF_FEDERATED_COMPRESSION
+
+#ifdef LF_FEDERATED_BATCHING
+/**
+ * Number of bytes of tagged messages that may accumulate for one destination
+ * before they are sent without waiting for the end of the tag. Larger messages
+ * are sent immediately.
+ */
+#ifndef LF_FEDERATED_BATCH_SIZE
+#define LF_FEDERATED_BATCH_SIZE 65536
+#endif
+
+/** Index in _lf_outbound_batches of the batch for the RTI. */
+#define _LF_RTI_BATCH NUMBER_OF_FEDERATES
+
+/**
+ * Tagged messages and port absent messages waiting to be sent to one destination.
+ * Each message is stored with its header, exactly as it would have been written
+ * to the socket, so the receiver reads the messages one at a time as if they had
+ * been sent separately. A batch is guarded by the lock of its socket.
+ */
+typedef struct outbound_batch_t {
+    unsigned char* buffer;
+    size_t length;      // Number of bytes of messages in the buffer.
+    size_t capacity;    // Size of the buffer.
+    size_t messages;    // Number of messages in the buffer.
+} outbound_batch_t;
+
+/** The batches for each federate, indexed by federate ID, followed by that for the RTI. */
+outbound_batch_t _lf_outbound_batches[NUMBER_OF_FEDERATES + 1];
+
+/**
+ * Number of network input control reactions waiting for the status of their
+ * port. While this is positive, messages are sent immediately rather than
+ * batched because the input being waited for may depend on them.
+ * This is changed only while holding the mutex lock and before flushing
+ * the batches, so a sender holding the lock of a socket sees the change.
+ */
+int _lf_port_status_waits = 0;
+
+/**
+ * Return the socket to the specified destination, which is a federate ID or
+ * _LF_RTI_BATCH, and set the pointer at the specified address to its lock.
+ */
+int _lf_outbound_socket(int destination, lf_mutex_t** socket_mutex) {
+    if (destination == _LF_RTI_BATCH) {
+        *socket_mutex = &outbound_socket_mutex;
+        return _fed.socket_TCP_RTI;
+    }
+    *socket_mutex = &_fed.outbound_p2p_socket_mutexes[destination];
+    return _fed.sockets_for_outbound_p2p_connections[destination];
+}
+
+/**
+ * Send the messages in the batch for the specified destination, if any.
+ * The caller must hold the lock of the socket to that destination.
+ * @param destination A federate ID or _LF_RTI_BATCH.
+ */
+void _lf_flush_outbound_batch_already_locked(int destination) {
+    outbound_batch_t* batch = &_lf_outbound_batches[destination];
+    if (batch->length == 0) {
+        return;
+    }
+    lf_mutex_t* socket_mutex;
+    int socket = _lf_outbound_socket(destination, &socket_mutex);
+    if (socket < 0) {
+        warning_print("Socket is no longer connected. Dropping %zu messages.", batch->messages);
+    } else {
+        DEBUG_PRINT("Sending a batch of %zu messages with %zu bytes.", batch->messages, batch->length);
+        struct iovec vector = {.iov_base = batch->buffer, .iov_len = batch->length};
+        _lf_write_vector_to_federate_errexit_with_mutex(destination, socket, &vector, 1, socket_mutex,
+                "Failed to send a batch of messages.");
+    }
+    batch->length = 0;
+    batch->messages = 0;
+}
+
+/**
+ * Send the messages in all batches. This is called at the end of each tag
+ * and before this federate waits for the status of a network input port.
+ * Sending may block until the destination reads earlier messages, and its
+ * listener thread may be waiting for the mutex lock of its federate, so the
+ * caller must not hold the mutex lock.
+ */
+void _lf_flush_outbound_batches() {
+    for (int i = 0; i <= _LF_RTI_BATCH; i++) {
+        lf_mutex_t* socket_mutex;
+        _lf_outbound_socket(i, &socket_mutex);
+        lf_mutex_lock(socket_mutex);
+        _lf_flush_outbound_batch_already_locked(i);
+        lf_mutex_unlock(socket_mutex);
+    }
+}
+
+/**
+ * Add the message with the specified header and body to the batch for the
+ * specified destination, or send it immediately if it is too large to be
+ * batched or a network input control reaction is waiting. The caller must
+ * hold the lock of the socket to the destination and have checked that the
+ * socket is open.
+ * @param destination A federate ID or _LF_RTI_BATCH.
+ * @param header The message header.
+ * @param header_length The length of the header.
+ * @param body The message body, or NULL if there is none.
+ * @param length The length of the body.
+ */
+void _lf_batch_message_already_locked(int destination,
+        unsigned char* header, size_t header_length,
+        unsigned char* body, size_t length) {
+    outbound_batch_t* batch = &_lf_outbound_batches[destination];
+    size_t size = header_length + length;
+    if (batch->length + size > LF_FEDERATED_BATCH_SIZE || _lf_port_status_waits > 0) {
+        _lf_flush_outbound_batch_already_locked(destination);
+    }
+    if (batch->capacity < LF_FEDERATED_BATCH_SIZE && batch->length + size > batch->capacity) {
+        size_t capacity = (batch->capacity == 0) ? 1024 : batch->capacity;
+        while (capacity < batch->length + size && capacity < LF_FEDERATED_BATCH_SIZE) {
+            capacity *= 2;
+        }
+        if (capacity > LF_FEDERATED_BATCH_SIZE) {
+            capacity = LF_FEDERATED_BATCH_SIZE;
+        }
+        unsigned char* buffer = (unsigned char*)_lf_realloc(LF_MEMORY_FEDERATE_BUFFERS,
+                batch->buffer, batch->capacity, capacity);
+        if (buffer != NULL) {
+            batch->buffer = buffer;
+            batch->capacity = capacity;
+        }
+    }
+    if (_lf_port_status_waits > 0 || batch->length + size > batch->capacity) {
+        // Send any batched messages first so that messages arrive in the order sent.
+        _lf_flush_outbound_batch_already_locked(destination);
+        lf_mutex_t* socket_mutex;
+        int socket = _lf_outbound_socket(destination, &socket_mutex);
+        struct iovec vector[2] = {
+            {.iov_base = header, .iov_len = header_length},
+            {.iov_base = body, .iov_len = length}
+        };
+        _lf_write_vector_to_federate_errexit_with_mutex(destination, socket, vector, 2, socket_mutex,
+                "Failed to send a message.");
+        return;
+    }
+    memcpy(&batch->buffer[batch->length], header, header_length);
+    if (length > 0) {
+        memcpy(&batch->buffer[batch->length + header_length], body, length);
+    }
+    batch->length += size;
+    batch->messages++;
+}
+
+/**
+ * Record that a network input control reaction is about to wait for the
+ * status of its port and send all batched messages. The caller must hold
+ * the mutex lock, which is released while the messages are sent, so the
+ * status of the port may have changed when this returns.
+ */
+void _lf_begin_port_status_wait() {
+    _LF_MEMORY_ADD(&_lf_port_status_waits, 1);
+    _LF_UNLOCK_MUTEX();
+    _lf_flush_outbound_batches();
+    _LF_LOCK_MUTEX();
+}
+
+/**
+ * Record that a network input control reaction is done waiting.
+ * The caller must hold the mutex lock.
+ */
+void _lf_end_port_status_wait() {
+    _LF_MEMORY_ADD(&_lf_port_status_waits, -1);
+}
+
+/** Free the buffers of all batches after they have been flushed. */
+void _lf_free_outbound_batches() {
+    for (int i = 0; i <= _LF_RTI_BATCH; i++) {
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, _lf_outbound_batches[i].buffer, _lf_outbound_batches[i].capacity);
+        _lf_outbound_batches[i].buffer = NULL;
+        _lf_outbound_batches[i].capacity = 0;
+    }
+}
+#else
+#define _LF_RTI_BATCH NUMBER_OF_FEDERATES
+#define _lf_flush_outbound_batch_already_locked(...)
+#define _lf_flush_outbound_batches(...)
+#define _lf_begin_port_status_wait(...)
+#define _lf_end_port_status_wait(...)
+#define _lf_free_outbound_batches(...)
+#endif // LF_FEDERATED_BATCHING
+
 /** 
  * Thread that listens for inputs from other federates.
  * This thread listens for messages of type MSG_TYPE_P2P_TAGGED_MESSAGE
@@ -94,6 +679,9 @@ federate_instance_t _fed = {
  *  This procedure frees the memory pointed to before returning.
  */
 void* listen_to_federates(void* args);
+#ifdef LF_FEDERATED_EPOLL
+void* listen_to_federates_epoll(void* ignored);
+#endif
 
 
 /**
@@ -214,7 +802,7 @@ void create_server(int specified_port) {
 
 /**
  * Send a message to another federate directly or via the RTI.
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
+ * This method assumes that the caller does not hold the lock for the outbound socket,
  * which it acquires to perform the send.
  *
  * If the socket connection to the remote federate or the RTI has been broken,
@@ -266,8 +854,18 @@ int send_message(int message_type,
 
     // Header:  message_type + port_id + federate_id + length of message + timestamp + microstep
     const int header_length = 1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t);
-    // Use a mutex lock to prevent multiple threads from simultaneously sending.
-    lf_mutex_lock(&outbound_socket_mutex);
+    // Compress the message if the destination federate accepts that. Whether it
+    // does is settled when the connection is made, so this needs no lock.
+    size_t body_length = length;
+    unsigned char* compressed_body = (message_type == MSG_TYPE_P2P_MESSAGE) ?
+            _lf_compress_message(federate, header_buffer, message, length, &body_length) : NULL;
+    // Use a mutex lock to prevent multiple threads from simultaneously sending
+    // on the same socket. Sends to other destinations are not blocked.
+    lf_mutex_t* socket_mutex = &outbound_socket_mutex;
+    if (message_type == MSG_TYPE_P2P_MESSAGE || message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) {
+        socket_mutex = &_fed.outbound_p2p_socket_mutexes[federate];
+    }
+    lf_mutex_lock(socket_mutex);
     // First, check that the socket is still connected. This must done
     // while holding the mutex lock.
     int socket = -1;
@@ -278,14 +876,26 @@ int send_message(int message_type,
     }
     if (socket < 0) {
     	warning_print("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
+        lf_mutex_unlock(socket_mutex);
+        _lf_free_compressed_body(compressed_body, length);
     	return 0;
     }
-    write_to_socket_errexit_with_mutex(socket, header_length, header_buffer, &outbound_socket_mutex,
-            "Failed to send message header to to %s.", next_destination_str);
-    write_to_socket_errexit_with_mutex(socket, length, message, &outbound_socket_mutex,
-            "Failed to send message body to to %s.", next_destination_str);
-    lf_mutex_unlock(&outbound_socket_mutex);
+    // Send any batched messages first so that messages arrive in the order sent.
+    _lf_flush_outbound_batch_already_locked(
+            (message_type == MSG_TYPE_P2P_MESSAGE) ? federate : _LF_RTI_BATCH);
+    // Send the header and the body with one system call.
+    struct iovec vector[2] = {
+        {.iov_base = header_buffer, .iov_len = header_length},
+        {.iov_base = (compressed_body != NULL) ? compressed_body : message, .iov_len = body_length}
+    };
+    _lf_write_vector_to_federate_errexit_with_mutex(
+            (message_type == MSG_TYPE_P2P_MESSAGE) ? federate : -1,
+            socket, vector, 2, socket_mutex,
+            "Failed to send message to %s.", next_destination_str);
+    lf_mutex_unlock(socket_mutex);
+    _lf_free_compressed_body(compressed_body, length);
+    _LF_LIVE_METRICS_ADD(messages_sent, 1);
+    _LF_LIVE_METRICS_ADD(bytes_sent, body_length);
     return 1;
 }
 
@@ -301,7 +911,7 @@ int send_message(int message_type,
  * If the socket connection to the remote federate or the RTI has been broken,
  * then this returns 0 without sending. Otherwise, it returns 1.
  *
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
+ * This method assumes that the caller does not hold the lock for the outbound socket,
  * which it acquires to perform the send.
  * 
  * @note This function is similar to send_message() except that it
@@ -382,8 +992,20 @@ int send_timed_message(interval_t additional_delay,
         return 0;
     }
 
-    // Use a mutex lock to prevent multiple threads from simultaneously sending.
-    lf_mutex_lock(&outbound_socket_mutex);
+    // Compress the message if the destination federate accepts that. Whether it
+    // does is settled when the connection is made, so this needs no lock.
+    size_t body_length = length;
+    unsigned char* compressed_body = (message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) ?
+            _lf_compress_message(federate, header_buffer, message, length, &body_length) : NULL;
+    unsigned char* body = (compressed_body != NULL) ? compressed_body : message;
+
+    // Use a mutex lock to prevent multiple threads from simultaneously sending
+    // on the same socket. Sends to other destinations are not blocked.
+    lf_mutex_t* socket_mutex = &outbound_socket_mutex;
+    if (message_type == MSG_TYPE_P2P_MESSAGE || message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) {
+        socket_mutex = &_fed.outbound_p2p_socket_mutexes[federate];
+    }
+    lf_mutex_lock(socket_mutex);
     // First, check that the socket is still connected. This must done
     // while holding the mutex lock.
     int socket = -1;
@@ -394,14 +1016,30 @@ int send_timed_message(interval_t additional_delay,
     }
     if (socket < 0) {
     	warning_print("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
+        lf_mutex_unlock(socket_mutex);
+        _lf_free_compressed_body(compressed_body, length);
     	return 0;
     }
-    write_to_socket_errexit_with_mutex(socket, header_length, header_buffer, &outbound_socket_mutex,
-            "Failed to send timed message header to %s.", next_destination_str);
-    write_to_socket_errexit_with_mutex(socket, length, message, &outbound_socket_mutex,
-            "Failed to send timed message body to %s.", next_destination_str);
-    lf_mutex_unlock(&outbound_socket_mutex);
+#ifdef LF_FEDERATED_BATCHING
+    // Send the message with the others to the same destination at the end of the tag.
+    _lf_batch_message_already_locked(
+            (message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) ? federate : _LF_RTI_BATCH,
+            header_buffer, header_length, body, body_length);
+#else
+    // Send the header and the body with one system call.
+    struct iovec vector[2] = {
+        {.iov_base = header_buffer, .iov_len = header_length},
+        {.iov_base = body, .iov_len = body_length}
+    };
+    _lf_write_vector_to_federate_errexit_with_mutex(
+            (message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) ? federate : -1,
+            socket, vector, 2, socket_mutex,
+            "Failed to send timed message to %s.", next_destination_str);
+#endif
+    lf_mutex_unlock(socket_mutex);
+    _lf_free_compressed_body(compressed_body, length);
+    _LF_LIVE_METRICS_ADD(messages_sent, 1);
+    _LF_LIVE_METRICS_ADD(bytes_sent, body_length);
     return 1;
 }
 
@@ -424,6 +1062,7 @@ void _lf_send_time(unsigned char type, instant_t time) {
         lf_mutex_unlock(&outbound_socket_mutex);
     	return;
     }
+    _lf_flush_outbound_batch_already_locked(_LF_RTI_BATCH);
     ssize_t bytes_written = write_to_socket(_fed.socket_TCP_RTI, bytes_to_write, buffer);
     if (bytes_written < (ssize_t)bytes_to_write) {
         if (errno == ENOTCONN) {
@@ -461,6 +1100,7 @@ void _lf_send_tag(unsigned char type, tag_t tag) {
         lf_mutex_unlock(&outbound_socket_mutex);
     	return;
     }
+    _lf_flush_outbound_batch_already_locked(_LF_RTI_BATCH);
     ssize_t bytes_written = write_to_socket(_fed.socket_TCP_RTI, bytes_to_write, buffer);
     if (bytes_written < (ssize_t)bytes_to_write) {
         if (errno == ENOTCONN) {
@@ -484,13 +1124,33 @@ void _lf_send_tag(unsigned char type, tag_t tag) {
  * Thread to accept connections from other federates that send this federate
  * messages directly (not through the RTI). This thread starts a thread for
  * each accepted socket connection and, once it has opened all expected
- * sockets, exits.
+ * sockets, exits. If LF_FEDERATED_EPOLL is defined, it instead starts one
+ * thread that listens to all the sockets and adds each accepted socket to
+ * the set that this thread waits on.
  * @param ignored No argument needed for this thread.
  */
 void* handle_p2p_connections_from_federates(void* ignored) {
     int received_federates = 0;
+#ifdef LF_FEDERATED_EPOLL
+    _fed.inbound_p2p_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (_fed.inbound_p2p_epoll_fd < 0) {
+        error_print_and_exit("Failed to create an epoll instance: %s.", strerror(errno));
+    }
+    // Allocate memory to store the ID of the one listening thread and start it.
+    _fed.inbound_socket_listeners = (lf_thread_t*)_lf_calloc(LF_MEMORY_FEDERATE_BUFFERS,
+            1, sizeof(lf_thread_t));
+    int result = lf_thread_create(&_fed.inbound_socket_listeners[0], listen_to_federates_epoll, NULL);
+    if (result != 0) {
+        error_print_and_exit(
+                "Failed to create a thread to listen for incoming messages. Error code: %d.",
+                result
+        );
+    }
+#else
     // Allocate memory to store thread IDs.
-    _fed.inbound_socket_listeners = (lf_thread_t*)calloc(_fed.number_of_inbound_p2p_connections, sizeof(lf_thread_t));
+    _fed.inbound_socket_listeners = (lf_thread_t*)_lf_calloc(LF_MEMORY_FEDERATE_BUFFERS,
+            _fed.number_of_inbound_p2p_connections, sizeof(lf_thread_t));
+#endif
     while (received_federates < _fed.number_of_inbound_p2p_connections) {
         // Wait for an incoming connection request.
         struct sockaddr client_fd;
@@ -554,12 +1214,34 @@ void* handle_p2p_connections_from_federates(void* ignored) {
         write_to_socket_errexit(socket_id, 1, (unsigned char*)&response,
                 "Failed to write MSG_TYPE_ACK in response to federate %d.",
                 remote_fed_id);
-
+#ifdef LF_FEDERATED_SHM
+        _lf_accept_shm_offer(socket_id, remote_fed_id);
+#endif
+        _lf_accept_compression_offer(socket_id, remote_fed_id);
+
+#ifdef LF_FEDERATED_EPOLL
+        // Wait for incoming messages on this socket together with the others
+        // without blocking on any of them. The event records both the
+        // federate ID and the socket because
+        // _fed.sockets_for_inbound_p2p_connections[remote_fed_id] is set to -1
+        // by _lf_request_close_inbound_socket() before the socket is closed.
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = ((uint64_t)remote_fed_id << 32) | (uint32_t)socket_id;
+        int flags = fcntl(socket_id, F_GETFL);
+        if (flags < 0 || fcntl(socket_id, F_SETFL, flags | O_NONBLOCK) != 0
+                || epoll_ctl(_fed.inbound_p2p_epoll_fd, EPOLL_CTL_ADD, socket_id, &event) != 0) {
+            close(socket_id);
+            _fed.sockets_for_inbound_p2p_connections[remote_fed_id] = -1;
+            error_print_and_exit("Failed to listen for messages from federate %d: %s.",
+                    remote_fed_id, strerror(errno));
+        }
+#else
         // Start a thread to listen for incoming messages from other federates.
         // We cannot pass a pointer to remote_fed_id to the thread we need to create
         // because that variable is on the stack. Instead, we malloc memory.
         // The created thread is responsible for calling free().
-        uint16_t* remote_fed_id_copy = (uint16_t*)malloc(sizeof(uint16_t));
+        uint16_t* remote_fed_id_copy = (uint16_t*)_lf_malloc(LF_MEMORY_FEDERATE_BUFFERS, sizeof(uint16_t));
         if (remote_fed_id_copy == NULL) {
             error_print_and_exit("malloc failed.");
         }
@@ -577,6 +1259,7 @@ void* handle_p2p_connections_from_federates(void* ignored) {
                     result
             );
         }
+#endif
 
         received_federates++;
     }
@@ -588,12 +1271,20 @@ void* handle_p2p_connections_from_federates(void* ignored) {
 /**
  * Close the socket that sends outgoing messages to the
  * specified federate ID. This function assumes the caller holds
- * the outbound_socket_mutex mutex lock.
+ * the lock in _fed.outbound_p2p_socket_mutexes for that federate.
  * @param The ID of the peer federate receiving messages from this
  *  federate, or -1 if the RTI (centralized coordination).
  */
 void _lf_close_outbound_socket(int fed_id) {
 	assert (fed_id >= 0 && fed_id < NUMBER_OF_FEDERATES);
+#ifdef LF_FEDERATED_SHM
+	if (_fed.outbound_p2p_rings[fed_id] != NULL) {
+	    // The remote federate reads what has been written and then sees an EOF.
+	    close_shm_ring(_fed.outbound_p2p_rings[fed_id]);
+	    unmap_shm_ring(_fed.outbound_p2p_rings[fed_id]);
+	    _fed.outbound_p2p_rings[fed_id] = NULL;
+	}
+#endif
 	if (_fed.sockets_for_outbound_p2p_connections[fed_id] >= 0) {
         shutdown(_fed.sockets_for_outbound_p2p_connections[fed_id], SHUT_RDWR);
         close(_fed.sockets_for_outbound_p2p_connections[fed_id]);
@@ -614,18 +1305,19 @@ void* listen_for_upstream_messages_from_downstream_federates(void* fed_id_ptr) {
     uint16_t fed_id = *((uint16_t*)fed_id_ptr);
     unsigned char message;
 
-    lf_mutex_lock(&outbound_socket_mutex);
+    lf_mutex_t* socket_mutex = &_fed.outbound_p2p_socket_mutexes[fed_id];
+    lf_mutex_lock(socket_mutex);
     while(_fed.sockets_for_outbound_p2p_connections[fed_id] >= 0) {
     	// Unlock the mutex before performing a blocking read.
     	// Note that there is a race condition here, but the read will return
     	// a failure if the socket gets closed.
-        lf_mutex_unlock(&outbound_socket_mutex);
+        lf_mutex_unlock(socket_mutex);
 
         DEBUG_PRINT("Thread listening for MSG_TYPE_CLOSE_REQUEST from federate %d", fed_id);
     	ssize_t bytes_read = read_from_socket(
     			_fed.sockets_for_outbound_p2p_connections[fed_id], 1, &message);
     	// Reacquire the mutex lock before closing or reading the socket again.
-        lf_mutex_lock(&outbound_socket_mutex);
+        lf_mutex_lock(socket_mutex);
 
         if (bytes_read == 1 && message == MSG_TYPE_CLOSE_REQUEST) {
     		// Received a request to close the socket.
@@ -633,7 +1325,7 @@ void* listen_for_upstream_messages_from_downstream_federates(void* fed_id_ptr) {
     		_lf_close_outbound_socket(fed_id);
     	}
     }
-    lf_mutex_unlock(&outbound_socket_mutex);
+    lf_mutex_unlock(socket_mutex);
     return NULL;
 }
 
@@ -766,6 +1458,9 @@ void connect_to_federate(uint16_t remote_federate_id) {
             }
         } else {
             // Connect was successful.
+            // Messages on this socket are each written with one call,
+            // so there is no need to delay small ones.
+            set_socket_no_delay(socket_id);
             size_t buffer_length = 1 + sizeof(uint16_t) + 1;
             unsigned char buffer[buffer_length];
             buffer[0] = MSG_TYPE_P2P_SENDING_FED_ID;
@@ -776,13 +1471,12 @@ void connect_to_federate(uint16_t remote_federate_id) {
             encode_uint16((uint16_t)_lf_my_fed_id, (unsigned char*)&(buffer[1]));
             unsigned char federation_id_length = (unsigned char)strnlen(federation_id, 255);
             buffer[sizeof(uint16_t) + 1] = federation_id_length;
-            write_to_socket_errexit(socket_id,
-                    buffer_length, buffer,
-                    "Failed to send fed_id to federate %d.", remote_federate_id);
-            write_to_socket_errexit(socket_id,
-                    federation_id_length, (unsigned char*)federation_id,
-                    "Failed to send federation id to federate %d.",
-                    remote_federate_id);
+            struct iovec vector[2] = {
+                {.iov_base = buffer, .iov_len = buffer_length},
+                {.iov_base = federation_id, .iov_len = federation_id_length}
+            };
+            write_vector_to_socket_errexit_with_mutex(socket_id, vector, 2, NULL,
+                    "Failed to send fed_id and federation id to federate %d.", remote_federate_id);
 
             read_from_socket_errexit(socket_id, 1, (unsigned char*)buffer,
                     "Failed to read MSG_TYPE_ACK from federate %d in response to sending fed_id.",
@@ -796,6 +1490,10 @@ void connect_to_federate(uint16_t remote_federate_id) {
                 continue;
             } else {
                 info_print("Connected to federate %d, port %d.", remote_federate_id, port);
+#ifdef LF_FEDERATED_SHM
+                _lf_offer_shm_ring(socket_id, remote_federate_id);
+#endif
+                _lf_offer_compression(socket_id, remote_federate_id);
             }
         }
     }
@@ -805,7 +1503,7 @@ void connect_to_federate(uint16_t remote_federate_id) {
 
     // Start a thread to listen for upstream messages (MSG_TYPE_CLOSE_REQUEST) from
     // this downstream federate.
-    uint16_t* remote_fed_id_copy = (uint16_t*)malloc(sizeof(uint16_t));
+    uint16_t* remote_fed_id_copy = (uint16_t*)_lf_malloc(LF_MEMORY_FEDERATE_BUFFERS, sizeof(uint16_t));
     if (remote_fed_id_copy == NULL) {
         error_print_and_exit("malloc failed.");
     }
@@ -834,6 +1532,11 @@ void connect_to_federate(uint16_t remote_federate_id) {
  */
 void connect_to_rti(char* hostname, int port) {
     LOG_PRINT("Connecting to the RTI.");
+    // Initialize the locks for the outbound sockets before any of them is opened.
+    lf_mutex_init(&outbound_socket_mutex);
+    for (int i = 0; i < NUMBER_OF_FEDERATES; i++) {
+        lf_mutex_init(&_fed.outbound_p2p_socket_mutexes[i]);
+    }
     uint16_t uport = 0;
     if (port < 0 ||
             port > INT16_MAX) {
@@ -929,6 +1632,9 @@ void connect_to_rti(char* hostname, int port) {
 
             LOG_PRINT("Connected to an RTI. Sending federation ID for authentication.");
 
+            // Tag messages to the RTI are small and latency critical, so send them without delay.
+            set_socket_no_delay(_fed.socket_TCP_RTI);
+
             // Send the message type first.
             buffer[0] = MSG_TYPE_FED_IDS;
             // Next send the federate ID.
@@ -941,12 +1647,13 @@ void connect_to_rti(char* hostname, int port) {
             size_t federation_id_length = strnlen(federation_id, 255);
             buffer[1 + sizeof(uint16_t)] = (unsigned char)(federation_id_length & 0xff);
 
-            write_to_socket_errexit(_fed.socket_TCP_RTI, 2 + sizeof(uint16_t), buffer,
-                    "Failed to send federate ID to RTI.");
-
-            // Next send the federation ID itself.
-            write_to_socket_errexit(_fed.socket_TCP_RTI, federation_id_length, (unsigned char*)federation_id,
-                            "Failed to send federation ID to RTI.");
+            // Send the federate ID followed by the federation ID itself.
+            struct iovec vector[2] = {
+                {.iov_base = buffer, .iov_len = 2 + sizeof(uint16_t)},
+                {.iov_base = federation_id, .iov_len = federation_id_length}
+            };
+            write_vector_to_socket_errexit_with_mutex(_fed.socket_TCP_RTI, vector, 2, NULL,
+                    "Failed to send federate ID and federation ID to RTI.");
 
             // Wait for a response.
             // The response will be MSG_TYPE_REJECT if the federation ID doesn't match.
@@ -1079,14 +1786,50 @@ bool is_input_control_reaction_blocked() {
     return false;
 }
 
+/**
+ * Return the condition variable used to wait for the status of the
+ * specified network input port, creating those for all ports if they
+ * do not exist yet.
+ *
+ * This assumes the caller holds the mutex.
+ */
+lf_cond_t* get_port_status_changed(int portID) {
+    if (port_status_changed == NULL) {
+        int size = _fed.triggers_for_network_input_control_reactions_size;
+        port_status_changed = (lf_cond_t*)_lf_calloc(LF_MEMORY_FEDERATE_BUFFERS,
+                (size > 0) ? size : 1, sizeof(lf_cond_t));
+        if (port_status_changed == NULL) {
+            error_print_and_exit("Out of memory.");
+        }
+        for (int i = 0; i < size; i++) {
+            lf_cond_init(&port_status_changed[i]);
+        }
+        port_status_changed_size = size;
+    }
+    return &port_status_changed[portID];
+}
+
+/**
+ * Wake up the control reactions waiting for the status of the specified
+ * network input port, if there are any, and no other waiting control reactions.
+ *
+ * This assumes the caller holds the mutex.
+ */
+void notify_port_status_changed(int portID) {
+    trigger_t* network_input_port_action = _lf_action_for_port(portID);
+    if (network_input_port_action->is_a_control_reaction_waiting
+            && portID < port_status_changed_size) {
+        _LF_COND_BROADCAST(&port_status_changed[portID]);
+    }
+}
+
 /**
  * Update the last known status tag of all network input ports
  * to the value of `tag`, unless that the provided `tag` is less
  * than the last_known_status_tag of the port. This is called when
  * all inputs to network ports with tags up to an including `tag`
- * have been received by those ports. If any update occurs and if
- * there are control reactions blocked, then this broadcasts a
- * signal to potentially unblock those control reactions.
+ * have been received by those ports. For each port that is updated,
+ * this notifies the control reactions blocked on that port, if any.
  * 
  * This assumes the caller holds the mutex.
  *
@@ -1094,7 +1837,6 @@ bool is_input_control_reaction_blocked() {
  *  ports is known.
  */
 void update_last_known_status_on_input_ports(tag_t tag) {
-	bool notify = false;
     for (int i = 0; i < _fed.triggers_for_network_input_control_reactions_size; i++) {
         trigger_t* input_port_action = _lf_action_for_port(i);
         // This is called when a TAG is received.
@@ -1106,20 +1848,10 @@ void update_last_known_status_on_input_ports(tag_t tag) {
         if (compare_tags(tag,
                 input_port_action->last_known_status_tag) >= 0) {
             input_port_action->last_known_status_tag = tag;
-            if (input_port_action->is_a_control_reaction_waiting) {
-            	notify = true;
-            }
+            // If a control reaction is waiting for this port, notify it.
+            notify_port_status_changed(i);
         }
     }
-    // Then, check if any control reaction is waiting.
-    // If so, notify them.
-    // FIXME: We could put a condition variable into the trigger_t
-    // struct for each network input port, in which case this won't
-    // be a broadcast but rather a targetted signal.
-    if (notify) {
-        // Notify network input control reactions
-        lf_cond_broadcast(&port_status_changed);
-    }
 }
 
 
@@ -1148,10 +1880,7 @@ void update_last_known_status_on_input_port(tag_t tag, int port_id) {
                 }
         input_port_action->last_known_status_tag = tag;
         // If any control reaction is waiting, notify them that the status has changed
-        if (input_port_action->is_a_control_reaction_waiting) {
-            // The last known status tag of the port has changed. Notify any waiting threads.
-            lf_cond_broadcast(&port_status_changed);
-        }
+        notify_port_status_changed(port_id);
     } else {
         warning_print("Attempt to update the last known status tag "
                "of network input port %d to an earlier tag was ignored.", port_id);
@@ -1269,10 +1998,238 @@ void enqueue_network_control_reactions(pqueue_t* reaction_q) {
     enqueue_network_output_control_reactions(reaction_q);
 }
 
+/**
+ * Lock the socket over which port absent messages are sent to the federate
+ * with the specified ID and return it. With centralized coordination, this
+ * is the socket to the RTI.
+ * @param fed_ID The fed ID of the receiving federate.
+ * @param destination Where to store the federate ID or _LF_RTI_BATCH
+ *  identifying the destination of the messages.
+ * @param socket_mutex Where to store the pointer to the lock of the socket.
+ * @return The socket, or -1 if it is closed.
+ */
+int _lf_lock_port_absent_socket(unsigned short fed_ID, int* destination, lf_mutex_t** socket_mutex) {
+#ifdef FEDERATED_CENTRALIZED
+    // Send the absent message through the RTI
+    *destination = _LF_RTI_BATCH;
+    *socket_mutex = &outbound_socket_mutex;
+    lf_mutex_lock(*socket_mutex);
+    return _fed.socket_TCP_RTI;
+#else
+    // Send the absent message directly to the federate
+    *destination = fed_ID;
+    *socket_mutex = &_fed.outbound_p2p_socket_mutexes[fed_ID];
+    lf_mutex_lock(*socket_mutex);
+    return _fed.sockets_for_outbound_p2p_connections[fed_ID];
+#endif
+}
+
+/**
+ * Send a MSG_TYPE_PORT_ABSENT or MSG_TYPE_PORT_ABSENT_UNTIL message.
+ * The caller must hold the lock of the socket, which must be open.
+ * @param message_type The message type.
+ * @param port_ID The ID of the receiving port.
+ * @param fed_ID The fed ID of the receiving federate.
+ * @param tag The tag in the message.
+ * @param destination The federate ID or _LF_RTI_BATCH returned by
+ *  _lf_lock_port_absent_socket().
+ * @param socket The socket returned by _lf_lock_port_absent_socket().
+ * @param socket_mutex The lock of the socket.
+ */
+void _lf_send_port_absent_already_locked(unsigned char message_type,
+        unsigned short port_ID, unsigned short fed_ID, tag_t tag,
+        int destination, int socket, lf_mutex_t* socket_mutex) {
+    // Construct the message
+    size_t message_length = 1 + sizeof(port_ID) + sizeof(fed_ID) + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[message_length];
+
+    buffer[0] = message_type;
+    encode_uint16(port_ID, &(buffer[1]));
+    encode_uint16(fed_ID, &(buffer[1+sizeof(port_ID)]));
+    encode_tag(&(buffer[1+sizeof(port_ID)+sizeof(fed_ID)]), tag);
+
+#ifdef LF_FEDERATED_BATCHING
+    _lf_batch_message_already_locked(destination, buffer, message_length, NULL, 0);
+#else
+    struct iovec vector = {.iov_base = buffer, .iov_len = message_length};
+    _lf_write_vector_to_federate_errexit_with_mutex(destination, socket, &vector, 1, socket_mutex,
+            "Failed to send port absent message for port %hu to federate %hu.",
+            port_ID, fed_ID);
+#endif
+}
+
+#ifdef LF_FEDERATED_ABSENT_HORIZON
+/**
+ * A network input port of another federate to which this federate may send
+ * port absent messages. The table of these for a destination federate is
+ * guarded by the lock of the socket over which the messages are sent.
+ */
+typedef struct port_absent_horizon_t {
+    interval_t additional_delay;
+    tag_t absent_until;     // Largest tag up to which the port has been declared absent.
+    bool absent_now;        // Whether the port was declared absent at the current tag.
+} port_absent_horizon_t;
+
+/**
+ * The ports to which port absent messages have been sent, indexed by
+ * federate ID and then by port ID.
+ */
+port_absent_horizon_t* _lf_port_absent_horizons[NUMBER_OF_FEDERATES];
+
+/** The number of entries in each table, which exceeds the largest port ID in it. */
+size_t _lf_port_absent_horizons_size[NUMBER_OF_FEDERATES];
+
+/**
+ * Return the entry for the specified port of the specified federate, growing
+ * the table of the federate if it has none, or NULL if there is no memory for it.
+ * The caller must hold the lock of the socket to the federate.
+ */
+port_absent_horizon_t* _lf_port_absent_horizon_already_locked(unsigned short fed_ID,
+        unsigned short port_ID, interval_t additional_delay) {
+    size_t size = _lf_port_absent_horizons_size[fed_ID];
+    if (port_ID >= size) {
+        port_absent_horizon_t* horizons = (port_absent_horizon_t*)_lf_realloc(LF_MEMORY_FEDERATE_BUFFERS,
+                _lf_port_absent_horizons[fed_ID],
+                size * sizeof(port_absent_horizon_t), (port_ID + 1) * sizeof(port_absent_horizon_t));
+        if (horizons == NULL) {
+            return NULL;
+        }
+        for (size_t i = size; i <= port_ID; i++) {
+            horizons[i].additional_delay = 0LL;
+            horizons[i].absent_until = NEVER_TAG;
+            horizons[i].absent_now = false;
+        }
+        _lf_port_absent_horizons[fed_ID] = horizons;
+        _lf_port_absent_horizons_size[fed_ID] = port_ID + 1;
+    }
+    port_absent_horizon_t* horizon = &_lf_port_absent_horizons[fed_ID][port_ID];
+    horizon->additional_delay = additional_delay;
+    return horizon;
+}
+
+/**
+ * Return the latest tag that is earlier than the specified tag.
+ */
+tag_t _lf_tag_before(tag_t tag) {
+    if (tag.microstep > 0) {
+        tag.microstep--;
+    } else {
+        tag.time--;
+        tag.microstep = UINT_MAX;
+    }
+    return tag;
+}
+
+/**
+ * Return the earliest tag at which this federate may produce an output after
+ * the tag that has just completed. As for a NET, that tag is bounded by the
+ * next event on the event queue, by the inputs that upstream federates may
+ * still send, and by physical time if there are physical actions upstream of
+ * outputs. With decentralized coordination, inputs may arrive with any tag,
+ * so this returns NEVER_TAG if the federate has upstream federates.
+ *
+ * This function assumes the caller holds the mutex lock.
+ * @return The earliest tag, or NEVER_TAG if it is not later than the current tag.
+ */
+tag_t _lf_port_absent_horizon() {
+    tag_t current = get_current_tag();
+    tag_t earliest = get_next_event_tag();
+    if (_fed.min_delay_from_physical_action_to_federate_output >= 0LL) {
+        instant_t physical_time = get_physical_time()
+                + _fed.min_delay_from_physical_action_to_federate_output;
+        if (physical_time < earliest.time) {
+            earliest = (tag_t){.time = physical_time, .microstep = 0u};
+        }
+    }
+#ifdef FEDERATED_CENTRALIZED
+    if (_fed.has_upstream) {
+        // Inputs up to and including a TAG have all been received, but
+        // inputs may still arrive at a PTAG.
+        tag_t input_tag = _fed.last_TAG;
+        if (!_fed.is_last_TAG_provisional) {
+            input_tag.microstep++;
+        }
+        if (compare_tags(input_tag, current) <= 0) {
+            input_tag = (tag_t){.time = current.time, .microstep = current.microstep + 1};
+        }
+        if (compare_tags(input_tag, earliest) < 0) {
+            earliest = input_tag;
+        }
+    }
+#else
+    if (_fed.number_of_inbound_p2p_connections > 0) {
+        return NEVER_TAG;
+    }
+#endif
+    if (compare_tags(earliest, current) <= 0) {
+        return NEVER_TAG;
+    }
+    return earliest;
+}
+
+/**
+ * For each port that was declared absent at the tag that has just completed,
+ * declare it absent up to the specified tag, delayed by its connection, so
+ * that no port absent messages need to be sent for it at the tags in between.
+ * Sending may block until the destination reads earlier messages, and its
+ * listener thread may be waiting for the mutex lock of its federate, so the
+ * caller must not hold the mutex lock.
+ * @param earliest The tag returned by _lf_port_absent_horizon() at the end
+ *  of the tag, or NEVER_TAG to declare no port absent.
+ */
+void _lf_send_port_absent_horizons(tag_t earliest) {
+    for (int i = 0; i < NUMBER_OF_FEDERATES; i++) {
+        if (_lf_port_absent_horizons_size[i] == 0) {
+            continue;
+        }
+        int destination;
+        lf_mutex_t* socket_mutex;
+        int socket = _lf_lock_port_absent_socket(i, &destination, &socket_mutex);
+        for (size_t port_ID = 0; port_ID < _lf_port_absent_horizons_size[i]; port_ID++) {
+            port_absent_horizon_t* horizon = &_lf_port_absent_horizons[i][port_ID];
+            if (!horizon->absent_now) {
+                continue;
+            }
+            // The port may be present at the next tag, so clear this even
+            // if no horizon is sent.
+            horizon->absent_now = false;
+            if (earliest.time == NEVER) {
+                continue;
+            }
+            tag_t absent_until = (earliest.time == FOREVER) ? FOREVER_TAG
+                    : _lf_tag_before(delay_tag(earliest, horizon->additional_delay));
+            if (socket >= 0 && compare_tags(absent_until, horizon->absent_until) > 0) {
+                LOG_PRINT("Sending port absent until tag (%lld, %u) for port %zu to federate %d.",
+                        absent_until.time - start_time, absent_until.microstep,
+                        port_ID, i);
+                _lf_send_port_absent_already_locked(MSG_TYPE_PORT_ABSENT_UNTIL,
+                        port_ID, i, absent_until, destination, socket, socket_mutex);
+                horizon->absent_until = absent_until;
+            }
+        }
+        lf_mutex_unlock(socket_mutex);
+    }
+}
+
+/** Free the tables of ports to which port absent messages have been sent. */
+void _lf_free_port_absent_horizons() {
+    for (int i = 0; i < NUMBER_OF_FEDERATES; i++) {
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, _lf_port_absent_horizons[i],
+                _lf_port_absent_horizons_size[i] * sizeof(port_absent_horizon_t));
+        _lf_port_absent_horizons[i] = NULL;
+        _lf_port_absent_horizons_size[i] = 0;
+    }
+}
+#else
+#define _lf_free_port_absent_horizons(...)
+#endif // LF_FEDERATED_ABSENT_HORIZON
+
 /**
  * Send a port absent message to federate with fed_ID, informing the
  * remote federate that the current federate will not produce an event
  * on this network port at the current logical time.
+ * If LF_FEDERATED_ABSENT_HORIZON is defined, nothing is sent if the port
+ * has already been declared absent at that time.
  * 
  * @param additional_delay The offset applied to the timestamp
  *  using after. The additional delay will be greater or equal to zero
@@ -1284,41 +2241,45 @@ void enqueue_network_control_reactions(pqueue_t* reaction_q) {
 void send_port_absent_to_federate(interval_t additional_delay,
                                     unsigned short port_ID, 
                                   unsigned short fed_ID) {
-    // Construct the message
-    size_t message_length = 1 + sizeof(port_ID) + sizeof(fed_ID) + sizeof(instant_t) + sizeof(microstep_t);
-    unsigned char buffer[message_length];
-
     // Apply the additional delay to the current tag and use that as the intended
     // tag of the outgoing message
     tag_t current_message_intended_tag = delay_tag(get_current_tag(),
                                                     additional_delay);
 
+    int destination;
+    lf_mutex_t* socket_mutex;
+    int socket = _lf_lock_port_absent_socket(fed_ID, &destination, &socket_mutex);
+#ifdef LF_FEDERATED_ABSENT_HORIZON
+    port_absent_horizon_t* horizon = _lf_port_absent_horizon_already_locked(fed_ID,
+            port_ID, additional_delay);
+    if (horizon != NULL) {
+        horizon->absent_now = true;
+        if (compare_tags(current_message_intended_tag, horizon->absent_until) <= 0) {
+            DEBUG_PRINT("Not sending port absent for tag (%lld, %u) for port %d to federate %d "
+                    "because it has been declared absent until (%lld, %u).",
+                    current_message_intended_tag.time - start_time,
+                    current_message_intended_tag.microstep,
+                    port_ID, fed_ID,
+                    horizon->absent_until.time - start_time, horizon->absent_until.microstep);
+            lf_mutex_unlock(socket_mutex);
+            return;
+        }
+        horizon->absent_until = current_message_intended_tag;
+    }
+#endif
+
     LOG_PRINT("Sending port "
             "absent for tag (%lld, %u) for port %d to federate %d.",
             current_message_intended_tag.time - start_time,
             current_message_intended_tag.microstep,
             port_ID, fed_ID);
 
-    buffer[0] = MSG_TYPE_PORT_ABSENT;
-    encode_uint16(port_ID, &(buffer[1]));
-    encode_uint16(fed_ID, &(buffer[1+sizeof(port_ID)]));
-    encode_tag(&(buffer[1+sizeof(port_ID)+sizeof(fed_ID)]), current_message_intended_tag);
-    
-    lf_mutex_lock(&outbound_socket_mutex);
-#ifdef FEDERATED_CENTRALIZED
-    // Send the absent message through the RTI
-    int socket = _fed.socket_TCP_RTI;
-#else
-    // Send the absent message directly to the federate
-    int socket = _fed.sockets_for_outbound_p2p_connections[fed_ID];
-#endif
     // Do not write if the socket is closed.
     if (socket >= 0) {
-    	write_to_socket_errexit_with_mutex(socket, message_length, buffer, &outbound_socket_mutex,
-    			"Failed to send port absent message for port %hu to federate %hu.",
-				port_ID, fed_ID);
+        _lf_send_port_absent_already_locked(MSG_TYPE_PORT_ABSENT, port_ID, fed_ID,
+                current_message_intended_tag, destination, socket, socket_mutex);
     }
-    lf_mutex_unlock(&outbound_socket_mutex);
+    lf_mutex_unlock(socket_mutex);
 }
 
 /**
@@ -1336,7 +2297,7 @@ void wait_until_port_status_known(int port_ID, interval_t STP) {
     // Need to lock the mutex to prevent
     // a race condition with the network
     // receiver logic.
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     // See if the port status is already known.
     if (get_current_port_status(port_ID) != unknown) {
@@ -1344,7 +2305,7 @@ void wait_until_port_status_known(int port_ID, interval_t STP) {
         LOG_PRINT("------ Not waiting for network input port %d: "
                     "Status of the port is known already.", port_ID);
         mark_control_reaction_waiting(port_ID, false);
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         return;
     }
 
@@ -1364,14 +2325,26 @@ void wait_until_port_status_known(int port_ID, interval_t STP) {
     wait_until_time = current_tag.time + STP;
 #endif
 
-    // Perform the wait, unless the STP is zero.
+    // The input may depend on messages that this federate has batched, so send them.
+    _lf_begin_port_status_wait();
+
+    // Perform the wait, unless the STP is zero or the status of the port
+    // became known while the batched messages were sent.
+    if (get_current_port_status(port_ID) != unknown) {
+        LOG_PRINT("------ Not waiting for network input port %d: "
+                    "Status of the port has changed.", port_ID);
+        mark_control_reaction_waiting(port_ID, false);
+        _lf_end_port_status_wait();
+        _LF_UNLOCK_MUTEX();
+        return;
+    }
     if (wait_until_time != current_tag.time) {
         LOG_PRINT("------ Waiting until time %lldns for network input port %d at tag (%llu, %d).",
                 wait_until_time,
                 port_ID,
                 current_tag.time - start_time,
                 current_tag.microstep);
-        while(!wait_until(wait_until_time, &port_status_changed)) {
+        while(!wait_until(wait_until_time, get_port_status_changed(port_ID))) {
             // Interrupted
             DEBUG_PRINT("------ Wait for network input port %d interrupted.", port_ID);
             // Check if the status of the port is known
@@ -1380,7 +2353,8 @@ void wait_until_port_status_known(int port_ID, interval_t STP) {
                 LOG_PRINT("------ Done waiting for network input port %d: "
                             "Status of the port has changed.", port_ID);
                 mark_control_reaction_waiting(port_ID, false);
-                lf_mutex_unlock(&mutex);
+                _lf_end_port_status_wait();
+                _LF_UNLOCK_MUTEX();
                 return;
             }
         }
@@ -1407,7 +2381,8 @@ void wait_until_port_status_known(int port_ID, interval_t STP) {
         set_network_port_status(port_ID, absent);
     }
     mark_control_reaction_waiting(port_ID, false);
-    lf_mutex_unlock(&mutex);
+    _lf_end_port_status_wait();
+    _LF_UNLOCK_MUTEX();
     LOG_PRINT("------ Done waiting for network input port %d: "
                 "Wait timed out without a port status change.", port_ID);
 #endif
@@ -1481,7 +2456,7 @@ trigger_handle_t schedule_message_received_from_network_already_locked(
     }
     // Notify the main thread in case it is waiting for physical time to elapse.
     DEBUG_PRINT("Broadcasting notification that event queue changed.");
-    lf_cond_broadcast(&event_q_changed);
+    _LF_COND_BROADCAST(&event_q_changed);
     return return_value;
 }
 
@@ -1533,7 +2508,16 @@ void _lf_close_inbound_socket(int fed_id) {
         // Then shutdown and close the socket.
         shutdown(socket, SHUT_RDWR);
         close(socket);
-    } else if (_fed.sockets_for_inbound_p2p_connections[fed_id] >= 0) {
+        return;
+    }
+#ifdef LF_FEDERATED_SHM
+    if (_fed.inbound_p2p_rings[fed_id] != NULL) {
+        close_shm_ring(_fed.inbound_p2p_rings[fed_id]);
+        unmap_shm_ring(_fed.inbound_p2p_rings[fed_id]);
+        _fed.inbound_p2p_rings[fed_id] = NULL;
+    }
+#endif
+    if (_fed.sockets_for_inbound_p2p_connections[fed_id] >= 0) {
         shutdown(_fed.sockets_for_inbound_p2p_connections[fed_id], SHUT_RDWR);
         close(_fed.sockets_for_inbound_p2p_connections[fed_id]);
         _fed.sockets_for_inbound_p2p_connections[fed_id] = -1;
@@ -1554,7 +2538,7 @@ void _lf_close_inbound_socket(int fed_id) {
 void handle_port_absent_message(int socket, int fed_id) {
     size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(instant_t) + sizeof(microstep_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
+    _lf_read_from_federate_errexit(fed_id, socket, bytes_to_read, buffer,
     		"Failed to read port absent message.");
 
     // Extract the header information.
@@ -1570,12 +2554,12 @@ void handle_port_absent_message(int socket, int fed_id) {
             fed_id
     );
 
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 #ifdef FEDERATED_DECENTRALIZED
     trigger_t* network_input_port_action = _lf_action_for_port(port_id);
     if (compare_tags(intended_tag,
             network_input_port_action->last_known_status_tag) < 0) {
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         error_print_and_exit("The following contract was violated for port absent messages: In-order "
                              "delivery of messages over a TCP socket. Had status for (%lld, %u), got "
                              "port absent with intended tag (%lld, %u).",
@@ -1589,7 +2573,108 @@ void handle_port_absent_message(int socket, int fed_id) {
        // have not arrived yet.
     // Set the mutex status as absent
     update_last_known_status_on_input_port(intended_tag, port_id);
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
+}
+
+/**
+ * Handle a port absent until message received from a remote federate.
+ * This sets the last known status tag of the port specified in the
+ * message to the tag in the message, unless it is already later.
+ *
+ * This assumes the caller does not hold the mutex, which it acquires.
+ *
+ * @param socket The socket to read the message from
+ * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ */
+void handle_port_absent_until_message(int socket, int fed_id) {
+    size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[bytes_to_read];
+    _lf_read_from_federate_errexit(fed_id, socket, bytes_to_read, buffer,
+    		"Failed to read port absent until message.");
+
+    unsigned short port_id = extract_uint16(buffer);
+    tag_t absent_until = extract_tag(&(buffer[sizeof(uint16_t)+sizeof(uint16_t)]));
+
+    LOG_PRINT("Handling port absent until tag (%lld, %u) for port %d.",
+            absent_until.time - start_time,
+            absent_until.microstep,
+            port_id);
+
+    _LF_LOCK_MUTEX();
+    // Unlike for a port absent message, the tag is not advanced by a microstep
+    // if it equals the last known status tag, because the message covers the
+    // tag in it and no later tag.
+    trigger_t* network_input_port_action = _lf_action_for_port(port_id);
+    if (compare_tags(absent_until, network_input_port_action->last_known_status_tag) > 0) {
+        network_input_port_action->last_known_status_tag = absent_until;
+        notify_port_status_changed(port_id);
+    }
+    _LF_UNLOCK_MUTEX();
+}
+
+/**
+ * Read the body of a message from the specified socket into a newly allocated
+ * buffer and return it. If the body is compressed, decompress it and update
+ * the specified length to the length of the message.
+ * @param socket The socket to read the body from.
+ * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param compressed Whether the body is compressed.
+ * @param length The length of the body given in the message header.
+ * @param payload_pool If not NULL, allocate the buffer with
+ *  _lf_allocate_payload_buffer() and store its pool here. Otherwise, allocate
+ *  it with malloc().
+ */
+unsigned char* _lf_read_message_body(int socket, int fed_id, bool compressed,
+        size_t* length, int* payload_pool) {
+    size_t body_length = *length;
+    _LF_LIVE_METRICS_ADD(bytes_received, body_length);
+#ifdef LF_FEDERATED_COMPRESSION
+    unsigned char* body = NULL;
+    if (compressed) {
+        // The body is the length of the message followed by the compressed message.
+        if (body_length < sizeof(int32_t)) {
+            error_print_and_exit("Received a malformed compressed message from federate %d.", fed_id);
+        }
+        body = (unsigned char*)_lf_malloc(LF_MEMORY_FEDERATE_BUFFERS, body_length);
+        if (body == NULL) {
+            error_print_and_exit("Failed to allocate a buffer for a message of length %zu.", body_length);
+        }
+        _lf_read_from_federate_errexit(fed_id, socket, body_length, body,
+                "Failed to read message body.");
+        // A compressed block expands at most 255 times, so a larger length
+        // is malformed and must not be allocated.
+        int32_t message_length = extract_int32(body);
+        if (message_length < 0 || (uint64_t)message_length
+                > 255 * (uint64_t)(body_length - sizeof(int32_t)) + 15) {
+            error_print_and_exit("Received a malformed compressed message from federate %d.", fed_id);
+        }
+        *length = (size_t)message_length;
+    }
+#endif
+#ifdef _LF_PAYLOAD_POOL
+    unsigned char* message = (payload_pool != NULL) ?
+            (unsigned char*)_lf_allocate_payload_buffer(*length, payload_pool)
+            : (unsigned char*)malloc(*length);
+#else
+    unsigned char* message = (unsigned char*)malloc(*length);
+#endif
+    if (message == NULL && *length > 0) {
+        error_print_and_exit("Failed to allocate a buffer for a message of length %zu.", *length);
+    }
+#ifdef LF_FEDERATED_COMPRESSION
+    if (body != NULL) {
+        ssize_t decompressed = decompress_lz4_block(&body[sizeof(int32_t)],
+                body_length - sizeof(int32_t), message, *length);
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, body, body_length);
+        if (decompressed != (ssize_t)*length) {
+            error_print_and_exit("Received a malformed compressed message from federate %d.", fed_id);
+        }
+        return message;
+    }
+#endif
+    _lf_read_from_federate_errexit(fed_id, socket, body_length, message,
+    		"Failed to read message body.");
+    return message;
 }
 
 /**
@@ -1599,13 +2684,14 @@ void handle_port_absent_message(int socket, int fed_id) {
  * @param socket The socket to read the message from
  * @param buffer The buffer to read
  * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param compressed Whether the message is a MSG_TYPE_P2P_MESSAGE_COMPRESSED.
  */
-void handle_message(int socket, int fed_id) {
+void handle_message(int socket, int fed_id, bool compressed) {
     // FIXME: Need better error handling?
     // Read the header.
     size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
+    _lf_read_from_federate_errexit(fed_id, socket, bytes_to_read, buffer,
     		"Failed to read message header.");
 
     // Extract the header information.
@@ -1621,10 +2707,8 @@ void handle_message(int socket, int fed_id) {
     trigger_t* action = _lf_action_for_port(port_id);
 
     // Read the payload.
-    // Allocate memory for the message contents.
-    unsigned char* message_contents = (unsigned char*)malloc(length);
-    read_from_socket_errexit(socket, length, message_contents,
-    		"Failed to read message body.");
+    unsigned char* message_contents = _lf_read_message_body(socket, fed_id, compressed, &length, NULL);
+    _LF_LIVE_METRICS_ADD(messages_received, 1);
 
     LOG_PRINT("Message received by federate: %s. Length: %d.", message_contents, length);
 
@@ -1647,14 +2731,15 @@ void handle_message(int socket, int fed_id) {
  * @param socket The socket to read the message from.
  * @param buffer The buffer to read.
  * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param compressed Whether the message is a MSG_TYPE_P2P_TAGGED_MESSAGE_COMPRESSED.
  */
-void handle_tagged_message(int socket, int fed_id) {
+void handle_tagged_message(int socket, int fed_id, bool compressed) {
     // FIXME: Need better error handling?
     // Read the header which contains the timestamp.
     size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t)
             + sizeof(instant_t) + sizeof(microstep_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
+    _lf_read_from_federate_errexit(fed_id, socket, bytes_to_read, buffer,
     		"Failed to read timed message header");
 
     // Extract the header information.
@@ -1692,15 +2777,20 @@ void handle_tagged_message(int socket, int fed_id) {
             intended_tag.time - start_time, intended_tag.microstep, get_elapsed_logical_time(), get_microstep());
 
     // Read the payload.
-    // Allocate memory for the message contents.
-    unsigned char* message_contents = (unsigned char*)malloc(length);
-    read_from_socket_errexit(socket, length, message_contents,
-    		"Failed to read message body.");
+#ifdef _LF_PAYLOAD_POOL
+    // Read directly into a recycled buffer, which is returned to the pool
+    // when the token is freed.
+    int payload_pool;
+    unsigned char* message_contents = _lf_read_message_body(socket, fed_id, compressed, &length, &payload_pool);
+#else
+    unsigned char* message_contents = _lf_read_message_body(socket, fed_id, compressed, &length, NULL);
+#endif
+    _LF_LIVE_METRICS_ADD(messages_received, 1);
 
     // The following is only valid for string messages.
     // DEBUG_PRINT("Message received: %s.", message_contents);
 
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     // Create a token for the message
     lf_token_t* message_token = create_token(action->element_size);
@@ -1708,6 +2798,11 @@ void handle_tagged_message(int socket, int fed_id) {
 
     message_token->value = message_contents;
     message_token->length = length;
+#ifdef _LF_PAYLOAD_POOL
+    message_token->payload_pool = payload_pool;
+#endif
+    // The runtime is now responsible for freeing the message contents.
+    _lf_charge_payload(message_token);
 
     // Sanity checks
 #ifdef FEDERATED_DECENTRALIZED
@@ -1768,11 +2863,11 @@ void handle_tagged_message(int socket, int fed_id) {
         set_network_port_status(port_id, present);        
         // Port is now present. Therefore, notify the network input control reactions to
         // stop waiting and re-check the port status.
-        lf_cond_broadcast(&port_status_changed);
+        notify_port_status_changed(port_id);
 
         // Notify the main thread in case it is waiting for reactions.
         DEBUG_PRINT("Broadcasting notification that reaction queue changed.");
-        lf_cond_signal(&reaction_q_changed);
+        _LF_COND_SIGNAL(&reaction_q_changed);
     } else {
         // If no control reaction is waiting for this message, or if the intended
         // tag is in the future, use schedule functions to process the message.
@@ -1780,7 +2875,7 @@ void handle_tagged_message(int socket, int fed_id) {
         // Before that, if the current time >= stop time, discard the message.
         // But only if the stop time is not equal to the start time!
         if (compare_tags(current_tag, stop_tag) >= 0) {
-            lf_mutex_unlock(&mutex);
+            _LF_UNLOCK_MUTEX();
             warning_print("Received message too late. Already at stopping time. Discarding message.");
             return;
         }
@@ -1800,7 +2895,7 @@ void handle_tagged_message(int socket, int fed_id) {
     // logical time has been removed to avoid
     // the need for unecessary lock and unlock
     // operations.
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -1826,7 +2921,7 @@ void handle_tag_advance_grant() {
     		"Failed to read tag advance grant from RTI.");
     tag_t TAG = extract_tag(buffer);
 
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     // Update the last known status tag of all network input ports
     // to the TAG received from the RTI. Here we assume that the RTI
@@ -1844,7 +2939,7 @@ void handle_tag_advance_grant() {
         LOG_PRINT("Received Time Advance Grant (TAG): (%lld, %u).",
         		_fed.last_TAG.time - start_time, _fed.last_TAG.microstep);
     } else {
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         error_print("Received a TAG (%lld, %u) that wasn't larger "
         		"than the previous TAG or PTAG (%lld, %u). Ignoring the TAG.",
                 TAG.time - start_time, TAG.microstep,
@@ -1853,9 +2948,9 @@ void handle_tag_advance_grant() {
 
     _fed.waiting_for_TAG = false;
     // Notify everything that is blocked.
-    lf_cond_broadcast(&event_q_changed);
+    _LF_COND_BROADCAST(&event_q_changed);
 
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -1906,12 +3001,12 @@ void handle_provisional_tag_advance_grant() {
     // get updated to a PTAG value because a PTAG does not indicate that
     // the RTI knows about the status of all ports up to and _including_
     // the value of PTAG. Only a TAG message indicates that.
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     // Sanity check
     if (compare_tags(PTAG, _fed.last_TAG) < 0
     		|| (compare_tags(PTAG, _fed.last_TAG) == 0 && !_fed.is_last_TAG_provisional)) {
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         error_print_and_exit("Received a PTAG (%lld, %d) that is equal or earlier "
         		"than an already received TAG (%lld, %d).",
 				PTAG.time, PTAG.microstep,
@@ -1927,14 +3022,13 @@ void handle_provisional_tag_advance_grant() {
 
     // Even if we don't modify the event queue, we need to broadcast a change
     // because we do not need to continue to wait for a TAG.
-	lf_cond_broadcast(&event_q_changed);
+	_LF_COND_BROADCAST(&event_q_changed);
 	// Notify control reactions that are blocked.
-    // Check here whether there is any control reaction waiting
-    // before broadcasting to avoid an unnecessary broadcast.
+    // Only ports with a control reaction waiting are notified.
     // This also avoids problems waking up threads before execution
     // has started (while they are waiting for the start time).
-    if (is_input_control_reaction_blocked()) {
-    	lf_cond_broadcast(&port_status_changed);
+    for (int i = 0; i < _fed.triggers_for_network_input_control_reactions_size; i++) {
+        notify_port_status_changed(i);
     }
 
     // Possibly insert a dummy event into the event queue if current time is behind
@@ -1951,7 +3045,7 @@ void handle_provisional_tag_advance_grant() {
     	// it is already treating the current tag as PTAG cycle (e.g. at the
     	// start time) or it will be completing the current cycle and sending
     	// a LTC message shortly. In either case, there is nothing more to do.
-   	    lf_mutex_unlock(&mutex);
+   	    _LF_UNLOCK_MUTEX();
     	return;
     } else if (compare_tags(current_tag, PTAG) > 0) {
     	// Current tag is greater than the PTAG.
@@ -1965,7 +3059,7 @@ void handle_provisional_tag_advance_grant() {
     	// Send an LTC to indicate absent outputs.
     	_lf_logical_tag_complete(PTAG);
 	    // Nothing more to do.
-	   	lf_mutex_unlock(&mutex);
+	   	_LF_UNLOCK_MUTEX();
 	    return;
     } else if (PTAG.time == current_tag.time) {
     	// We now know current_tag < PTAG, but the times are equal.
@@ -1984,7 +3078,7 @@ void handle_provisional_tag_advance_grant() {
 			NULL, dummy_event_time, NULL, dummy_event_relative_microstep);
 	pqueue_insert(event_q, dummy);
 
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /** 
@@ -2016,6 +3110,7 @@ void _lf_fd_send_stop_request_to_rti() {
         lf_mutex_unlock(&outbound_socket_mutex);
     	return;
     }
+    _lf_flush_outbound_batch_already_locked(_LF_RTI_BATCH);
     write_to_socket_errexit_with_mutex(_fed.socket_TCP_RTI, MSG_TYPE_STOP_REQUEST_LENGTH, 
     		buffer, &outbound_socket_mutex,
             "Failed to send stop time %lld to the RTI.", current_tag.time - start_time);
@@ -2041,7 +3136,7 @@ void handle_stop_granted_message() {
 
     // Acquire a mutex lock to ensure that this state does change while a
     // message is transport or being used to determine a TAG.
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     tag_t received_stop_tag = extract_tag(buffer);
 
@@ -2065,12 +3160,12 @@ void handle_stop_granted_message() {
 
     _lf_decrement_global_tag_barrier_locked();
     // In case any thread is waiting on a condition, notify all.
-    lf_cond_broadcast(&reaction_q_changed);
+    _LF_COND_BROADCAST(&reaction_q_changed);
     // We signal instead of broadcast under the assumption that only
     // one worker thread can call wait_until at a given time because
     // the call to wait_until is protected by a mutex lock
-    lf_cond_signal(&event_q_changed);
-    lf_mutex_unlock(&mutex);
+    _LF_COND_SIGNAL(&event_q_changed);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -2087,11 +3182,11 @@ void handle_stop_request_message() {
 
     // Acquire a mutex lock to ensure that this state does change while a
     // message is being used to determine a TAG.
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     // Ignore the message if this federate originated a request.
     // The federate is already blocked is awaiting a MSG_TYPE_STOP_GRANTED message.
     if (_fed.sent_a_stop_request_to_rti == true) {
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         return;
     }
 
@@ -2116,9 +3211,10 @@ void handle_stop_request_message() {
     if (_fed.socket_TCP_RTI < 0) {
     	warning_print("Socket is no longer connected. Dropping message.");
         lf_mutex_unlock(&outbound_socket_mutex);
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
     	return;
     }
+    _lf_flush_outbound_batch_already_locked(_LF_RTI_BATCH);
     // Send the current logical time to the RTI. This message does not have an identifying byte since
     // since the RTI is waiting for a response from this federate.
     write_to_socket_errexit_with_mutex(
@@ -2133,7 +3229,7 @@ void handle_stop_request_message() {
     // A subsequent call to request_stop will be a no-op.
     _fed.sent_a_stop_request_to_rti = true;
 
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -2152,13 +3248,17 @@ void terminate_execution() {
     // Hence, it is paramount that these mutexes not allow for any
     // possibility of deadlock. To ensure this, this
     // function should NEVER be called while holding any mutex lock.
-    lf_mutex_lock(&outbound_socket_mutex);
+    // Send any messages that are still batched before closing the sockets.
+    _lf_flush_outbound_batches();
     for (int i=0; i < NUMBER_OF_FEDERATES; i++) {
         // Close outbound connections, in case they have not closed themselves.
         // This will result in EOF being sent to the remote federate, I think.
+        lf_mutex_lock(&_fed.outbound_p2p_socket_mutexes[i]);
         _lf_close_outbound_socket(i);
+        lf_mutex_unlock(&_fed.outbound_p2p_socket_mutexes[i]);
     }
     // Resign the federation, which will close the socket to the RTI.
+    lf_mutex_lock(&outbound_socket_mutex);
    	if (_fed.socket_TCP_RTI >= 0) {
         unsigned char message_marker = MSG_TYPE_RESIGN;
         ssize_t written = write_to_socket(_fed.socket_TCP_RTI, 1, &message_marker);
@@ -2167,6 +3267,9 @@ void terminate_execution() {
         }
     }
     lf_mutex_unlock(&outbound_socket_mutex);
+    _lf_free_outbound_batches();
+    _lf_free_port_absent_horizons();
+    _lf_print_compression_stats();
 
     // Request closing the incoming P2P sockets.
     for (int i=0; i < NUMBER_OF_FEDERATES; i++) {
@@ -2177,10 +3280,15 @@ void terminate_execution() {
     }
 
     // Wait for each inbound socket listener thread to close.
-    if (_fed.number_of_inbound_p2p_connections > 0) {
-    	LOG_PRINT("Waiting for %d threads listening for incoming messages to exit.",
-    			_fed.number_of_inbound_p2p_connections);
-    	for (int i=0; i < _fed.number_of_inbound_p2p_connections; i++) {
+#ifdef LF_FEDERATED_EPOLL
+    size_t number_of_listeners = (_fed.number_of_inbound_p2p_connections > 0) ? 1 : 0;
+#else
+    size_t number_of_listeners = _fed.number_of_inbound_p2p_connections;
+#endif
+    if (number_of_listeners > 0) {
+    	LOG_PRINT("Waiting for %zu threads listening for incoming messages to exit.",
+    			number_of_listeners);
+    	for (size_t i=0; i < number_of_listeners; i++) {
     		// Ignoring errors here.
     		lf_thread_join(_fed.inbound_socket_listeners[i], NULL);
     	}
@@ -2189,7 +3297,70 @@ void terminate_execution() {
     // Wait for the thread listening for messages from the RTI to close.
     lf_thread_join(_fed.RTI_socket_listener, NULL);
 
-    free(_fed.inbound_socket_listeners);
+    _lf_free(LF_MEMORY_FEDERATE_BUFFERS, _fed.inbound_socket_listeners,
+            number_of_listeners * sizeof(lf_thread_t));
+}
+
+/**
+ * Read one message from the specified peer federate and call the
+ * appropriate handling function for its type, which is one of
+ * MSG_TYPE_P2P_MESSAGE, MSG_TYPE_P2P_TAGGED_MESSAGE, or MSG_TYPE_PORT_ABSENT
+ * (@see net_common.h). This blocks until the first byte of the message
+ * is available.
+ * @param socket_id The socket to read the message from.
+ * @param fed_id The ID of the peer federate.
+ * @return 0 if the message was handled, or -1 if an error occurred,
+ *  an EOF was received, or the message type is invalid, in which case
+ *  the caller should stop listening to the socket and close it.
+ */
+int _lf_handle_p2p_message(int socket_id, uint16_t fed_id) {
+    // Read one byte to get the message type.
+    DEBUG_PRINT("Waiting for a P2P message on socket %d.", socket_id);
+    unsigned char message_type;
+    ssize_t bytes_read = _lf_read_from_federate_errexit(fed_id, socket_id, 1, &message_type, NULL);
+    if (bytes_read == 0) {
+        // EOF occurred. This breaks the connection.
+        info_print("Received EOF from peer federate %d. Closing the socket.", fed_id);
+        return -1;
+    } else if (bytes_read < 0) {
+        error_print("P2P socket to federate %d is broken.", fed_id);
+        return -1;
+    }
+    DEBUG_PRINT("Received a P2P message on socket %d of type %d.",
+            socket_id, message_type);
+    switch (message_type) {
+        case MSG_TYPE_P2P_MESSAGE:
+            LOG_PRINT("Received untimed message from federate %d.", fed_id);
+            handle_message(socket_id, fed_id, false);
+            break;
+        case MSG_TYPE_P2P_TAGGED_MESSAGE:
+            LOG_PRINT("Received timed message from federate %d.", fed_id);
+            handle_tagged_message(socket_id, fed_id, false);
+            break;
+#ifdef LF_FEDERATED_COMPRESSION
+        case MSG_TYPE_P2P_MESSAGE_COMPRESSED:
+            LOG_PRINT("Received compressed untimed message from federate %d.", fed_id);
+            handle_message(socket_id, fed_id, true);
+            break;
+        case MSG_TYPE_P2P_TAGGED_MESSAGE_COMPRESSED:
+            LOG_PRINT("Received compressed timed message from federate %d.", fed_id);
+            handle_tagged_message(socket_id, fed_id, true);
+            break;
+#endif
+        case MSG_TYPE_PORT_ABSENT:
+            LOG_PRINT("Received port absent message from federate %d.", fed_id);
+            handle_port_absent_message(socket_id, fed_id);
+            break;
+        case MSG_TYPE_PORT_ABSENT_UNTIL:
+            LOG_PRINT("Received port absent until message from federate %d.", fed_id);
+            handle_port_absent_until_message(socket_id, fed_id);
+            break;
+        default:
+            // FIXME: Better error handling needed.
+            error_print("Received erroneous message type: %d. Closing the socket.", message_type);
+            return -1;
+    }
+    return 0;
 }
 
 /** 
@@ -2212,54 +3383,180 @@ void* listen_to_federates(void* fed_id_ptr) {
 
     int socket_id = _fed.sockets_for_inbound_p2p_connections[fed_id];
 
-    // Buffer for incoming messages.
-    // This does not constrain the message size
-    // because the message will be put into malloc'd memory.
-    unsigned char buffer[FED_COM_BUFFER_SIZE];
-
     // Listen for messages from the federate.
-    while (1) {
-        // Read one byte to get the message type.
-        DEBUG_PRINT("Waiting for a P2P message on socket %d.", socket_id);
-        ssize_t bytes_read = read_from_socket(socket_id, 1, buffer);
-        if (bytes_read == 0) {
-            // EOF occurred. This breaks the connection.
-            info_print("Received EOF from peer federate %d. Closing the socket.", fed_id);
-            _lf_close_inbound_socket(fed_id);
+    while (_lf_handle_p2p_message(socket_id, fed_id) == 0);
+    _lf_close_inbound_socket(fed_id);
+
+    _lf_free(LF_MEMORY_FEDERATE_BUFFERS, fed_id_ptr, sizeof(uint16_t));
+    return NULL;
+}
+
+#ifdef LF_FEDERATED_EPOLL
+/**
+ * Return the length of the message from a peer federate that starts with the
+ * specified bytes, if they include enough of it to tell.
+ * @param buffer The bytes received, starting with the message type.
+ * @param length The number of bytes received.
+ * @return The length of the message, 0 if more bytes are needed to tell,
+ *  or -1 if the message is malformed. For an invalid message type, this is 1
+ *  so that _lf_handle_p2p_message() reports it.
+ */
+ssize_t _lf_p2p_message_length(unsigned char* buffer, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    size_t header_length;
+    switch (buffer[0]) {
+        case MSG_TYPE_P2P_MESSAGE:
+#ifdef LF_FEDERATED_COMPRESSION
+        case MSG_TYPE_P2P_MESSAGE_COMPRESSED:
+#endif
+            header_length = 1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t);
             break;
-        } else if (bytes_read < 0) {
-            error_print("P2P socket to federate %d is broken.", fed_id);
-            _lf_close_inbound_socket(fed_id);
+        case MSG_TYPE_P2P_TAGGED_MESSAGE:
+#ifdef LF_FEDERATED_COMPRESSION
+        case MSG_TYPE_P2P_TAGGED_MESSAGE_COMPRESSED:
+#endif
+            header_length = 1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t)
+                    + sizeof(instant_t) + sizeof(microstep_t);
             break;
+        case MSG_TYPE_PORT_ABSENT:
+        case MSG_TYPE_PORT_ABSENT_UNTIL:
+            return 1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(instant_t) + sizeof(microstep_t);
+        default:
+            return 1;
+    }
+    if (length < header_length) {
+        return 0;
+    }
+    // The length of the body follows the port ID and the federate ID.
+    int32_t body_length = extract_int32(&buffer[1 + sizeof(uint16_t) + sizeof(uint16_t)]);
+    if (body_length < 0) {
+        return -1;
+    }
+    return (ssize_t)(header_length + (size_t)body_length);
+}
+
+/**
+ * Read whatever bytes have arrived on the specified non-blocking socket from
+ * the specified peer federate into its receive buffer and handle each message
+ * that has arrived in full.
+ * @param socket_id The socket to read from.
+ * @param fed_id The ID of the peer federate.
+ * @return 0 if the socket remains open, or -1 if an error occurred, an EOF
+ *  was received, or a message was invalid, in which case the caller should
+ *  stop listening to the socket and close it.
+ */
+int _lf_receive_p2p_messages(int socket_id, uint16_t fed_id) {
+    inbound_buffer_t* inbound = &_lf_inbound_buffers[fed_id];
+    // Make room for the rest of a partly received message, or for
+    // LF_FEDERATED_EPOLL_READ_SIZE more bytes, whichever is more.
+    ssize_t message_length = _lf_p2p_message_length(inbound->buffer, inbound->length);
+    size_t capacity = inbound->length + LF_FEDERATED_EPOLL_READ_SIZE;
+    if (message_length > 0 && (size_t)message_length > capacity) {
+        capacity = (size_t)message_length;
+    }
+    if (capacity > inbound->capacity) {
+        unsigned char* buffer = (unsigned char*)_lf_realloc(LF_MEMORY_FEDERATE_BUFFERS,
+                inbound->buffer, inbound->capacity, capacity);
+        if (buffer == NULL) {
+            error_print("Failed to allocate a buffer for messages from federate %d.", fed_id);
+            return -1;
         }
-        DEBUG_PRINT("Received a P2P message on socket %d of type %d.",
-                socket_id, buffer[0]);
-        bool bad_message = false;
-        switch (buffer[0]) {
-            case MSG_TYPE_P2P_MESSAGE:
-                LOG_PRINT("Received untimed message from federate %d.", fed_id);
-                handle_message(socket_id, fed_id);
-                break;
-            case MSG_TYPE_P2P_TAGGED_MESSAGE:
-                LOG_PRINT("Received timed message from federate %d.", fed_id);
-                handle_tagged_message(socket_id, fed_id);
-                break;
-            case MSG_TYPE_PORT_ABSENT:
-                LOG_PRINT("Received port absent message from federate %d.", fed_id);
-                handle_port_absent_message(socket_id, fed_id);
-                break;
-            default:
-                bad_message = true;
+        inbound->buffer = buffer;
+        inbound->capacity = capacity;
+    }
+    ssize_t bytes_read = read(socket_id, &inbound->buffer[inbound->length],
+            inbound->capacity - inbound->length);
+    if (bytes_read == 0) {
+        // EOF occurred. This breaks the connection.
+        info_print("Received EOF from peer federate %d. Closing the socket.", fed_id);
+        return -1;
+    } else if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
         }
-        if (bad_message) {
-            // FIXME: Better error handling needed.
-            error_print("Received erroneous message type: %d. Closing the socket.", buffer[0]);
+        error_print("P2P socket to federate %d is broken.", fed_id);
+        return -1;
+    }
+    inbound->length += (size_t)bytes_read;
+
+    // Handle each message that has arrived in full.
+    size_t start = 0;
+    while ((message_length = _lf_p2p_message_length(&inbound->buffer[start], inbound->length - start)) != 0
+            && start + (size_t)message_length <= inbound->length) {
+        if (message_length < 0) {
+            error_print("Received a malformed message from federate %d. Closing the socket.", fed_id);
+            return -1;
+        }
+        inbound->position = start;
+        inbound->message_end = start + (size_t)message_length;
+        int result = _lf_handle_p2p_message(socket_id, fed_id);
+        inbound->message_end = 0;
+        if (result != 0) {
+            return -1;
+        }
+        start += (size_t)message_length;
+    }
+    // Keep the bytes of the next message at the start of the buffer.
+    inbound->length -= start;
+    if (inbound->length > 0) {
+        memmove(inbound->buffer, &inbound->buffer[start], inbound->length);
+    } else if (inbound->capacity > LF_FEDERATED_EPOLL_READ_SIZE) {
+        // Release the memory used for a large message.
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, inbound->buffer, inbound->capacity);
+        inbound->buffer = NULL;
+        inbound->capacity = 0;
+    }
+    return 0;
+}
+
+/**
+ * Thread that listens for inputs from all other federates that have
+ * connected to this federate. This thread waits with epoll until one or more
+ * of the sockets added by handle_p2p_connections_from_federates() are readable,
+ * then reads what has arrived on each of them without blocking and handles
+ * the messages that have arrived in full, as listen_to_federates() does.
+ * A federate that stalls in the middle of a message thus does not delay the
+ * messages from the others. When every inbound connection has been closed,
+ * this thread returns.
+ * @param ignored No argument needed for this thread.
+ */
+void* listen_to_federates_epoll(void* ignored) {
+    LOG_PRINT("Listening to %zu federates.", _fed.number_of_inbound_p2p_connections);
+
+    struct epoll_event events[LF_FEDERATED_EPOLL_EVENTS];
+    size_t closed_connections = 0;
+    while (closed_connections < _fed.number_of_inbound_p2p_connections) {
+        int count = epoll_wait(_fed.inbound_p2p_epoll_fd, events, LF_FEDERATED_EPOLL_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_print("Failed to wait for messages from other federates: %s.", strerror(errno));
             break;
         }
+        for (int i = 0; i < count; i++) {
+            uint16_t fed_id = (uint16_t)(events[i].data.u64 >> 32);
+            int socket_id = (int)(uint32_t)events[i].data.u64;
+            if (_lf_receive_p2p_messages(socket_id, fed_id) != 0) {
+                // Stop listening to the socket before it is closed.
+                epoll_ctl(_fed.inbound_p2p_epoll_fd, EPOLL_CTL_DEL, socket_id, NULL);
+                _lf_close_inbound_socket(fed_id);
+                closed_connections++;
+            }
+        }
+    }
+    close(_fed.inbound_p2p_epoll_fd);
+    for (int i = 0; i < NUMBER_OF_FEDERATES; i++) {
+        _lf_free(LF_MEMORY_FEDERATE_BUFFERS, _lf_inbound_buffers[i].buffer, _lf_inbound_buffers[i].capacity);
+        _lf_inbound_buffers[i].buffer = NULL;
+        _lf_inbound_buffers[i].capacity = 0;
+        _lf_inbound_buffers[i].length = 0;
     }
-    free(fed_id_ptr);
     return NULL;
 }
+#endif
 
 /** 
  * Thread that listens for TCP inputs from the RTI.
@@ -2307,7 +3604,7 @@ void* listen_to_rti_TCP(void* args) {
         }
         switch (buffer[0]) {
             case MSG_TYPE_TAGGED_MESSAGE:
-                handle_tagged_message(_fed.socket_TCP_RTI, -1);
+                handle_tagged_message(_fed.socket_TCP_RTI, -1, false);
                 break;
             case MSG_TYPE_TAG_ADVANCE_GRANT:
                 handle_tag_advance_grant();
@@ -2324,6 +3621,9 @@ void* listen_to_rti_TCP(void* args) {
             case MSG_TYPE_PORT_ABSENT:
                 handle_port_absent_message(_fed.socket_TCP_RTI, -1);
                 break;
+            case MSG_TYPE_PORT_ABSENT_UNTIL:
+                handle_port_absent_until_message(_fed.socket_TCP_RTI, -1);
+                break;
             case MSG_TYPE_CLOCK_SYNC_T1:
             case MSG_TYPE_CLOCK_SYNC_T4:
                 error_print("Federate %d received unexpected clock sync message from RTI on TCP socket.",
@@ -2516,6 +3816,22 @@ tag_t _lf_send_next_event_tag(tag_t tag, bool wait_for_reply) {
         if (compare_tags(_fed.last_TAG, tag) >= 0) {
             DEBUG_PRINT("Granted tag (%lld, %u) because TAG or PTAG has been received.",
             		_fed.last_TAG.time - start_time, _fed.last_TAG.microstep);
+#ifdef LF_FEDERATED_TAG_LOOKAHEAD
+            // While running ahead through granted tags, keep the RTI informed
+            // of the next event tag so that it can grant downstream federates
+            // tags beyond the last tag this federate has completed.
+            // Skip this if the NET would be bounded by physical time. The TAN
+            // will be sent once this federate catches up with its grant.
+            tag_t lookahead_tag = tag;
+            if (_fed.has_downstream
+            		&& compare_tags(tag, _fed.last_sent_NET) > 0
+            		&& (!wait_for_reply || !_lf_bounded_NET(&lookahead_tag))) {
+                _lf_send_tag(MSG_TYPE_NEXT_EVENT_TAG, tag);
+                _fed.last_sent_NET = tag;
+                LOG_PRINT("Sent look-ahead next event tag (NET) (%lld, %u) to RTI.",
+                        tag.time - start_time, tag.microstep);
+            }
+#endif // LF_FEDERATED_TAG_LOOKAHEAD
             return _fed.last_TAG;
         }
 
@@ -2567,7 +3883,7 @@ tag_t _lf_send_next_event_tag(tag_t tag, bool wait_for_reply) {
                 // Wait until either something changes on the event queue or
                 // the RTI has responded with a TAG.
                 DEBUG_PRINT("Waiting for a TAG from the RTI.");
-                if (lf_cond_wait(&event_q_changed, &mutex) != 0) {
+                if (_LF_COND_WAIT(&event_q_changed) != 0) {
                     error_print("Wait error.");
                 }
                 // Either a TAG or PTAG arrived.
@@ -2621,7 +3937,7 @@ tag_t _lf_send_next_event_tag(tag_t tag, bool wait_for_reply) {
             wait_until_time_ns = original_tag.time;
         }
 
-        lf_cond_timedwait(&event_q_changed, &mutex, wait_until_time_ns);
+        _LF_COND_TIMEDWAIT(&event_q_changed, wait_until_time_ns);
 
         DEBUG_PRINT("Wait finished or interrupted.");
 
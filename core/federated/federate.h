@@ -36,6 +36,94 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define ADVANCE_MESSAGE_INTERVAL MSEC(10)
 #endif
 
+/**
+ * If LF_FEDERATED_EPOLL is defined, one thread waits with epoll for messages
+ * on all inbound peer-to-peer sockets instead of one thread per socket.
+ * Since epoll is specific to Linux, this has no effect on other platforms.
+ * The sockets are non-blocking, and the bytes received on each are buffered
+ * until a whole message has arrived, so a federate that stalls in the middle
+ * of a message does not delay the messages from the others. The thread does
+ * block while it waits for the mutex lock to deliver a message.
+ */
+#if defined(LF_FEDERATED_EPOLL) && !defined(__linux__)
+#undef LF_FEDERATED_EPOLL
+#endif
+
+/**
+ * If LF_FEDERATED_SHM is defined, a federate offers each federate to which it
+ * connects directly to send the messages through a ring buffer in shared memory
+ * instead of the socket. The offer is accepted if both run on the same host.
+ * Since the rings use futexes, this has no effect on platforms other than Linux.
+ * It also has no effect if LF_FEDERATED_EPOLL is defined because a thread cannot
+ * wait with epoll for data in a ring. The handshake on direct connections
+ * differs when this is defined, so either all federates of a federation or none
+ * must be compiled with it.
+ */
+#if defined(LF_FEDERATED_SHM) && (!defined(__linux__) || defined(LF_FEDERATED_EPOLL))
+#undef LF_FEDERATED_SHM
+#endif
+
+/**
+ * If LF_FEDERATED_TAG_LOOKAHEAD is defined, a federate with centralized
+ * coordination that advances to a tag that the RTI has already granted still
+ * sends the RTI its next event tag (NET). The RTI can then grant downstream
+ * federates tags ahead of the tags this federate has completed, so that they
+ * too can run ahead without a round trip to the RTI for every tag.
+ */
+
+/**
+ * If LF_FEDERATED_ABSENT_HORIZON is defined, when a tag completes, a federate
+ * declares each network output port that was absent at that tag absent up to
+ * the earliest tag at which it may next produce an output, using
+ * MSG_TYPE_PORT_ABSENT_UNTIL. It then sends no MSG_TYPE_PORT_ABSENT for the
+ * tags in between. The RTI forwards this message regardless, but the
+ * receiving federates must understand it.
+ */
+
+/**
+ * If LF_FEDERATED_COMPRESSION is defined, a federate offers each federate to
+ * which it connects directly to compress the messages that it sends to it.
+ * Once the offer is accepted, a message at least LF_FEDERATED_COMPRESSION_THRESHOLD
+ * bytes long is sent compressed if that makes it smaller. Messages sent through
+ * shared memory or the RTI are not compressed. The handshake on direct
+ * connections differs when this is defined, so either all federates of a
+ * federation or none must be compiled with it.
+ */
+#ifdef LF_FEDERATED_COMPRESSION
+#include "compression_util.h"
+
+/** Length in bytes of the shortest message that is compressed. */
+#ifndef LF_FEDERATED_COMPRESSION_THRESHOLD
+#define LF_FEDERATED_COMPRESSION_THRESHOLD 1024
+#endif
+// A compressed body starts with the four-byte length of the message and must
+// be shorter than the message.
+#if LF_FEDERATED_COMPRESSION_THRESHOLD < 6
+#error "LF_FEDERATED_COMPRESSION_THRESHOLD must be at least 6."
+#endif
+#endif
+
+#ifdef LF_FEDERATED_SHM
+#include "shm_util.h"
+
+/** Number of bytes in the ring for each direct connection. This must be a power of two. */
+#ifndef LF_FEDERATED_SHM_CAPACITY
+#define LF_FEDERATED_SHM_CAPACITY SHM_RING_DEFAULT_CAPACITY
+#endif
+#endif
+
+#ifdef LF_FEDERATED_EPOLL
+/** Maximum number of ready sockets returned by one call to epoll_wait(). */
+#ifndef LF_FEDERATED_EPOLL_EVENTS
+#define LF_FEDERATED_EPOLL_EVENTS 64
+#endif
+
+/** Smallest number of bytes read from a socket at once when it is readable. */
+#ifndef LF_FEDERATED_EPOLL_READ_SIZE
+#define LF_FEDERATED_EPOLL_READ_SIZE 65536
+#endif
+#endif
+
 /**
  * Structure that a federate instance uses to keep track of its own state.
  */
@@ -62,10 +150,20 @@ typedef struct federate_instance_t {
 	/**
 	 * Array of thread IDs for threads that listen for incoming messages.
 	 * This is NULL if there are none and otherwise has size given by
-	 * number_of_inbound_p2p_connections.
+	 * number_of_inbound_p2p_connections, or size 1 if LF_FEDERATED_EPOLL
+	 * is defined.
 	 */
 	lf_thread_t *inbound_socket_listeners;
 
+#ifdef LF_FEDERATED_EPOLL
+	/**
+	 * The epoll instance on which the thread listening for incoming
+	 * messages waits. Each inbound socket is added to it once the
+	 * connection is accepted by handle_p2p_connections_from_federates().
+	 */
+	int inbound_p2p_epoll_fd;
+#endif
+
 	/**
 	 * Number of outbound peer-to-peer connections from the federate.
 	 * This can be either physical connections, or logical connections
@@ -103,6 +201,44 @@ typedef struct federate_instance_t {
 	 */
 	int sockets_for_outbound_p2p_connections[NUMBER_OF_FEDERATES];
 
+	/**
+	 * An array of mutex locks, one for each element of
+	 * sockets_for_outbound_p2p_connections, held while writing to or
+	 * closing the socket with the same index. Each destination has its
+	 * own lock so that a slow remote federate or a large message does not
+	 * block messages to other federates. These are initialized by
+	 * connect_to_rti(). The socket to the RTI is guarded by
+	 * outbound_socket_mutex.
+	 */
+	lf_mutex_t outbound_p2p_socket_mutexes[NUMBER_OF_FEDERATES];
+
+#ifdef LF_FEDERATED_SHM
+	/**
+	 * An array that holds, for each federate that receives messages from this
+	 * federate through shared memory, the ring to which they are written, and
+	 * NULL for the others. A ring is set by connect_to_federate() and is closed
+	 * together with the socket with the same index, which then remains open only
+	 * to close the connection. It is guarded by the same mutex as the socket.
+	 */
+	shm_ring_t* outbound_p2p_rings[NUMBER_OF_FEDERATES];
+
+	/**
+	 * An array that holds, for each federate that sends messages to this
+	 * federate through shared memory, the ring from which they are read, and
+	 * NULL for the others. A ring is set by handle_p2p_connections_from_federates().
+	 */
+	shm_ring_t* inbound_p2p_rings[NUMBER_OF_FEDERATES];
+#endif
+
+#ifdef LF_FEDERATED_COMPRESSION
+	/**
+	 * An array that holds, for each federate to which this federate sends
+	 * messages directly, whether it has accepted to receive compressed messages.
+	 * This is set by connect_to_federate().
+	 */
+	bool outbound_p2p_compression[NUMBER_OF_FEDERATES];
+#endif
+
 	/**
 	 * Thread ID for a thread that accepts sockets and then supervises
 	 * listening to those sockets for incoming P2P (physical) connections.
@@ -629,6 +629,73 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MSG_TYPE_NEIGHBOR_STRUCTURE 24
 #define MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE 9
 
+/**
+ * Byte identifying an offer to send the messages on a direct connection between
+ * federates through a ring buffer in shared memory instead of the socket.
+ * If the federates are compiled with LF_FEDERATED_SHM, the connecting federate
+ * sends this message right after it receives MSG_TYPE_ACK in response to
+ * MSG_TYPE_P2P_SENDING_FED_ID.
+ *
+ * The next eight bytes are a random number that the remote federate checks
+ * against the one stored in the ring.
+ * The next byte is the length n of the name of the shared memory object holding
+ * the ring, which is 0 if the connecting federate could not create one.
+ * The next n bytes are the name.
+ *
+ * The remote federate responds with MSG_TYPE_ACK if it has opened the ring,
+ * in which case all further messages on the connection go through the ring.
+ * Otherwise, presumably because it runs on another host, it responds with
+ * MSG_TYPE_REJECT and the socket is used.
+ */
+#define MSG_TYPE_P2P_SHM_OFFER 25
+#define MSG_TYPE_P2P_SHM_OFFER_HEADER_SIZE (1 + sizeof(uint64_t) + 1)
+
+/**
+ * A port absent message, informing the receiver that a given port will not
+ * have an event at any tag up to and including the tag in the message.
+ * This is sent instead of a MSG_TYPE_PORT_ABSENT for each of those tags by
+ * federates compiled with LF_FEDERATED_ABSENT_HORIZON.
+ *
+ * The rest of the message has the same layout as MSG_TYPE_PORT_ABSENT.
+ */
+#define MSG_TYPE_PORT_ABSENT_UNTIL 26
+
+/**
+ * Byte identifying an offer to compress the large messages on a direct
+ * connection between federates. If the federates are compiled with
+ * LF_FEDERATED_COMPRESSION, the connecting federate sends this message right
+ * after it receives MSG_TYPE_ACK in response to MSG_TYPE_P2P_SENDING_FED_ID,
+ * or, if they are also compiled with LF_FEDERATED_SHM, after the offer of
+ * shared memory has been rejected.
+ *
+ * The next byte identifies the compression format. Currently, the only one is
+ * COMPRESSION_LZ4_BLOCK.
+ *
+ * The remote federate responds with MSG_TYPE_ACK if it can decompress that
+ * format and with MSG_TYPE_REJECT otherwise.
+ */
+#define MSG_TYPE_P2P_COMPRESSION_OFFER 27
+#define MSG_TYPE_P2P_COMPRESSION_OFFER_LENGTH 2
+
+/** Compression format in which each message body is one block in the LZ4 block format. */
+#define COMPRESSION_LZ4_BLOCK 1
+
+/**
+ * Byte identifying a compressed message sent directly to another federate.
+ * The header is that of MSG_TYPE_P2P_MESSAGE, except that the length is that
+ * of the body, which is the length of the message in four bytes, followed by
+ * the compressed message.
+ */
+#define MSG_TYPE_P2P_MESSAGE_COMPRESSED 28
+
+/**
+ * Byte identifying a compressed timestamped message sent directly to another
+ * federate. The header is that of MSG_TYPE_P2P_TAGGED_MESSAGE, except that the
+ * length is that of the body, which is the length of the message in four bytes,
+ * followed by the compressed message.
+ */
+#define MSG_TYPE_P2P_TAGGED_MESSAGE_COMPRESSED 29
+
 /////////////////////////////////////////////
 //// Rejection codes
 
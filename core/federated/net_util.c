@@ -41,6 +41,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdarg.h>     // Defines va_list
 #include <time.h>       // Defines nanosleep()
 #include <math.h>       // For sqrtl() and powl
+#include <netinet/in.h> // Defines IPPROTO_TCP
+#include <netinet/tcp.h> // Defines TCP_NODELAY and TCP_CORK
 
 #ifndef NUMBER_OF_FEDERATES
 #define NUMBER_OF_FEDERATES 1
@@ -242,6 +244,111 @@ ssize_t write_to_socket(int socket, size_t num_bytes, unsigned char* buffer) {
     return write_to_socket_errexit_with_mutex(socket, num_bytes, buffer, NULL, NULL);
 }
 
+/**
+ * Write the specified buffers, in order, to the specified socket using a
+ * single sendmsg() call unless the socket accepts only part of the data,
+ * in which case the rest is written with further calls. If an error occurs,
+ * then if the format string is non-null, close the socket, report an error,
+ * and exit. If the format string is null, return without reporting.
+ *
+ * @param socket The socket ID.
+ * @param vector The buffers to write. This array is modified to skip the bytes
+ *  that have been written, but the contents of the buffers are not.
+ * @param count The number of buffers.
+ * @param mutex If non-NULL, the mutex to unlock before exiting.
+ * @param format A format string for error messages, followed by any number of
+ *  fields that will be used to fill the format string as in printf, or NULL
+ *  to prevent exit on error.
+ * @return The number of bytes written, or 0 if an EOF was received, or a negative
+ *  number if an error occurred.
+ */
+ssize_t write_vector_to_socket_errexit_with_mutex(
+		int socket,
+		struct iovec* vector,
+		int count,
+		lf_mutex_t* mutex,
+		char* format, ...) {
+    size_t num_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        num_bytes += vector[i].iov_len;
+    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = vector;
+    message.msg_iovlen = count;
+    ssize_t bytes_written = 0;
+    while (bytes_written < (ssize_t)num_bytes) {
+        ssize_t more = sendmsg(socket, &message, 0);
+        if (more <= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The error code set by the socket indicates
+            // that we should try again (@see man errno).
+            DEBUG_PRINT("Writing to socket was blocked. Will try again.");
+            continue;
+        } else if (more <= 0) {
+            if (format != NULL) {
+                int error_code = errno;
+                char description[256];
+                va_list args;
+                va_start(args, format);
+                vsnprintf(description, sizeof(description), format, args);
+                va_end(args);
+                shutdown(socket, SHUT_RDWR);
+                close(socket);
+                if (mutex != NULL) {
+                    lf_mutex_unlock(mutex);
+                }
+                error_print_and_exit("%s Code %d: %s.", description, error_code, strerror(error_code));
+            }
+            return more;
+        }
+        bytes_written += more;
+        // Skip the buffers, or the parts of a buffer, that have been written.
+        size_t skip = (size_t)more;
+        while (message.msg_iovlen > 0 && skip >= message.msg_iov->iov_len) {
+            skip -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (skip > 0) {
+            message.msg_iov->iov_base = (unsigned char*)message.msg_iov->iov_base + skip;
+            message.msg_iov->iov_len -= skip;
+        }
+    }
+    return bytes_written;
+}
+
+/**
+ * Disable Nagle's algorithm on the specified TCP socket so that small
+ * messages are sent immediately.
+ * @param socket The socket ID.
+ * @return 0 on success, or -1 if the option could not be set, in which case
+ *  a warning has been printed.
+ */
+int set_socket_no_delay(int socket) {
+    int true_variable = 1;
+    if (setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &true_variable, sizeof(true_variable)) < 0) {
+        warning_print("Failed to set TCP_NODELAY on socket %d: %s.", socket, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Cork or uncork the specified TCP socket, where supported.
+ * @param socket The socket ID.
+ * @param corked True to cork the socket, false to uncork it.
+ */
+void set_socket_cork(int socket, bool corked) {
+    int value = corked ? 1 : 0;
+#if defined(TCP_CORK)
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#elif defined(TCP_NOPUSH)
+    setsockopt(socket, IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value));
+#else
+    (void)value;
+#endif
+}
+
 /** Write the specified data as a sequence of bytes starting
  *  at the specified address. This encodes the data in little-endian
  *  order (lowest order byte first).
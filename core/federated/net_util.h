@@ -40,6 +40,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>      // Defines struct iovec
+#include <stdbool.h>
 #include "../platform.h"  // defines lf_mutex_t
 #include "../tag.h"       // Defines tag_t
 
@@ -147,6 +149,55 @@ ssize_t write_to_socket_errexit(
  */
 int write_to_socket2(int socket, int num_bytes, unsigned char* buffer);
 
+/**
+ * Write the specified buffers, in order, to the specified socket using a
+ * single sendmsg() call unless the socket accepts only part of the data,
+ * in which case the rest is written with further calls. Use this to send
+ * a message header and its payload without copying them into one buffer
+ * and without a separate system call (and possibly a separate TCP segment)
+ * for each. If an error occurs, then if the format string is non-null,
+ * close the socket, report an error, and exit. If the format string is null,
+ * return without reporting.
+ * @param socket The socket ID.
+ * @param vector The buffers to write. This array is modified to skip the bytes
+ *  that have been written, but the contents of the buffers are not.
+ * @param count The number of buffers.
+ * @param mutex If non-NULL, the mutex to unlock before exiting.
+ * @param format A format string for error messages, followed by any number of
+ *  fields that will be used to fill the format string as in printf, or NULL
+ *  to prevent exit on error.
+ * @return The number of bytes written, or 0 if an EOF was received, or a negative
+ *  number if an error occurred.
+ */
+ssize_t write_vector_to_socket_errexit_with_mutex(
+		int socket,
+		struct iovec* vector,
+		int count,
+		lf_mutex_t* mutex,
+		char* format, ...);
+
+/**
+ * Disable Nagle's algorithm on the specified TCP socket so that small
+ * messages, such as tag messages, are sent immediately rather than held back
+ * waiting for the acknowledgment of earlier data. Messages should then be
+ * written with one call each, for example with write_vector_to_socket_errexit_with_mutex().
+ * @param socket The socket ID.
+ * @return 0 on success, or -1 if the option could not be set, in which case
+ *  a warning has been printed.
+ */
+int set_socket_no_delay(int socket);
+
+/**
+ * Cork or uncork the specified TCP socket, where supported (TCP_CORK on Linux,
+ * TCP_NOPUSH on BSD and macOS). While a socket is corked, the operating system
+ * sends only full segments, so a message written with several calls goes out
+ * in as few segments as possible. Uncorking sends any remaining data at once.
+ * On other platforms, this does nothing.
+ * @param socket The socket ID.
+ * @param corked True to cork the socket, false to uncork it.
+ */
+void set_socket_cork(int socket, bool corked);
+
 /** Write the specified data as a sequence of bytes starting
  *  at the specified address. This encodes the data in little-endian
  *  order (lowest order byte first).
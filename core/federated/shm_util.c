@@ -0,0 +1,315 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Ring buffers in shared memory for federates on the same host.
+ * @see shm_util.h
+ */
+
+#include "../util.h"
+#include "shm_util.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>     // Defines memcpy()
+#include <unistd.h>     // Defines ftruncate(), getpid(), close(), and syscall()
+#include <fcntl.h>      // Defines O_CREAT, O_EXCL, and O_RDWR
+#include <signal.h>     // Defines kill()
+#include <time.h>       // Defines struct timespec
+#include <sys/mman.h>   // Defines shm_open(), mmap(), and munmap()
+#include <sys/stat.h>   // Defines fstat()
+#include <sys/syscall.h> // Defines SYS_futex
+#include <linux/futex.h> // Defines FUTEX_WAIT and FUTEX_WAKE
+
+/**
+ * Wait until the futex at the specified address no longer holds the specified
+ * value, it is woken, or SHM_RING_POLL_INTERVAL_MSEC milliseconds elapse.
+ * The futex is not private because the processes sharing it are different.
+ */
+static void _shm_futex_wait(volatile uint32_t* futex, uint32_t value) {
+    struct timespec timeout = {
+        SHM_RING_POLL_INTERVAL_MSEC / 1000,
+        (SHM_RING_POLL_INTERVAL_MSEC % 1000) * 1000000L
+    };
+    syscall(SYS_futex, futex, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+/**
+ * Increment the futex at the specified address and wake the process waiting on it.
+ */
+static void _shm_futex_wake(volatile uint32_t* futex) {
+    __sync_fetch_and_add(futex, 1);
+    syscall(SYS_futex, futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Return true if the process with the specified ID no longer exists.
+ */
+static bool _shm_process_gone(int64_t pid) {
+    return pid != 0 && kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+}
+
+/**
+ * Map the shared memory object open as the specified file descriptor,
+ * which has the specified size, and close the file descriptor.
+ * @return The mapped ring, or NULL if it could not be mapped.
+ */
+static shm_ring_t* _shm_map_ring(int fd, size_t size) {
+    void* result = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (result == MAP_FAILED) {
+        return NULL;
+    }
+    return (shm_ring_t*)result;
+}
+
+/**
+ * Create a shared memory object with the specified name holding a ring
+ * with the specified capacity, map it into memory, and become its writer.
+ * @param name The name of the shared memory object, which starts with '/'.
+ * @param capacity The number of bytes in the ring, a power of two.
+ * @param nonce A random number that the reader checks when it opens the ring.
+ * @return The ring, or NULL if it could not be created, in which case
+ *  a warning has been printed.
+ */
+shm_ring_t* create_shm_ring(const char* name, size_t capacity, uint64_t nonce) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        warning_print("Shared memory ring capacity %zu is not a power of two.", capacity);
+        return NULL;
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        warning_print("Failed to create shared memory object %s: %s.", name, strerror(errno));
+        return NULL;
+    }
+    size_t size = sizeof(shm_ring_t) + capacity;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        warning_print("Failed to size shared memory object %s: %s.", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    shm_ring_t* ring = _shm_map_ring(fd, size);
+    if (ring == NULL) {
+        warning_print("Failed to map shared memory object %s: %s.", name, strerror(errno));
+        shm_unlink(name);
+        return NULL;
+    }
+    // The object is zero filled, so only the nonzero fields need to be set.
+    ring->version = SHM_RING_VERSION;
+    ring->nonce = nonce;
+    ring->capacity = capacity;
+    ring->writer_pid = (int64_t)getpid();
+    // Make sure the other fields are visible before the ring is marked initialized.
+    __sync_synchronize();
+    ring->magic = SHM_RING_MAGIC;
+    return ring;
+}
+
+/**
+ * Map the ring in the shared memory object with the specified name into
+ * memory and become its reader.
+ * @param name The name of the shared memory object.
+ * @param nonce The number given to create_shm_ring().
+ * @return The ring, or NULL if there is no such object or it does not hold
+ *  a ring created with the specified nonce, which is the case if the
+ *  writer is on another host.
+ */
+shm_ring_t* open_shm_ring(const char* name, uint64_t nonce) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(shm_ring_t)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)status.st_size;
+    shm_ring_t* ring = _shm_map_ring(fd, size);
+    if (ring == NULL) {
+        return NULL;
+    }
+    if (ring->magic != SHM_RING_MAGIC
+            || ring->version != SHM_RING_VERSION
+            || ring->nonce != nonce
+            || sizeof(shm_ring_t) + ring->capacity != size) {
+        munmap(ring, size);
+        return NULL;
+    }
+    ring->reader_pid = (int64_t)getpid();
+    return ring;
+}
+
+/**
+ * Write the specified buffers, in order, to the specified ring. This blocks
+ * while the ring is full.
+ * @param ring The ring.
+ * @param vector The buffers to write.
+ * @param count The number of buffers.
+ * @return The number of bytes written, or -1 if the ring has been closed or
+ *  the reader no longer exists.
+ */
+ssize_t write_vector_to_shm_ring(shm_ring_t* ring, struct iovec* vector, int count) {
+    uint64_t mask = ring->capacity - 1;
+    uint64_t head = ring->head;
+    ssize_t bytes_written = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned char* source = (unsigned char*)vector[i].iov_base;
+        size_t remaining = vector[i].iov_len;
+        while (remaining > 0) {
+            // Wait for space, spinning briefly first.
+            uint64_t space = ring->capacity - (head - ring->tail);
+            for (int spin = 0; space == 0 && spin < SHM_RING_SPIN_COUNT; spin++) {
+                space = ring->capacity - (head - ring->tail);
+            }
+            while (space == 0) {
+                if (ring->closed || _shm_process_gone(ring->reader_pid)) {
+                    return -1;
+                }
+                uint32_t doorbell = ring->space_doorbell;
+                ring->writer_waiting = 1;
+                __sync_synchronize();
+                space = ring->capacity - (head - ring->tail);
+                if (space == 0) {
+                    _shm_futex_wait(&ring->space_doorbell, doorbell);
+                    space = ring->capacity - (head - ring->tail);
+                }
+                ring->writer_waiting = 0;
+            }
+            if (ring->closed) {
+                return -1;
+            }
+            // Copy as much as fits, in two parts if the ring wraps around.
+            size_t length = (remaining < space) ? remaining : (size_t)space;
+            size_t offset = (size_t)(head & mask);
+            size_t first = ring->capacity - offset;
+            if (first > length) {
+                first = length;
+            }
+            memcpy(&ring->data[offset], source, first);
+            memcpy(&ring->data[0], source + first, length - first);
+            head += length;
+            source += length;
+            remaining -= length;
+            bytes_written += (ssize_t)length;
+            // Publish the bytes before checking whether the reader waits.
+            __sync_synchronize();
+            ring->head = head;
+            __sync_synchronize();
+            if (ring->reader_waiting) {
+                _shm_futex_wake(&ring->data_doorbell);
+            }
+        }
+    }
+    return bytes_written;
+}
+
+/**
+ * Read the specified number of bytes from the specified ring into the
+ * specified buffer. This blocks until that many bytes are available.
+ * @param ring The ring.
+ * @param num_bytes The number of bytes to read.
+ * @param buffer The buffer into which to put the bytes.
+ * @return The number of bytes read, or 0 if the ring was closed and
+ *  drained first, or -1 if the writer no longer exists.
+ */
+ssize_t read_from_shm_ring(shm_ring_t* ring, size_t num_bytes, unsigned char* buffer) {
+    uint64_t mask = ring->capacity - 1;
+    uint64_t tail = ring->tail;
+    size_t bytes_read = 0;
+    while (bytes_read < num_bytes) {
+        // Wait for data, spinning briefly first.
+        uint64_t available = ring->head - tail;
+        for (int spin = 0; available == 0 && spin < SHM_RING_SPIN_COUNT; spin++) {
+            available = ring->head - tail;
+        }
+        while (available == 0) {
+            if (ring->closed) {
+                // The writer closes the ring only after publishing what it wrote.
+                __sync_synchronize();
+                if (ring->head == tail) {
+                    return 0;
+                }
+            } else if (_shm_process_gone(ring->writer_pid)) {
+                return -1;
+            }
+            uint32_t doorbell = ring->data_doorbell;
+            ring->reader_waiting = 1;
+            __sync_synchronize();
+            available = ring->head - tail;
+            if (available == 0 && !ring->closed) {
+                _shm_futex_wait(&ring->data_doorbell, doorbell);
+                available = ring->head - tail;
+            }
+            ring->reader_waiting = 0;
+        }
+        // Make sure the bytes are read only after the head that covers them.
+        __sync_synchronize();
+        size_t length = num_bytes - bytes_read;
+        if (length > available) {
+            length = (size_t)available;
+        }
+        size_t offset = (size_t)(tail & mask);
+        size_t first = ring->capacity - offset;
+        if (first > length) {
+            first = length;
+        }
+        memcpy(buffer + bytes_read, &ring->data[offset], first);
+        memcpy(buffer + bytes_read + first, &ring->data[0], length - first);
+        tail += length;
+        bytes_read += length;
+        // Free the space before checking whether the writer waits.
+        __sync_synchronize();
+        ring->tail = tail;
+        __sync_synchronize();
+        if (ring->writer_waiting) {
+            _shm_futex_wake(&ring->space_doorbell);
+        }
+    }
+    return (ssize_t)bytes_read;
+}
+
+/**
+ * Close the specified ring and wake the other end if it is blocked on it.
+ * The reader will read the bytes already written and then see an EOF.
+ * @param ring The ring.
+ */
+void close_shm_ring(shm_ring_t* ring) {
+    __sync_synchronize();
+    ring->closed = 1;
+    __sync_synchronize();
+    _shm_futex_wake(&ring->data_doorbell);
+    _shm_futex_wake(&ring->space_doorbell);
+}
+
+/**
+ * Unmap the specified ring from memory. The ring must not be used afterwards.
+ * @param ring The ring.
+ */
+void unmap_shm_ring(shm_ring_t* ring) {
+    munmap(ring, sizeof(shm_ring_t) + ring->capacity);
+}
@@ -0,0 +1,160 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Header file for a ring buffer in shared memory that carries a stream of
+ * bytes from one process to another process on the same host. The ring
+ * has the semantics of one direction of a socket: the writer blocks while
+ * the ring is full, the reader blocks while it is empty, and the reader
+ * sees an EOF once the writer has closed the ring and it has been drained.
+ * A blocked process is woken through a futex in the shared memory, so this
+ * is only available on Linux.
+ *
+ * Like the functions in net_util.h, these functions do not acquire any
+ * mutexes. Each ring must have one writing thread and one reading thread
+ * at a time.
+ */
+
+#ifndef SHM_UTIL_H
+#define SHM_UTIL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>      // Defines struct iovec
+
+/** Number identifying a shared memory object that holds an shm_ring_t. */
+#define SHM_RING_MAGIC 0x4c46524eu
+
+/** Version of shm_ring_t. Increment this when the struct changes. */
+#define SHM_RING_VERSION 1
+
+/** Default number of bytes in a ring. This must be a power of two. */
+#define SHM_RING_DEFAULT_CAPACITY (1u << 20)
+
+/** Maximum length of the name of a shared memory object holding a ring. */
+#define SHM_RING_NAME_LENGTH 64
+
+/**
+ * Number of times that a reader or writer checks the ring again before
+ * it sleeps on the futex. Spinning briefly avoids the cost of a system
+ * call on both sides when the peer runs on another core.
+ */
+#define SHM_RING_SPIN_COUNT 1000
+
+/**
+ * Number of milliseconds that a blocked reader or writer sleeps before
+ * it checks whether the process at the other end still exists.
+ */
+#define SHM_RING_POLL_INTERVAL_MSEC 100
+
+/**
+ * Header of a ring in shared memory, followed by the bytes of the ring.
+ * The fields written by the writer and those written by the reader are
+ * on separate cache lines.
+ */
+typedef struct shm_ring_t {
+    uint32_t magic;                     // SHM_RING_MAGIC once the ring is initialized.
+    uint32_t version;                   // SHM_RING_VERSION.
+    uint64_t nonce;                     // Random number given by the creator of the ring.
+    uint64_t capacity;                  // Number of bytes in data, a power of two.
+    int64_t writer_pid;                 // Process ID of the writer.
+    int64_t reader_pid;                 // Process ID of the reader, or 0 until it has opened the ring.
+
+    // Written by the writer.
+    volatile uint64_t head __attribute__((aligned(64))); // Number of bytes written since creation.
+    volatile uint32_t data_doorbell;    // Futex incremented when data is written while the reader waits.
+    volatile uint32_t writer_waiting;   // 1 while the writer waits for space.
+
+    // Written by the reader.
+    volatile uint64_t tail __attribute__((aligned(64))); // Number of bytes read since creation.
+    volatile uint32_t space_doorbell;   // Futex incremented when space is freed while the writer waits.
+    volatile uint32_t reader_waiting;   // 1 while the reader waits for data.
+
+    // Written by either end.
+    volatile uint32_t closed __attribute__((aligned(64))); // 1 once either end has closed the ring.
+
+    unsigned char data[] __attribute__((aligned(64)));
+} shm_ring_t;
+
+/**
+ * Create a shared memory object with the specified name holding a ring
+ * with the specified capacity, map it into memory, and become its writer.
+ * @param name The name of the shared memory object, which starts with '/'.
+ * @param capacity The number of bytes in the ring, a power of two.
+ * @param nonce A random number that the reader checks when it opens the ring.
+ * @return The ring, or NULL if it could not be created, in which case
+ *  a warning has been printed.
+ */
+shm_ring_t* create_shm_ring(const char* name, size_t capacity, uint64_t nonce);
+
+/**
+ * Map the ring in the shared memory object with the specified name into
+ * memory and become its reader.
+ * @param name The name of the shared memory object.
+ * @param nonce The number given to create_shm_ring().
+ * @return The ring, or NULL if there is no such object or it does not hold
+ *  a ring created with the specified nonce, which is the case if the
+ *  writer is on another host.
+ */
+shm_ring_t* open_shm_ring(const char* name, uint64_t nonce);
+
+/**
+ * Write the specified buffers, in order, to the specified ring. This blocks
+ * while the ring is full.
+ * @param ring The ring.
+ * @param vector The buffers to write.
+ * @param count The number of buffers.
+ * @return The number of bytes written, or -1 if the ring has been closed or
+ *  the reader no longer exists.
+ */
+ssize_t write_vector_to_shm_ring(shm_ring_t* ring, struct iovec* vector, int count);
+
+/**
+ * Read the specified number of bytes from the specified ring into the
+ * specified buffer. This blocks until that many bytes are available.
+ * @param ring The ring.
+ * @param num_bytes The number of bytes to read.
+ * @param buffer The buffer into which to put the bytes.
+ * @return The number of bytes read, or 0 if the ring was closed and
+ *  drained first, or -1 if the writer no longer exists.
+ */
+ssize_t read_from_shm_ring(shm_ring_t* ring, size_t num_bytes, unsigned char* buffer);
+
+/**
+ * Close the specified ring and wake the other end if it is blocked on it.
+ * The reader will read the bytes already written and then see an EOF.
+ * @param ring The ring.
+ */
+void close_shm_ring(shm_ring_t* ring);
+
+/**
+ * Unmap the specified ring from memory. The ring must not be used afterwards.
+ * @param ring The ring.
+ */
+void unmap_shm_ring(shm_ring_t* ring);
+
+#endif /* SHM_UTIL_H */
@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Live metrics that a running Lingua Franca program publishes for external tools.
+ *
+ * If the program is compiled with LF_LIVE_METRICS defined, the runtime maps a
+ * file holding one lf_live_metrics_t struct into memory and updates the counters
+ * in it as it executes. Another process can map the same file and read the
+ * counters at any time without stopping or slowing down the program. By default,
+ * the file is LF_LIVE_METRICS_DIRECTORY/lf_metrics_<pid>. The --metrics-file
+ * command-line option gives another path. The file is removed at termination.
+ *
+ * The counters are updated without locking, so a reader may see values that are
+ * momentarily inconsistent with each other, for example a tag whose microstep has
+ * been updated but whose time has not. Rates can be computed from the differences
+ * between the counters at two different times.
+ *
+ * The monitor_metrics program in util/tracing periodically prints these counters.
+ */
+#ifndef LIVE_METRICS_H
+#define LIVE_METRICS_H
+
+#include <stdint.h>
+#include "platform.h"   // Defines _LF_MEMORY_ADD().
+
+/** Magic number at the start of a live metrics file. It is written last at startup. */
+#define LF_LIVE_METRICS_MAGIC "LFLM"
+
+/** Version of lf_live_metrics_t. Increment this when the struct changes. */
+#define LF_LIVE_METRICS_VERSION 2
+
+/** Directory in which live metrics files are created by default. */
+#ifndef LF_LIVE_METRICS_DIRECTORY
+#ifdef __linux__
+#define LF_LIVE_METRICS_DIRECTORY "/dev/shm"
+#else
+#define LF_LIVE_METRICS_DIRECTORY "/tmp"
+#endif
+#endif
+
+/** Format of the default name of the live metrics file, given the process ID. */
+#define LF_LIVE_METRICS_FILE_FORMAT LF_LIVE_METRICS_DIRECTORY "/lf_metrics_%ld"
+
+/**
+ * Counters published by a running program. Times are in nanoseconds.
+ * Values labeled as sampled are updated whenever logical time advances.
+ */
+typedef struct lf_live_metrics_t {
+    char magic[4];                      // LF_LIVE_METRICS_MAGIC once the struct is initialized.
+    uint32_t version;                   // LF_LIVE_METRICS_VERSION.
+    int64_t pid;                        // Process ID of the program.
+    int64_t start_time;                 // Logical start time.
+    int64_t last_update_time;           // Physical time at which logical time last advanced.
+    int64_t current_time;               // Time of the current tag.
+    uint32_t current_microstep;         // Microstep of the current tag.
+    uint32_t running;                   // 1 while the program executes, 0 once it has terminated.
+    uint64_t tags;                      // Number of tags processed.
+    uint64_t reactions;                 // Number of reactions executed, not counting deadline handlers.
+    uint64_t event_queue_size;          // Sampled number of events on the event queue.
+    uint64_t reaction_queue_size;       // Number of reactions on the reaction queue when one was last taken from it.
+    uint64_t max_reaction_queue_size;   // Largest value that reaction_queue_size has had.
+    uint64_t deadline_violations;       // Number of deadline violations detected.
+    uint64_t STP_violations;            // Number of STP violations detected.
+    uint64_t live_tokens;               // Sampled number of tokens that have not been freed.
+    uint64_t token_allocations;         // Sampled number of tokens allocated since startup.
+    uint64_t memory_bytes;              // Sampled number of bytes allocated by the runtime.
+    uint64_t messages_sent;             // Number of messages sent to other federates.
+    uint64_t bytes_sent;                // Number of payload bytes in those messages, after any compression.
+    uint64_t messages_received;         // Number of messages received from other federates.
+    uint64_t bytes_received;            // Number of payload bytes in those messages, before any decompression.
+    uint64_t bytes_compressed;          // Number of payload bytes in the messages sent compressed.
+    uint64_t bytes_after_compression;   // Number of bytes those payloads were compressed to.
+} lf_live_metrics_t;
+
+#ifdef LF_LIVE_METRICS
+
+/**
+ * The live metrics. Until start_live_metrics() is called, and if the metrics
+ * file could not be created, this points to a struct that is not shared.
+ */
+extern lf_live_metrics_t* _lf_live_metrics;
+
+/** Path of the live metrics file from the --metrics-file option, or NULL for the default. */
+extern char* _lf_live_metrics_file_name;
+
+/** Add the specified value to the specified counter. This is thread safe. */
+#define _LF_LIVE_METRICS_ADD(field, value) _LF_MEMORY_ADD(&_lf_live_metrics->field, (value))
+
+/**
+ * Create the live metrics file, if possible, and start publishing the metrics
+ * in it. This is called by initialize().
+ */
+void start_live_metrics();
+
+/**
+ * Publish the current tag and sample the queue sizes and memory usage.
+ * This is called whenever logical time advances. The caller must hold
+ * the mutex lock, if there is one.
+ */
+void _lf_live_metrics_tag_advanced();
+
+/**
+ * Publish the number of reactions on the reaction queue, which has just
+ * had a reaction taken from it. The caller must hold the mutex lock, if there is one.
+ */
+void _lf_live_metrics_reaction_queue_size(size_t size);
+
+/**
+ * Publish the final values of the metrics, mark the program as no longer
+ * running, and remove the live metrics file. This is called by termination().
+ */
+void stop_live_metrics();
+
+#else
+
+// empty definition in case we compile without live metrics
+#define _LF_LIVE_METRICS_ADD(...)
+#define start_live_metrics(...)
+#define _lf_live_metrics_tag_advanced(...)
+#define _lf_live_metrics_reaction_queue_size(...)
+#define stop_live_metrics(...)
+
+#endif // LF_LIVE_METRICS
+#endif // LIVE_METRICS_H
@@ -70,6 +70,29 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 typedef _lf_mutex_t lf_mutex_t;          // Type to hold handle to a mutex
 typedef _lf_cond_t lf_cond_t;            // Type to hold handle to a condition variable
 typedef _lf_thread_t lf_thread_t;        // Type to hold handle to a thread
+
+// Storage class of variables that have a separate instance in each thread.
+#if defined(__GNUC__) || defined(__clang__)
+#define _LF_THREAD_LOCAL __thread
+#else
+#define _LF_THREAD_LOCAL __declspec(thread)
+#endif
+#endif
+
+/**
+ * Atomic read-modify-write operations on counters and pointers shared by
+ * threads. These use the GCC/Clang builtins where available. Otherwise,
+ * concurrent updates from multiple threads may be lost, making counts
+ * approximate.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define _LF_MEMORY_ADD(pointer, value) __sync_add_and_fetch(pointer, value)
+#define _LF_MEMORY_SUB(pointer, value) __sync_sub_and_fetch(pointer, value)
+#define _LF_MEMORY_CAS(pointer, old, new) __sync_bool_compare_and_swap(pointer, old, new)
+#else
+#define _LF_MEMORY_ADD(pointer, value) (*(pointer) += (value))
+#define _LF_MEMORY_SUB(pointer, value) (*(pointer) -= (value))
+#define _LF_MEMORY_CAS(pointer, old, new) ((*(pointer) = (new)), 1)
 #endif
 
 /**
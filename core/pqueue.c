@@ -131,17 +131,18 @@ pqueue_t * pqueue_init(size_t n,
                        pqueue_print_entry_f prt) {
     pqueue_t *q;
 
-    if (!(q = (pqueue_t*)malloc(sizeof(pqueue_t))))
+    if (!(q = (pqueue_t*)_lf_malloc(LF_MEMORY_QUEUES, sizeof(pqueue_t))))
         return NULL;
 
     /* Need to allocate n+1 elements since element 0 isn't used. */
-    if (!(q->d = (void**)malloc((n + 1) * sizeof(void *)))) {
-        free(q);
+    if (!(q->d = (void**)_lf_malloc(LF_MEMORY_QUEUES, (n + 1) * sizeof(void *)))) {
+        _lf_free(LF_MEMORY_QUEUES, q, sizeof(pqueue_t));
         return NULL;
     }
 
     q->size = 1;
     q->avail = q->step = (n+1);  /* see comment above about n+1 */
+    q->fixed = 0;
     q->cmppri = cmppri;
     q->getpri = getpri;
     q->getpos = getpos;
@@ -152,8 +153,12 @@ pqueue_t * pqueue_init(size_t n,
 }
 
 void pqueue_free(pqueue_t *q) {
-    free(q->d);
-    free(q);
+    _lf_free(LF_MEMORY_QUEUES, q->d, q->avail * sizeof(void *));
+    _lf_free(LF_MEMORY_QUEUES, q, sizeof(pqueue_t));
+}
+
+void pqueue_set_fixed_capacity(pqueue_t *q, int fixed) {
+    q->fixed = fixed;
 }
 
 size_t pqueue_size(pqueue_t *q) {
@@ -236,8 +241,13 @@ int pqueue_insert(pqueue_t *q, void *d) {
 
     /* allocate more memory if necessary */
     if (q->size >= q->avail) {
+        if (q->fixed) {
+            error_print_and_exit("pqueue_insert: queue is full at its fixed capacity of %zu elements.",
+                    q->avail - 1);
+        }
         newsize = q->size + q->step;
-        if (!(tmp = (void**)realloc(q->d, sizeof(void *) * newsize)))
+        if (!(tmp = (void**)_lf_realloc(LF_MEMORY_QUEUES, q->d,
+                sizeof(void *) * q->avail, sizeof(void *) * newsize)))
             return 1;
         q->d = tmp;
         q->avail = newsize;
@@ -313,7 +323,6 @@ void pqueue_print(pqueue_t *q, pqueue_print_entry_f print) {
                       q->cmppri, q->getpri,
                       q->getpos, q->setpos, q->eqelem, q->prt);
     dup->size = q->size;
-    dup->avail = q->avail;
     dup->step = q->step;
 
     memcpy(dup->d, q->d, (q->size * sizeof(void *)));
@@ -63,6 +63,7 @@ typedef struct pqueue_t
     size_t size;                /**< number of elements in this queue plus 1 */
     size_t avail;               /**< slots available in this queue */
     size_t step;                /**< growth stepping setting */
+    int fixed;                  /**< if non-zero, the queue never grows */
     pqueue_cmp_pri_f cmppri;    /**< callback to compare priorities */
     pqueue_get_pri_f getpri;    /**< callback to get priority of a node */
     pqueue_get_pos_f getpos;    /**< callback to get position of a node */
@@ -103,6 +104,16 @@ pqueue_init(size_t n,
 void pqueue_free(pqueue_t *q);
 
 
+/**
+ * Forbid (or allow) the queue to grow beyond the capacity it currently has.
+ * An insertion into a full queue that is not allowed to grow is a fatal
+ * error rather than a call to realloc().
+ * @param q the queue
+ * @param fixed non-zero to forbid growth, zero to allow it
+ */
+void pqueue_set_fixed_capacity(pqueue_t *q, int fixed);
+
+
 /**
  * return the size of the queue.
  * @param q the queue
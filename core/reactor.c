@@ -66,6 +66,8 @@ trigger_handle_t _lf_schedule_value(void* action, interval_t extra_delay, void*
     lf_token_t* token = create_token(trigger->element_size);
     token->value = value;
     token->length = length;
+    // The runtime is now responsible for freeing the value.
+    _lf_charge_payload(token);
     return schedule_token(action, extra_delay, token);
 }
 
@@ -150,6 +152,7 @@ int _lf_do_step() {
     while(pqueue_size(reaction_q) > 0) {
         // print_snapshot();
         reaction_t* reaction = (reaction_t*)pqueue_pop(reaction_q);
+        _lf_live_metrics_reaction_queue_size(pqueue_size(reaction_q));
         
         LOG_PRINT("Invoking reaction %s at elapsed logical tag (%lld, %d).",
         		reaction->name,
@@ -176,6 +179,8 @@ int _lf_do_step() {
                 LOG_PRINT("Deadline violation. Invoking deadline handler.");
                 // Deadline violation has occurred.
                 violation = true;
+                _lf_metrics_deadline_violation(reaction, physical_time);
+                _LF_LIVE_METRICS_ADD(deadline_violations, 1);
                 // Invoke the local handler, if there is one.
                 reaction_function_t handler = reaction->deadline_violation_handler;
                 if (handler != NULL) {
@@ -189,9 +194,16 @@ int _lf_do_step() {
         
         if (!violation) {
             // Invoke the reaction function.
+#ifdef _LF_TIME_REACTIONS
+            instant_t reaction_start_time = get_physical_time();
+#endif
             tracepoint_reaction_starts(reaction, 0); // 0 indicates unthreaded.
+            _LF_LIVE_METRICS_ADD(reactions, 1);
             reaction->function(reaction->self);
             tracepoint_reaction_ends(reaction, 0);
+#ifdef _LF_TIME_REACTIONS
+            _lf_record_execution_time(reaction, reaction_start_time);
+#endif
 
             // If the reaction produced outputs, put the resulting triggered
             // reactions into the queue.
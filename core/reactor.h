@@ -66,14 +66,44 @@
 // after its requirements are met, so the #include appears at
 // then end.
 // #include "trace.h"
+#include "live_metrics.h"
 
 //  ======== Macros ========  //
 #define CONSTRUCTOR(classname) (new_ ## classname)
 #define SELF_STRUCT_T(classname) (classname ## _self_t)
 
-// FIXME: May want these to application dependent, hence code generated.
+// Reactions are timed if execution-time histograms or runtime metrics are enabled.
+#if defined(LF_REACTION_HISTOGRAMS) || defined(LF_METRICS)
+#define _LF_TIME_REACTIONS
+#endif
+
+// Initial capacities of the queues. The code generator can define
+// NUMBER_OF_TRIGGERS and NUMBER_OF_REACTIONS (or these macros directly)
+// so that the queues are sized from the program topology when they are
+// created rather than grown with realloc() during the first tags.
+// A reaction is never on the reaction queue twice, so NUMBER_OF_REACTIONS
+// is an upper bound for it. There is no such bound on the number of pending
+// events, since an action can be scheduled any number of times, so
+// NUMBER_OF_TRIGGERS is only a hint. If _LF_FIXED_CAPACITY_QUEUES is defined,
+// the reaction queues never grow, and exceeding their capacity is a fatal
+// error. The event queues are then fixed only if INITIAL_EVENT_QUEUE_SIZE is
+// defined explicitly as a bound on the number of pending events.
+#ifndef INITIAL_EVENT_QUEUE_SIZE
+#ifdef NUMBER_OF_TRIGGERS
+#define INITIAL_EVENT_QUEUE_SIZE NUMBER_OF_TRIGGERS
+#else
 #define INITIAL_EVENT_QUEUE_SIZE 10
+#endif
+#else
+#define _LF_BOUNDED_EVENT_QUEUES
+#endif
+#ifndef INITIAL_REACT_QUEUE_SIZE
+#ifdef NUMBER_OF_REACTIONS
+#define INITIAL_REACT_QUEUE_SIZE NUMBER_OF_REACTIONS
+#else
 #define INITIAL_REACT_QUEUE_SIZE 10
+#endif
+#endif
 
 ////////////////////////////////////////////////////////////
 //// Macros for producing outputs.
@@ -330,6 +360,13 @@ typedef enum {no=0, token_and_value, token_only} ok_to_free_t;
  */
 typedef enum {absent = false, present = true, unknown} port_status_t;
 
+/**
+ * Payloads of at most this many bytes are stored inside the token
+ * that carries them rather than in separately allocated memory.
+ * See _lf_initialize_token().
+ */
+#define LF_TOKEN_INLINE_PAYLOAD_SIZE 32
+
 /**
  * The flag OK_TO_FREE is used to indicate whether
  * the void* in toke_t should be freed or not.
@@ -340,6 +377,17 @@ typedef enum {absent = false, present = true, unknown} port_status_t;
 #define OK_TO_FREE token_and_value
 #endif
 
+/**
+ * In federated execution, payloads received from other federates are read
+ * into buffers that are recycled through a pool rather than allocated for
+ * each message. This is not done if payloads are garbage collected because
+ * then the payload may be referenced after the token is freed.
+ * See _lf_allocate_payload_buffer().
+ */
+#if defined(FEDERATED) && !defined(_LF_GARBAGE_COLLECTED)
+#define _LF_PAYLOAD_POOL
+#endif
+
 /**
  * Handles for scheduled triggers. These handles are returned
  * by schedule() functions. The intent is that the handle can be
@@ -416,6 +464,26 @@ typedef struct lf_token_t {
     ok_to_free_t ok_to_free;
     /** For recycling, a pointer to the next token in the recycling bin. */
     struct lf_token_t* next_free;
+    /**
+     * The number of bytes of value charged to the payload memory category,
+     * or 0 if value was not allocated through the runtime.
+     */
+    size_t payload_charge;
+    /**
+     * The size class of the pooled buffer that value points to plus one,
+     * or 0 if value was not taken from the payload buffer pool.
+     */
+    int payload_pool;
+    /**
+     * Storage for a small payload. If value points here, the payload
+     * lives and dies with the token and is never passed to free().
+     */
+    union {
+        char bytes[LF_TOKEN_INLINE_PAYLOAD_SIZE];
+        long long align_integer;
+        long double align_float;
+        void* align_pointer;
+    } inline_value;
 } lf_token_t;
 
 /** A struct with a pointer to a lf_token_t and an _is_present variable
@@ -471,6 +539,12 @@ struct reaction_t {
     char* name;                 // If logging is set to LOG or higher, then this will
                                 // point to the full name of the reactor followed by
     							// the reaction number.
+    size_t id;                  // Index of this reaction in the threaded runtime's table of
+                                // hot scheduling fields, or 0 if not yet registered. RUNTIME.
+#ifdef LF_REACTION_HISTOGRAMS
+    struct reaction_statistics_t* statistics; // Execution-time histogram, or NULL if the reaction has
+                                              // not yet been executed. RUNTIME.
+#endif
 };
 
 /** Typedef for event_t struct, used for storing activation records. */
@@ -483,6 +557,7 @@ struct event_t {
     size_t pos;               // Position in the priority queue.
     lf_token_t* token;        // Pointer to the token wrapping the value.
     bool is_dummy;            // Flag to indicate whether this event is merely a placeholder or an actual event.
+    microstep_t microstep_offset; // For a dummy event, the number of microsteps it stands in for (at least 1).
 #ifdef FEDERATED
     tag_t intended_tag;       // The intended tag.
 #endif
@@ -683,8 +758,9 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token);
 
 /**
  * Create a dummy event to be used as a spacer in the event queue.
+ * A single dummy event stands in for the whole gap of microsteps.
  */
-event_t* _lf_create_dummy_event(trigger_t* trigger, instant_t time, event_t* next, unsigned int offset);
+event_t* _lf_create_dummy_events(trigger_t* trigger, instant_t time, event_t* next, microstep_t offset);
 
 /**
  * Schedule the specified action with the specified token as a payload.
@@ -794,6 +870,43 @@ void _lf_notify_workers();
  */
 bool _lf_is_blocked_by_executing_reaction();
 
+/**
+ * Report the 50th, 99th, and 99.9th percentile and the maximum execution
+ * time of each reaction that has executed so far on stdout. This requires
+ * compiling with LF_REACTION_HISTOGRAMS defined, in which case it is called
+ * automatically at termination. It can also be called from reaction code,
+ * but in a threaded execution the numbers for reactions that are executing
+ * concurrently may be slightly inconsistent.
+ */
+void lf_print_reaction_execution_times();
+
+/**
+ * Runtime metrics that are recorded if the program is compiled with
+ * LF_METRICS defined. All values are in nanoseconds. Lags are physical
+ * time minus the time of the tag, and negative lags, as in a fast
+ * execution, are recorded as 0.
+ */
+typedef struct lf_metrics_t {
+    unsigned long long tags;           // Number of tags at which at least one reaction executed.
+    lf_histogram_t first_reaction_lag; // Lag of the start of the first reaction at each tag.
+    lf_histogram_t last_reaction_lag;  // Lag of the end of the last reaction at each tag.
+    lf_histogram_t deadline_lateness;  // For each deadline violation, physical time by which the deadline was missed.
+    lf_histogram_t STP_lateness;       // For each STP violation, logical time by which the trigger was late.
+} lf_metrics_t;
+
+/**
+ * Return the runtime metrics recorded so far, or NULL if the program was
+ * not compiled with LF_METRICS defined. The metrics for the tag being
+ * processed are added when the next tag starts.
+ */
+lf_metrics_t* lf_get_metrics();
+
+/**
+ * Report the runtime metrics on stdout. This is called automatically at
+ * termination if the program is compiled with LF_METRICS defined.
+ */
+void lf_print_metrics();
+
 //  ******** Global Variables ********  //
 
 /**
@@ -39,6 +39,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pqueue.c"
 #include "util.c"
 
+// The live metrics are published through a memory-mapped file
+// on platforms that support it.
+#if defined(LF_LIVE_METRICS) && !defined(_WIN32)
+#include <sys/mman.h>   // Defines mmap() and munmap().
+#include <unistd.h>     // Defines ftruncate(), getpid(), and unlink().
+#include <fcntl.h>      // Defines open().
+#endif
+
 /** 
  * Indicator of whether to wait for physical time to match logical time.
  * By default, execution will wait. The command-line argument -fast will
@@ -353,6 +361,111 @@ int _lf_token_recycling_bin_size = 0;
  */
 #define _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT 512
 
+#ifdef _LF_PAYLOAD_POOL
+/** The smallest pooled payload buffer has 2^_LF_PAYLOAD_POOL_MIN_SHIFT bytes. */
+#define _LF_PAYLOAD_POOL_MIN_SHIFT 6
+
+/**
+ * Number of size classes of pooled payload buffers. Each class holds buffers
+ * twice as large as the previous one, so the largest have 64 KiB.
+ */
+#define _LF_PAYLOAD_POOL_CLASSES 11
+
+/**
+ * Maximum number of unused buffers kept in each size class. When a class is
+ * full, buffers returned to it are freed using free().
+ */
+#define _LF_PAYLOAD_POOL_LIMIT 64
+
+/** Alignment of payload buffers that are too large to be pooled. */
+#define _LF_PAYLOAD_LARGE_ALIGNMENT 4096
+
+/** An unused buffer in the payload buffer pool. */
+typedef struct pooled_payload_t {
+    struct pooled_payload_t* next;
+} pooled_payload_t;
+
+/** For each size class, the unused buffers, chained using their next field. */
+pooled_payload_t* _lf_payload_pool[_LF_PAYLOAD_POOL_CLASSES];
+
+/** For each size class, the number of unused buffers. */
+int _lf_payload_pool_size[_LF_PAYLOAD_POOL_CLASSES];
+
+/**
+ * Mutex guarding the payload buffer pool. This is separate from the global
+ * mutex so that threads receiving messages can get a buffer without it.
+ * It is initialized by the main function.
+ */
+lf_mutex_t _lf_payload_pool_mutex;
+
+/**
+ * Return a buffer for a payload of the specified size. Buffers of at most
+ * 64 KiB are taken from a pool of recycled buffers of the same size class,
+ * and the size class plus one is stored in pool. Larger buffers are aligned
+ * to a page boundary and are not pooled, in which case 0 is stored in pool
+ * and the buffer is freed using free(). The mutex lock need not be held.
+ * @param size The size of the payload in bytes.
+ * @param pool Where to store the size class of the buffer.
+ * @return The buffer, or NULL if memory cannot be allocated.
+ */
+void* _lf_allocate_payload_buffer(size_t size, int* pool) {
+    int size_class = 0;
+    while (size_class < _LF_PAYLOAD_POOL_CLASSES
+            && ((size_t)1 << (_LF_PAYLOAD_POOL_MIN_SHIFT + size_class)) < size) {
+        size_class++;
+    }
+    if (size_class == _LF_PAYLOAD_POOL_CLASSES) {
+        *pool = 0;
+        void* result = NULL;
+        size_t rounded = (size + _LF_PAYLOAD_LARGE_ALIGNMENT - 1) & ~((size_t)_LF_PAYLOAD_LARGE_ALIGNMENT - 1);
+        if (posix_memalign(&result, _LF_PAYLOAD_LARGE_ALIGNMENT, rounded) != 0) {
+            return NULL;
+        }
+        return result;
+    }
+    *pool = size_class + 1;
+    size_t capacity = (size_t)1 << (_LF_PAYLOAD_POOL_MIN_SHIFT + size_class);
+    lf_mutex_lock(&_lf_payload_pool_mutex);
+    pooled_payload_t* result = _lf_payload_pool[size_class];
+    if (result != NULL) {
+        _lf_payload_pool[size_class] = result->next;
+        _lf_payload_pool_size[size_class]--;
+    }
+    lf_mutex_unlock(&_lf_payload_pool_mutex);
+    if (result == NULL) {
+        return malloc(capacity);
+    }
+    // The memory of unused buffers is charged to federate buffers.
+    _lf_memory_freed(LF_MEMORY_FEDERATE_BUFFERS, capacity, 0);
+    return result;
+}
+
+/**
+ * Return a buffer obtained from _lf_allocate_payload_buffer() to the pool.
+ * @param buffer The buffer.
+ * @param pool The size class of the buffer plus one.
+ */
+void _lf_free_payload_buffer(void* buffer, int pool) {
+    int size_class = pool - 1;
+    size_t capacity = (size_t)1 << (_LF_PAYLOAD_POOL_MIN_SHIFT + size_class);
+    lf_mutex_lock(&_lf_payload_pool_mutex);
+    if (_lf_payload_pool_size[size_class] < _LF_PAYLOAD_POOL_LIMIT) {
+        pooled_payload_t* pooled = (pooled_payload_t*)buffer;
+        pooled->next = _lf_payload_pool[size_class];
+        _lf_payload_pool[size_class] = pooled;
+        _lf_payload_pool_size[size_class]++;
+        buffer = NULL;
+    }
+    lf_mutex_unlock(&_lf_payload_pool_mutex);
+    if (buffer != NULL) {
+        // The size class is full.
+        free(buffer);
+    } else {
+        _lf_memory_allocated(LF_MEMORY_FEDERATE_BUFFERS, capacity, 0);
+    }
+}
+#endif // _LF_PAYLOAD_POOL
+
 /** Possible return values for _lf_done_using. */
 typedef enum token_freed {
     NOT_FREED,     // Nothing was freed.
@@ -380,13 +493,30 @@ token_freed _lf_done_using(lf_token_t* token) {
     token->ref_count--;
     DEBUG_PRINT("_lf_done_using: ref_count = %d.", token->ref_count);
     if (token->ref_count == 0) {
-        if (token->value != NULL) {
+        if (token->value == (void*)&token->inline_value) {
+            // The payload is stored in the token itself. There is nothing to free.
+            token->value = NULL;
+            result = VALUE_FREED;
+        } else if (token->value != NULL) {
             // Count frees to issue a warning if this is never freed.
             // Do not free the value field if it is garbage collected.
             _lf_count_payload_allocations--;
             if(OK_TO_FREE != token_only) {
                 DEBUG_PRINT("_lf_done_using: Freeing allocated memory for payload (token value): %p", token->value);
+#ifdef _LF_PAYLOAD_POOL
+                if (token->payload_pool > 0) {
+                    _lf_free_payload_buffer(token->value, token->payload_pool);
+                    token->payload_pool = 0;
+                } else {
+                    free(token->value);
+                }
+#else
                 free(token->value);
+#endif
+            }
+            if (token->payload_charge > 0) {
+                _lf_memory_freed(LF_MEMORY_PAYLOADS, token->payload_charge, 1);
+                token->payload_charge = 0;
             }
             token->value = NULL;
             result = VALUE_FREED;
@@ -403,7 +533,7 @@ token_freed _lf_done_using(lf_token_t* token) {
                 _lf_token_recycling_bin_size++;
             } else {
                 // Recycling bin is full.
-                free(token);
+                _lf_free(LF_MEMORY_TOKENS, token, sizeof(lf_token_t));
             }
             _lf_count_token_allocations--;
             DEBUG_PRINT("_lf_done_using: Freeing allocated memory for token: %p", token);
@@ -420,6 +550,233 @@ token_freed _lf_done_using(lf_token_t* token) {
  */
 void _lf_enqueue_reaction(reaction_t* reaction);
 
+#ifdef LF_METRICS
+/** The runtime metrics recorded so far. */
+lf_metrics_t _lf_metrics;
+
+/** Physical time at which the first reaction at the current tag started, or NEVER if none has. */
+instant_t _lf_metrics_first_reaction_start = NEVER;
+
+/** Physical time at which the last reaction at the current tag finished, or NEVER if none has. */
+instant_t _lf_metrics_last_reaction_end = NEVER;
+
+/** The time of the tag at which the reactions above executed. */
+instant_t _lf_metrics_tag_time = NEVER;
+
+/**
+ * Record the lags of the tag that has just been processed, if any reactions
+ * executed at it. This is called between tags, when no reactions are executing.
+ */
+void _lf_metrics_end_tag() {
+    if (_lf_metrics_first_reaction_start == NEVER) {
+        return;
+    }
+    _lf_metrics.tags++;
+    lf_histogram_record(&_lf_metrics.first_reaction_lag, _lf_metrics_first_reaction_start - _lf_metrics_tag_time);
+    lf_histogram_record(&_lf_metrics.last_reaction_lag, _lf_metrics_last_reaction_end - _lf_metrics_tag_time);
+    _lf_metrics_first_reaction_start = NEVER;
+    _lf_metrics_last_reaction_end = NEVER;
+}
+
+/**
+ * Record that a reaction executed from the specified start time to the
+ * specified end time at the current tag. This is thread safe.
+ */
+void _lf_metrics_reaction_executed(instant_t start_time, instant_t end_time) {
+    // Record the tag here because current_tag has already advanced
+    // when _lf_metrics_end_tag() is called. Every thread stores the same value.
+    _lf_metrics_tag_time = current_tag.time;
+    instant_t first = _lf_metrics_first_reaction_start;
+    while ((first == NEVER || start_time < first)
+            && !_LF_MEMORY_CAS(&_lf_metrics_first_reaction_start, first, start_time)) {
+        first = _lf_metrics_first_reaction_start;
+    }
+    instant_t last = _lf_metrics_last_reaction_end;
+    while (end_time > last && !_LF_MEMORY_CAS(&_lf_metrics_last_reaction_end, last, end_time)) {
+        last = _lf_metrics_last_reaction_end;
+    }
+}
+
+/**
+ * Record a deadline violation of the specified reaction detected at the
+ * specified physical time. This is thread safe.
+ */
+void _lf_metrics_deadline_violation(reaction_t* reaction, instant_t physical_time) {
+    lf_histogram_record_concurrent(&_lf_metrics.deadline_lateness,
+            physical_time - (current_tag.time + reaction->deadline));
+}
+
+/**
+ * Record an STP violation by a trigger with the specified intended tag.
+ * This is thread safe.
+ */
+void _lf_metrics_STP_violation(tag_t intended_tag) {
+    lf_histogram_record_concurrent(&_lf_metrics.STP_lateness, current_tag.time - intended_tag.time);
+}
+#else
+#define _lf_metrics_end_tag(...)
+#define _lf_metrics_deadline_violation(...)
+#define _lf_metrics_STP_violation(...)
+#endif
+
+/**
+ * Return the runtime metrics recorded so far, or NULL if the program was
+ * not compiled with LF_METRICS defined.
+ */
+lf_metrics_t* lf_get_metrics() {
+#ifdef LF_METRICS
+    return &_lf_metrics;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Report the runtime metrics on stdout.
+ */
+void lf_print_metrics() {
+#ifdef LF_METRICS
+    info_print("---- Lag and lateness in nanoseconds over %llu tags (count, p50, p99, p99.9, max):",
+            _lf_metrics.tags);
+    const char* names[] = {"first reaction lag", "last reaction lag", "deadline lateness", "STP lateness"};
+    lf_histogram_t* histograms[] = {&_lf_metrics.first_reaction_lag, &_lf_metrics.last_reaction_lag,
+            &_lf_metrics.deadline_lateness, &_lf_metrics.STP_lateness};
+    for (int i = 0; i < 4; i++) {
+        info_print("----   %-32s %10llu %10lld %10lld %10lld %10lld",
+                names[i], histograms[i]->total,
+                lf_histogram_percentile(histograms[i], 50.0),
+                lf_histogram_percentile(histograms[i], 99.0),
+                lf_histogram_percentile(histograms[i], 99.9),
+                histograms[i]->max);
+    }
+#else
+    warning_print("Runtime metrics are only recorded if LF_METRICS is defined.");
+#endif
+}
+
+#ifdef LF_LIVE_METRICS
+/** Live metrics used before the live metrics file is mapped or if it cannot be. */
+lf_live_metrics_t _lf_unshared_live_metrics;
+
+lf_live_metrics_t* _lf_live_metrics = &_lf_unshared_live_metrics;
+
+char* _lf_live_metrics_file_name = NULL;
+
+/** Path of the live metrics file that is mapped, or NULL if there is none. */
+char* _lf_live_metrics_path = NULL;
+
+/** Buffer for the default path of the live metrics file. */
+char _lf_live_metrics_default_path[256];
+
+/**
+ * Sample the values of the live metrics that are not counted as they change.
+ * The caller must hold the mutex lock, if there is one.
+ */
+void _lf_live_metrics_sample() {
+    lf_live_metrics_t* metrics = _lf_live_metrics;
+    metrics->start_time = start_time;
+    metrics->last_update_time = get_physical_time();
+    metrics->event_queue_size = (event_q == NULL) ? 0 : pqueue_size(event_q);
+    metrics->live_tokens = (_lf_count_token_allocations > 0) ? _lf_count_token_allocations : 0;
+    metrics->token_allocations = lf_get_memory_usage(LF_MEMORY_TOKENS).allocations;
+    size_t bytes = 0;
+    for (int i = 0; i < LF_MEMORY_NUMBER_OF_CATEGORIES; i++) {
+        bytes += lf_get_memory_usage((lf_memory_category_t)i).bytes;
+    }
+    metrics->memory_bytes = bytes;
+}
+
+/**
+ * Create the live metrics file, if possible, and start publishing the metrics
+ * in it. If the file cannot be created, print a warning and keep counting in
+ * memory that is not shared.
+ */
+void start_live_metrics() {
+    lf_live_metrics_t* metrics = &_lf_unshared_live_metrics;
+#ifndef _WIN32
+    char* path = _lf_live_metrics_file_name;
+    if (path == NULL) {
+        snprintf(_lf_live_metrics_default_path, sizeof(_lf_live_metrics_default_path),
+                LF_LIVE_METRICS_FILE_FORMAT, (long)getpid());
+        path = _lf_live_metrics_default_path;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        // Extending the file fills it with zeros, which initializes all the counters.
+        if (ftruncate(fd, (off_t)sizeof(lf_live_metrics_t)) == 0) {
+            void* mapping = mmap(NULL, sizeof(lf_live_metrics_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapping != MAP_FAILED) {
+                metrics = (lf_live_metrics_t*)mapping;
+                _lf_live_metrics_path = path;
+            }
+        }
+        close(fd);
+        if (_lf_live_metrics_path == NULL) {
+            unlink(path);
+        }
+    }
+    if (_lf_live_metrics_path == NULL) {
+        warning_print("Failed to create the live metrics file %s. Live metrics will not be published.", path);
+    }
+    metrics->pid = (int64_t)getpid();
+#else
+    warning_print("Live metrics are not supported on this platform.");
+#endif
+    metrics->version = LF_LIVE_METRICS_VERSION;
+    metrics->current_time = start_time;
+    metrics->running = 1;
+    _lf_live_metrics = metrics;
+    _lf_live_metrics_sample();
+#if defined(__GNUC__) || defined(__clang__)
+    // Make sure that readers that see the magic number see initialized values.
+    __sync_synchronize();
+#endif
+    memcpy(metrics->magic, LF_LIVE_METRICS_MAGIC, sizeof(metrics->magic));
+    if (_lf_live_metrics_path != NULL) {
+        info_print("Publishing live metrics in %s.", _lf_live_metrics_path);
+    }
+}
+
+/**
+ * Publish the current tag and sample the queue sizes and memory usage.
+ * The caller must hold the mutex lock, if there is one.
+ */
+void _lf_live_metrics_tag_advanced() {
+    _lf_live_metrics->current_microstep = current_tag.microstep;
+    _lf_live_metrics->current_time = current_tag.time;
+    _lf_live_metrics->tags++;
+    _lf_live_metrics_sample();
+}
+
+/**
+ * Publish the number of reactions on the reaction queue, which has just
+ * had a reaction taken from it. The caller must hold the mutex lock, if there is one.
+ */
+void _lf_live_metrics_reaction_queue_size(size_t size) {
+    _lf_live_metrics->reaction_queue_size = size;
+    if (size > _lf_live_metrics->max_reaction_queue_size) {
+        _lf_live_metrics->max_reaction_queue_size = size;
+    }
+}
+
+/**
+ * Publish the final values of the metrics, mark the program as no longer
+ * running, and remove the live metrics file. The file stays mapped because
+ * threads that are still running may update the counters, and readers that
+ * have the file open can still read the final values.
+ */
+void stop_live_metrics() {
+    _lf_live_metrics_sample();
+    _lf_live_metrics->running = 0;
+#ifndef _WIN32
+    if (_lf_live_metrics_path != NULL) {
+        unlink(_lf_live_metrics_path);
+        _lf_live_metrics_path = NULL;
+    }
+#endif
+}
+#endif // LF_LIVE_METRICS
+
 /**
  * Use tables to reset is_present fields to false,
  * set intended_tag fields in federated execution
@@ -428,6 +785,9 @@ void _lf_enqueue_reaction(reaction_t* reaction);
  */
 void _lf_start_time_step() {
     LOG_PRINT("--------- Start time step at tag (%lld, %u).", current_tag.time - start_time, current_tag.microstep);
+    _lf_metrics_end_tag();
+    // Decide once for the whole tag whether tracing records it.
+    _lf_trace_sample_tag();
     for(int i = 0; i < _lf_tokens_with_ref_count_size; i++) {
         if (*(_lf_tokens_with_ref_count[i].status) == present) {
             if (_lf_tokens_with_ref_count[i].reset_is_present) {
@@ -457,6 +817,94 @@ void _lf_start_time_step() {
 #endif
 }
 
+#ifdef LF_REACTION_HISTOGRAMS
+/**
+ * Execution-time histogram of one reaction. These are allocated the
+ * first time each reaction executes and kept on a list for reporting.
+ */
+typedef struct reaction_statistics_t {
+    reaction_t* reaction;
+    lf_histogram_t execution_times;
+    struct reaction_statistics_t* next;
+} reaction_statistics_t;
+
+/** List of the statistics of all reactions that have executed. */
+reaction_statistics_t* _lf_reaction_statistics = NULL;
+#endif
+
+#ifdef _LF_TIME_REACTIONS
+/**
+ * Record the execution time of a reaction that has just finished.
+ * A reaction does not execute concurrently with itself, so its histogram
+ * has a single writer. Only adding it to the shared list needs to be atomic.
+ * @param reaction The reaction.
+ * @param start_time The physical time at which the reaction started.
+ */
+void _lf_record_execution_time(reaction_t* reaction, instant_t start_time) {
+    instant_t end_time = get_physical_time();
+#ifdef LF_METRICS
+    _lf_metrics_reaction_executed(start_time, end_time);
+#endif
+#ifdef LF_REACTION_HISTOGRAMS
+    reaction_statistics_t* statistics = reaction->statistics;
+    if (statistics == NULL) {
+        statistics = (reaction_statistics_t*)_lf_calloc(LF_MEMORY_STATISTICS, 1, sizeof(reaction_statistics_t));
+        if (statistics == NULL) {
+            return;
+        }
+        statistics->reaction = reaction;
+        do {
+            statistics->next = _lf_reaction_statistics;
+        } while (!_LF_MEMORY_CAS(&_lf_reaction_statistics, statistics->next, statistics));
+        reaction->statistics = statistics;
+    }
+    lf_histogram_record(&statistics->execution_times, end_time - start_time);
+#endif
+}
+#endif
+
+/**
+ * Report the 50th, 99th, and 99.9th percentile and the maximum execution
+ * time of each reaction that has executed so far on stdout.
+ */
+void lf_print_reaction_execution_times() {
+#ifdef LF_REACTION_HISTOGRAMS
+    info_print("---- Reaction execution times in nanoseconds (count, p50, p99, p99.9, max):");
+    for (reaction_statistics_t* s = _lf_reaction_statistics; s != NULL; s = s->next) {
+        lf_histogram_t* histogram = &s->execution_times;
+        char unnamed[32];
+        char* name = s->reaction->name;
+        if (name == NULL) {
+            // Reaction names are only set when logging is enabled.
+            snprintf(unnamed, sizeof(unnamed), "reaction %d", s->reaction->number);
+            name = unnamed;
+        }
+        info_print("----   %-32s %10llu %10lld %10lld %10lld %10lld",
+                name, histogram->total,
+                lf_histogram_percentile(histogram, 50.0),
+                lf_histogram_percentile(histogram, 99.0),
+                lf_histogram_percentile(histogram, 99.9),
+                histogram->max);
+    }
+#else
+    warning_print("Reaction execution times are only recorded if LF_REACTION_HISTOGRAMS is defined.");
+#endif
+}
+
+/**
+ * Charge the value of the specified token to the payload memory category.
+ * This should be called when the runtime takes responsibility for freeing
+ * the value. The charge is recorded in the token so that _lf_done_using()
+ * credits exactly the same amount when it frees the value.
+ * @param token The token, whose value, element_size, and length are set.
+ */
+void _lf_charge_payload(lf_token_t* token) {
+    token->payload_charge = token->element_size * token->length;
+    if (token->payload_charge > 0) {
+        _lf_memory_allocated(LF_MEMORY_PAYLOADS, token->payload_charge, 1);
+    }
+}
+
 /**
  * Create a new lf_token_t struct and initialize it for assignment to a trigger.
  * The value pointer will be NULL and the length will be 0.
@@ -476,7 +924,7 @@ lf_token_t* _lf_create_token(size_t element_size) {
         _lf_token_recycling_bin_size--;
         DEBUG_PRINT("_lf_create_token: Retrieved token from the recycling bin: %p", token);
     } else {
-        token = (lf_token_t*)malloc(sizeof(lf_token_t));
+        token = (lf_token_t*)_lf_malloc(LF_MEMORY_TOKENS, sizeof(lf_token_t));
         DEBUG_PRINT("_lf_create_token: Allocated memory for token: %p", token);
     }
     token->value = NULL;
@@ -485,6 +933,8 @@ lf_token_t* _lf_create_token(size_t element_size) {
     token->ref_count = 0;
     token->ok_to_free = no;
     token->next_free = NULL;
+    token->payload_charge = 0;
+    token->payload_pool = 0;
     return token;
 }
 
@@ -533,6 +983,9 @@ lf_token_t* _lf_initialize_token_with_value(lf_token_t* token, void* value, size
     }
     result->value = value;
     result->length = length;
+    if (value != NULL) {
+        _lf_charge_payload(result);
+    }
     return result;
 }
 
@@ -545,6 +998,11 @@ lf_token_t* _lf_initialize_token_with_value(lf_token_t* token, void* value, size
  * the specified token. The caller should populate the value and
  * ref_count field of the returned token after this returns.
  *
+ * If the array fits in LF_TOKEN_INLINE_PAYLOAD_SIZE bytes, then no memory
+ * is allocated. The value field instead points into the returned token.
+ * This is not done if payloads are garbage collected because then the
+ * payload may be referenced after the token is recycled.
+ *
  * @param token The token to populate, if it is available (must not be NULL).
  * @param length The length of the array, or 1 if it is not an array.
  * @return Either the specified token or a new one, in each case with a value
@@ -553,7 +1011,15 @@ lf_token_t* _lf_initialize_token_with_value(lf_token_t* token, void* value, size
 lf_token_t* _lf_initialize_token(lf_token_t* token, size_t length) {
     // assert(token != NULL);
 
-    // Allocate memory for storing the array.
+#ifndef _LF_GARBAGE_COLLECTED
+    if (token->element_size * length <= LF_TOKEN_INLINE_PAYLOAD_SIZE) {
+        lf_token_t* result = _lf_initialize_token_with_value(token, NULL, length);
+        result->value = (void*)&result->inline_value;
+        return result;
+    }
+#endif
+    // Allocate memory for storing the array. It is charged to the payload
+    // memory category by _lf_initialize_token_with_value().
     void* value = malloc(token->element_size * length);
     // Count allocations to issue a warning if this is never freed.
     _lf_count_payload_allocations++;
@@ -581,11 +1047,18 @@ void _lf_pop_events() {
         
         if (event->is_dummy) {
         	DEBUG_PRINT("Popped dummy event from the event queue.");
-        	if (event->next != NULL) {
-            	DEBUG_PRINT("Putting event from the event queue for the next microstep.");
-        		pqueue_insert(next_q, event->next);
+        	if (event->microstep_offset > 1) {
+        	    // The dummy event still stands in for later microsteps.
+        	    // Defer it by one microstep rather than recycling it.
+        	    event->microstep_offset--;
+        	    pqueue_insert(next_q, event);
+        	} else {
+        	    if (event->next != NULL) {
+        	        DEBUG_PRINT("Putting event from the event queue for the next microstep.");
+        	        pqueue_insert(next_q, event->next);
+        	    }
+        	    _lf_recycle_event(event);
         	}
-            _lf_recycle_event(event);
             // Peek at the next event in the event queue.
             event = (event_t*)pqueue_peek(event_q);
             continue;
@@ -613,6 +1086,8 @@ void _lf_pop_events() {
                                     current_tag) < 0) {
                         // Mark the triggered reaction with a STP violation
                         reaction->is_STP_violated = true;
+                        _lf_metrics_STP_violation(event->intended_tag);
+                        _LF_LIVE_METRICS_ADD(STP_violations, 1);
                         LOG_PRINT("Trigger %p has violated the reaction's STP offset. Intended tag: (%lld, %u). Current tag: (%lld, %u)",
                                     event->trigger,
                                     event->intended_tag.time - start_time, event->intended_tag.microstep,
@@ -719,15 +1194,38 @@ void _lf_initialize_timer(trigger_t* timer) {
     tracepoint_schedule(timer, delay); // Trace even though schedule is not called.
 }
 
+/**
+ * Number of event_t structs allocated at once when the recycle queue is empty.
+ * Events are carved out of such a block one at a time and are afterwards
+ * reused through the recycle queue, so blocks are never freed.
+ */
+#define _LF_EVENT_ARENA_BLOCK_SIZE 128
+
+/** The block of zero'ed events from which new events are currently carved. */
+static event_t* _lf_event_arena = NULL;
+
+/** The number of events not yet handed out from the current block. */
+static size_t _lf_event_arena_available = 0;
+
 /**
  * Get a new event. If there is a recycled event available, use that.
- * If not, allocate a new one. In either case, all fields will be zero'ed out.
+ * If not, take one from the event arena. In either case, all fields
+ * will be zero'ed out.
  */
 event_t* _lf_get_new_event() {
     // Recycle event_t structs, if possible.    
     event_t* e = (event_t*)pqueue_pop(recycle_q);
     if (e == NULL) {
-        e = (event_t*)calloc(1, sizeof(struct event_t));
+        if (_lf_event_arena_available == 0) {
+            // Bump-allocate from a fresh block rather than calling calloc() per event.
+            _lf_event_arena = (event_t*)_lf_calloc(LF_MEMORY_EVENTS,
+                    _LF_EVENT_ARENA_BLOCK_SIZE, sizeof(struct event_t));
+            _lf_event_arena_available = _LF_EVENT_ARENA_BLOCK_SIZE;
+            DEBUG_PRINT("_lf_get_new_event: Allocated a block of %d events: %p",
+                    _LF_EVENT_ARENA_BLOCK_SIZE, _lf_event_arena);
+        }
+        e = _lf_event_arena++;
+        _lf_event_arena_available--;
 #ifdef FEDERATED_DECENTRALIZED
         e->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
 #endif
@@ -745,6 +1243,7 @@ void _lf_recycle_event(event_t* e) {
     e->pos = 0;
     e->token = NULL;
     e->is_dummy = false;
+    e->microstep_offset = 0;
 #ifdef FEDERATED_DECENTRALIZED
     e->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
 #endif
@@ -753,32 +1252,53 @@ void _lf_recycle_event(event_t* e) {
 }
 
 /**
- * Create dummy events to be used as spacers in the event queue.
+ * Create a dummy event to be used as a spacer in the event queue.
+ * Rather than chaining one dummy event per skipped microstep, a single
+ * dummy event records the number of microsteps it stands in for.
+ * When popped from the event queue, it is deferred by one microstep at a
+ * time until the gap is exhausted, after which its next event is released.
  * @param trigger The eventual event to be triggered.
  * @param time The logical time of that event.
- * @param next The event to place after the dummy events.
- * @param offset The number of dummy events to insert.
- * @return A pointer to the first dummy event.
+ * @param next The event to place after the dummy event.
+ * @param offset The number of microsteps to skip before next.
+ * @return A pointer to the dummy event.
  */
 event_t* _lf_create_dummy_events(trigger_t* trigger, instant_t time, event_t* next, microstep_t offset) {
-    event_t* first_dummy = _lf_get_new_event();
-    event_t* dummy = first_dummy;
+    event_t* dummy = _lf_get_new_event();
     dummy->time = time;
     dummy->is_dummy = true;
     dummy->trigger = trigger;
-    while (offset > 0) {
-        if (offset == 1) {
-            dummy->next = next;
-            break;
-        }
-        dummy->next = _lf_get_new_event();
-        dummy = dummy->next;
-        dummy->time = time;
-        dummy->is_dummy = true;
-        dummy->trigger = trigger;
-        offset--;
-    }
-    return first_dummy;
+    dummy->microstep_offset = (offset > 0) ? offset : 1;
+    dummy->next = next;
+    return dummy;
+}
+
+/**
+ * Return the number of microsteps taken up by the specified event
+ * in a chain of events lined up in superdense time. A dummy event
+ * takes up as many microsteps as it stands in for. Any other event
+ * takes up exactly one.
+ * @param event The event.
+ */
+static microstep_t _lf_event_microsteps(event_t* event) {
+    return (event->is_dummy && event->microstep_offset > 1) ? event->microstep_offset : 1;
+}
+
+/**
+ * Split the specified dummy event so that it stands in for at most
+ * the specified number of microsteps. The rest of the gap, if any,
+ * is covered by a new dummy event chained right after it.
+ * @param dummy The dummy event.
+ * @param microsteps The number of microsteps (at least 1) to keep.
+ * @return The event that now follows the dummy event.
+ */
+static event_t* _lf_split_dummy_event(event_t* dummy, microstep_t microsteps) {
+    if (dummy->microstep_offset > microsteps) {
+        dummy->next = _lf_create_dummy_events(dummy->trigger, dummy->time, dummy->next,
+                dummy->microstep_offset - microsteps);
+        dummy->microstep_offset = microsteps;
+    }
+    return dummy->next;
 }
 
 /**
@@ -871,8 +1391,13 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token) {
                 // at a future time and at the beginning of the skip list of events 
                 // at that time.
                 // In case the event is a dummy event
-                // convert it to a real event.                
-                found->is_dummy = false;
+                // convert it to a real event. Only the first microstep
+                // of the gap it stands in for becomes a real event.
+                if (found->is_dummy) {
+                    _lf_split_dummy_event(found, 1);
+                    found->is_dummy = false;
+                    found->microstep_offset = 0;
+                }
                 switch (trigger->policy) {
                     case drop:
                         if (found->token != token) {
@@ -920,13 +1445,22 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token) {
                                                             // is at this microstep.
             }
             // Follow the chain of events until the right point
-            // to insert the new event.
+            // to insert the new event. A dummy event takes up
+            // as many microsteps as it stands in for.
             while (microstep_of_found < tag.microstep - 1) {
+                microstep_t remaining = (tag.microstep - 1) - microstep_of_found;
+                microstep_t span = _lf_event_microsteps(found);
+                if (span > remaining) {
+                    // The insertion point falls within the gap of a dummy event.
+                    found = _lf_split_dummy_event(found, remaining);
+                    microstep_of_found += remaining;
+                    break;
+                }
                 if (found->next == NULL) {
                     // The chain stops short of where we want to be.
                     // If it exactly one microstep short of where we want to be,
                     // then we don't need a dummy. Otherwise, we do.
-                    microstep_t undershot_by = (tag.microstep - 1) - microstep_of_found;
+                    microstep_t undershot_by = remaining + 1 - span;
                     if (undershot_by > 0) {
                         found->next = _lf_create_dummy_events(trigger, tag.time, e, undershot_by);
                     } else {
@@ -935,11 +1469,27 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token) {
                     return 1;
                 }
                 found = found->next;
-                microstep_of_found++;
+                microstep_of_found += span;
             }
             // At this point, microstep_of_found == tag.microstep - 1.
+            if (found->is_dummy) {
+                // Make sure that the event after found is at tag.microstep.
+                _lf_split_dummy_event(found, 1);
+            }
             if (found->next == NULL) {
                 found->next = e;
+            } else if (found->next->is_dummy) {
+                // The requested microstep is a gap held by a dummy event.
+                // Let the new event take its place.
+                event_t* dummy = found->next;
+                found->next = e;
+                if (dummy->microstep_offset > 1) {
+                    dummy->microstep_offset--;
+                    e->next = dummy;
+                } else {
+                    e->next = dummy->next;
+                    _lf_recycle_event(dummy);
+                }
             } else {
                 switch (trigger->policy) {
                     case drop:
@@ -1119,11 +1669,11 @@ trigger_handle_t _lf_schedule(trigger_t* trigger, interval_t extra_delay, lf_tok
         event_t* found = (event_t *)pqueue_find_equal_same_priority(event_q, e);
         // Check for conflicts. Let events pile up in super dense time.
         if (found != NULL) {
-            intended_tag.microstep++;
+            intended_tag.microstep += _lf_event_microsteps(found);
             // Skip to the last node in the linked list.
             while(found->next != NULL) {
                 found = found->next;
-                intended_tag.microstep++;
+                intended_tag.microstep += _lf_event_microsteps(found);
             }
             if (_lf_is_tag_after_stop_tag(intended_tag)) {
                 DEBUG_PRINT("Attempt to schedule an event after stop_tag was rejected.");
@@ -1296,6 +1846,8 @@ trigger_handle_t _lf_insert_reactions_for_trigger(trigger_t* trigger, lf_token_t
 #ifdef FEDERATED
     if (compare_tags(trigger->intended_tag, get_current_tag()) < 0) {
         is_STP_violated = true;
+        _lf_metrics_STP_violation(trigger->intended_tag);
+        _LF_LIVE_METRICS_ADD(STP_violations, 1);
     }
 #ifdef FEDERATED_CENTRALIZED
     // Check for STP violation in the centralized coordination, which is a 
@@ -1395,6 +1947,7 @@ void _lf_advance_logical_time(instant_t next_time) {
         error_print_and_exit("_lf_advance_logical_time(): Attempted to move tag back in time.");
     }
     LOG_PRINT("Advanced (elapsed) tag to (%lld, %u)", next_time - start_time, current_tag.microstep);
+    _lf_live_metrics_tag_advanced();
 }
 
 /**
@@ -1411,9 +1964,8 @@ trigger_handle_t _lf_schedule_int(void* action, interval_t extra_delay, int valu
         error_print("Action type is not an integer.");
         return -1;
     }
-    int* container = (int*)malloc(sizeof(int));
-    *container = value;
-    return _lf_schedule_value(action, extra_delay, container, 1);
+    // The int fits in the token, so copying it avoids allocating memory for it.
+    return _lf_schedule_copy(action, extra_delay, &value, 1);
 }
 
 /**
@@ -1439,6 +1991,15 @@ lf_token_t* _lf_set_new_array_impl(lf_token_t* token, size_t length, int num_des
     return new_token;
 }
 
+#if defined(LF_SCHEDULER_STATISTICS) && defined(NUMBER_OF_WORKERS)
+/**
+ * Count a reaction that the calling worker executes directly in
+ * schedule_output_reactions() rather than putting it on the reaction queue.
+ * This is defined in reactor_threaded.c.
+ */
+void _lf_count_inline_reaction();
+#endif
+
 /**
  * For the specified reaction, if it has produced outputs, insert the
  * resulting triggered reactions into the reaction queue.
@@ -1572,6 +2133,8 @@ void schedule_output_reactions(reaction_t* reaction, int worker) {
             if (physical_time > current_tag.time + downstream_to_execute_now->deadline) {
                 // Deadline violation has occurred.
                 violation = true;
+                _lf_metrics_deadline_violation(downstream_to_execute_now, physical_time);
+                _LF_LIVE_METRICS_ADD(deadline_violations, 1);
                 // Invoke the local handler, if there is one.
                 reaction_function_t handler = downstream_to_execute_now->deadline_violation_handler;
                 if (handler != NULL) {
@@ -1585,10 +2148,20 @@ void schedule_output_reactions(reaction_t* reaction, int worker) {
             }
         }
         if (!violation) {
+#if defined(LF_SCHEDULER_STATISTICS) && defined(NUMBER_OF_WORKERS)
+            _lf_count_inline_reaction();
+#endif
             // Invoke the downstream_reaction function.
+#ifdef _LF_TIME_REACTIONS
+            instant_t reaction_start_time = get_physical_time();
+#endif
             tracepoint_reaction_starts(downstream_to_execute_now, worker);
+            _LF_LIVE_METRICS_ADD(reactions, 1);
             downstream_to_execute_now->function(downstream_to_execute_now->self);
             tracepoint_reaction_ends(downstream_to_execute_now, worker);
+#ifdef _LF_TIME_REACTIONS
+            _lf_record_execution_time(downstream_to_execute_now, reaction_start_time);
+#endif
 
             // If the downstream_reaction produced outputs, put the resulting triggered
             // reactions into the queue (or execute them directly, if possible).
@@ -1637,6 +2210,7 @@ lf_token_t* writable_copy(lf_token_t* token) {
         lf_token_t* result = create_token(token->element_size);
         result->length = token->length;
         result->value = copy;
+        _lf_charge_payload(result);
         return result;
     }
 }
@@ -1657,6 +2231,21 @@ void usage(int argc, char* argv[]) {
     printf("   Executed in <n> threads if possible (optional feature).\n\n");
     printf("  -i, --id <n>\n");
     printf("   The ID of the federation that this reactor will join.\n\n");
+    printf("  --trace-file <path>\n");
+    printf("   Write the trace to <path> (if tracing is enabled).\n\n");
+    printf("  --trace-buffer-capacity <n>\n");
+    printf("   Buffer up to <n> trace records per thread, rounded up to a power of two.\n\n");
+    printf("  --trace-events <event>[,<event>...]\n");
+    printf("   Trace only the specified event types, for example reaction_starts,reaction_ends.\n\n");
+    printf("  --trace-reactors <name>[,<name>...]\n");
+    printf("   Trace reactions and calls to schedule only of the named reactors and their contents.\n\n");
+    printf("  --trace-sample <n>\n");
+    printf("   Trace only one of every <n> tags.\n\n");
+    printf("  --trace-sample-interval <duration> <units>\n");
+    printf("   Trace a tag only if the specified amount of physical time has elapsed since\n");
+    printf("   the last traced tag started, where units are as for --timeout.\n\n");
+    printf("  --metrics-file <path>\n");
+    printf("   Publish live metrics in <path> (if live metrics are enabled).\n\n");
 
     printf("Command given:\n");
     for (int i = 0; i < argc; i++) {
@@ -1665,6 +2254,45 @@ void usage(int argc, char* argv[]) {
     printf("\n\n");
 }
 
+/**
+ * Parse a duration given as a time value and units, as in "--timeout 10 msec".
+ * @param time_spec The time value.
+ * @param units The units, one of nsec, usec, msec, sec, minute, hour, day, week, or the plurals of those.
+ * @param result Where to put the duration.
+ * @return true if successful, false if either argument is invalid.
+ */
+bool parse_duration(char* time_spec, char* units, interval_t* result) {
+    interval_t value = atoll(time_spec);
+    // A parse error returns 0LL, so check to see whether that is what is meant.
+    if (value == 0LL && strncmp(time_spec, "0", 1) != 0) {
+        // Parse error.
+        error_print("Invalid time value: %s", time_spec);
+        return false;
+    }
+    if (strncmp(units, "sec", 3) == 0) {
+        *result = SEC(value);
+    } else if (strncmp(units, "msec", 4) == 0) {
+        *result = MSEC(value);
+    } else if (strncmp(units, "usec", 4) == 0) {
+        *result = USEC(value);
+    } else if (strncmp(units, "nsec", 4) == 0) {
+        *result = NSEC(value);
+    } else if (strncmp(units, "min", 3) == 0) {
+        *result = MINUTE(value);
+    } else if (strncmp(units, "hour", 4) == 0) {
+        *result = HOUR(value);
+    } else if (strncmp(units, "day", 3) == 0) {
+        *result = DAY(value);
+    } else if (strncmp(units, "week", 4) == 0) {
+        *result = WEEK(value);
+    } else {
+        // Invalid units.
+        error_print("Invalid time units: %s", units);
+        return false;
+    }
+    return true;
+}
+
 // Some options given in the target directive are provided here as
 // default command-line options.
 int default_argc = 0;
@@ -1711,33 +2339,7 @@ int process_args(int argc, char* argv[]) {
             i++;
             char* time_spec = argv[i++];
             char* units = argv[i];
-            duration = atoll(time_spec);
-            // A parse error returns 0LL, so check to see whether that is what is meant.
-            if (duration == 0LL && strncmp(time_spec, "0", 1) != 0) {
-                // Parse error.
-                error_print("Invalid time value: %s", time_spec);
-                usage(argc, argv);
-                return 0;
-            }
-            if (strncmp(units, "sec", 3) == 0) {
-                duration = SEC(duration);
-            } else if (strncmp(units, "msec", 4) == 0) {
-                duration = MSEC(duration);
-            } else if (strncmp(units, "usec", 4) == 0) {
-                duration = USEC(duration);
-            } else if (strncmp(units, "nsec", 4) == 0) {
-                duration = NSEC(duration);
-            } else if (strncmp(units, "min", 3) == 0) {
-                duration = MINUTE(duration);
-            } else if (strncmp(units, "hour", 4) == 0) {
-                duration = HOUR(duration);
-            } else if (strncmp(units, "day", 3) == 0) {
-                duration = DAY(duration);
-            } else if (strncmp(units, "week", 4) == 0) {
-                duration = WEEK(duration);
-            } else {
-                // Invalid units.
-                error_print("Invalid time units: %s", units);
+            if (!parse_duration(time_spec, units, &duration)) {
                 usage(argc, argv);
                 return 0;
             }
@@ -1779,6 +2381,88 @@ int process_args(int argc, char* argv[]) {
             i++;
             info_print("Federation ID for executable %s: %s", argv[0], argv[i]);
             federation_id = argv[i++];
+        } else if (strcmp(argv[i], "--trace-file") == 0
+                || strcmp(argv[i], "--trace-buffer-capacity") == 0
+                || strcmp(argv[i], "--trace-events") == 0
+                || strcmp(argv[i], "--trace-reactors") == 0) {
+            if (argc < i + 2) {
+                error_print("%s needs an argument.", argv[i]);
+                usage(argc, argv);
+                return 0;
+            }
+            char* option = argv[i++];
+#ifdef LINGUA_FRANCA_TRACE
+            if (strcmp(option, "--trace-file") == 0) {
+                _lf_trace_file_name = argv[i];
+            } else if (strcmp(option, "--trace-buffer-capacity") == 0) {
+                long long capacity = atoll(argv[i]);
+                if (capacity <= 0) {
+                    error_print("Invalid value for --trace-buffer-capacity: %s", argv[i]);
+                    usage(argc, argv);
+                    return 0;
+                }
+                _lf_trace_buffer_capacity = (size_t)capacity;
+            } else if (strcmp(option, "--trace-events") == 0) {
+                if (!_lf_trace_set_events(argv[i])) {
+                    usage(argc, argv);
+                    return 0;
+                }
+            } else {
+                _lf_trace_reactor_filter = argv[i];
+            }
+#else
+            warning_print("Ignoring %s because tracing is not enabled.", option);
+#endif
+        } else if (strcmp(argv[i], "--trace-sample") == 0) {
+            if (argc < i + 2) {
+                error_print("--trace-sample needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            char* sample_spec = argv[i];
+            int period = atoi(sample_spec);
+            if (period <= 0) {
+                error_print("Invalid value for --trace-sample: %s", sample_spec);
+                usage(argc, argv);
+                return 0;
+            }
+#ifdef LINGUA_FRANCA_TRACE
+            _lf_trace_sample_period = (unsigned int)period;
+#else
+            warning_print("Ignoring --trace-sample because tracing is not enabled.");
+#endif
+        } else if (strcmp(argv[i], "--trace-sample-interval") == 0) {
+            if (argc < i + 3) {
+                error_print("--trace-sample-interval needs time and units.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            char* time_spec = argv[i++];
+            char* units = argv[i];
+            interval_t interval;
+            if (!parse_duration(time_spec, units, &interval)) {
+                usage(argc, argv);
+                return 0;
+            }
+#ifdef LINGUA_FRANCA_TRACE
+            _lf_trace_sample_interval = interval;
+#else
+            warning_print("Ignoring --trace-sample-interval because tracing is not enabled.");
+#endif
+        } else if (strcmp(argv[i], "--metrics-file") == 0) {
+            if (argc < i + 2) {
+                error_print("--metrics-file needs a path.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+#ifdef LF_LIVE_METRICS
+            _lf_live_metrics_file_name = argv[i];
+#else
+            warning_print("Ignoring --metrics-file because live metrics are not enabled.");
+#endif
         } else if (strcmp(argv[i], "--ros-args") == 0) {
     	      // FIXME: Ignore ROS arguments for now
         } else {
@@ -1813,6 +2497,16 @@ void initialize() {
             get_event_position, set_event_position, event_matches, print_event);
     next_q = pqueue_init(INITIAL_EVENT_QUEUE_SIZE, in_no_particular_order, get_event_time,
             get_event_position, set_event_position, event_matches, print_event);
+#ifdef _LF_FIXED_CAPACITY_QUEUES
+    pqueue_set_fixed_capacity(reaction_q, 1);
+#ifdef _LF_BOUNDED_EVENT_QUEUES
+    // The recycle queue is left growable: it only grows when a new block
+    // of events is carved out of the event arena, which is not on the
+    // path of a reaction.
+    pqueue_set_fixed_capacity(event_q, 1);
+    pqueue_set_fixed_capacity(next_q, 1);
+#endif
+#endif
 
     // Initialize the trigger table.
     _lf_initialize_trigger_objects();
@@ -1823,6 +2517,9 @@ void initialize() {
 
     DEBUG_PRINT("Start time: %lldns", start_time);
 
+    // Start publishing the live metrics, if they are enabled.
+    start_live_metrics();
+
     struct timespec physical_time_timespec = {physical_start_time / BILLION, physical_start_time % BILLION};
 
     info_print("---- Start execution at time %s---- plus %ld nanoseconds.",
@@ -1865,6 +2562,18 @@ void termination() {
         warning_print("Memory allocated for tokens has not been freed!");
         warning_print("Number of unfreed tokens: %d.", _lf_count_token_allocations);
     }
+    // Report memory usage by category if logging is enabled.
+    if (LOG_LEVEL >= LOG_LEVEL_LOG) {
+        lf_print_memory_usage();
+    }
+#ifdef LF_REACTION_HISTOGRAMS
+    lf_print_reaction_execution_times();
+#endif
+#ifdef LF_METRICS
+    lf_print_metrics();
+#endif
+    // Stop publishing the live metrics, if they are enabled.
+    stop_live_metrics();
     // Print elapsed times.
     // If these are negative, then the program failed to start up.
     interval_t elapsed_time = get_elapsed_logical_time();
@@ -83,6 +83,29 @@ _lf_tag_advancement_barrier _lf_global_tag_advancement_barrier = {0, FOREVER_TAG
 // Queue of currently executing reactions.
 pqueue_t* executing_q; // Sorted by index (precedence sort)
 
+/**
+ * Structure-of-arrays copy of the reaction_t fields read by scans over
+ * many reactions, such as _lf_is_blocked_by_executing_reaction().
+ * Entries are indexed by the id field of reaction_t, assigned the first
+ * time the scheduler sees a reaction (id 0 is never used). A scan thus
+ * touches only these dense arrays rather than whole reaction_t structs,
+ * whose cold fields would otherwise be pulled into the cache.
+ * This table should only be accessed while holding the mutex lock.
+ */
+typedef struct _lf_reaction_table_t {
+    index_t* index;                // Copy of reaction_t.index.
+    unsigned long long* chain_id;  // Copy of reaction_t.chain_id.
+    reaction_t** reaction;         // The reaction itself (used only for debug output).
+    size_t size;                   // Number of ids handed out, plus one for the unused id 0.
+    size_t capacity;               // Number of entries allocated in each array.
+} _lf_reaction_table_t;
+
+_lf_reaction_table_t _lf_reaction_table = {NULL, NULL, NULL, 1, 0};
+
+// Ids of the reactions in executing_q, in no particular order.
+size_t* _lf_executing_reaction_ids = NULL;
+size_t _lf_executing_reaction_ids_size = 0;
+
 pqueue_t* transfer_q;  // To store reactions that are still blocked by other reactions.
 
 // The one and only mutex lock.
@@ -96,6 +119,154 @@ lf_cond_t executing_q_emptied;
 // of requestors on the tag barrier reaches zero.
 lf_cond_t global_tag_barrier_requestors_reached_zero;
 
+#ifdef LF_SCHEDULER_STATISTICS
+/**
+ * Contention statistics of one worker thread. Only the operations of
+ * worker threads on the one and only mutex and its condition variables
+ * are counted. All times are in nanoseconds.
+ */
+typedef struct worker_statistics_t {
+    unsigned long long lock_acquisitions; // Number of times the worker acquired the mutex.
+    interval_t lock_wait_time;            // Total time spent waiting to acquire the mutex.
+    interval_t max_lock_wait_time;        // Longest time spent waiting to acquire the mutex.
+    interval_t lock_hold_time;            // Total time holding the mutex, excluding condition waits.
+    interval_t max_lock_hold_time;        // Longest time holding the mutex.
+    unsigned long long condition_waits;   // Number of waits on condition variables.
+    interval_t condition_wait_time;       // Total time spent in those waits.
+    unsigned long long futile_wakeups;    // Wakeups on reaction_q_changed that found no reaction ready.
+    unsigned long long signals;           // Number of signals and broadcasts sent.
+    unsigned long long queued_reactions;  // Reactions taken from the reaction queue.
+    unsigned long long inline_reactions;  // Reactions executed directly by schedule_output_reactions().
+    int lock_depth;                       // Nesting depth of the recursive mutex.
+    instant_t lock_acquired_time;         // Time at which the mutex was last acquired or reacquired.
+} worker_statistics_t;
+
+/** Statistics of each worker thread, indexed by the worker number minus 1. */
+worker_statistics_t* _lf_worker_statistics = NULL;
+unsigned int _lf_worker_statistics_size = 0;
+
+/** Statistics of the calling thread, or NULL if it is not a worker thread. */
+static _LF_THREAD_LOCAL worker_statistics_t* _lf_this_worker_statistics = NULL;
+
+/** Return the platform clock, which is cheaper to read than get_physical_time(). */
+static inline instant_t _lf_statistics_clock() {
+    instant_t now;
+    lf_clock_gettime(&now);
+    return now;
+}
+
+/** Record that the calling worker stops holding the mutex at the specified time. */
+static void _lf_statistics_release(worker_statistics_t* statistics, instant_t now) {
+    interval_t hold_time = now - statistics->lock_acquired_time;
+    statistics->lock_hold_time += hold_time;
+    if (hold_time > statistics->max_lock_hold_time) {
+        statistics->max_lock_hold_time = hold_time;
+    }
+}
+
+/** Lock the mutex, recording how long it took if the caller is a worker. */
+void _lf_statistics_lock_mutex() {
+    worker_statistics_t* statistics = _lf_this_worker_statistics;
+    if (statistics == NULL || statistics->lock_depth++ > 0) {
+        // Not a worker, or the worker already holds the recursive mutex.
+        lf_mutex_lock(&mutex);
+        return;
+    }
+    instant_t start = _lf_statistics_clock();
+    lf_mutex_lock(&mutex);
+    statistics->lock_acquired_time = _lf_statistics_clock();
+    interval_t wait_time = statistics->lock_acquired_time - start;
+    statistics->lock_acquisitions++;
+    statistics->lock_wait_time += wait_time;
+    if (wait_time > statistics->max_lock_wait_time) {
+        statistics->max_lock_wait_time = wait_time;
+    }
+}
+
+/** Unlock the mutex, recording how long it was held if the caller is a worker. */
+void _lf_statistics_unlock_mutex() {
+    worker_statistics_t* statistics = _lf_this_worker_statistics;
+    if (statistics != NULL && --statistics->lock_depth == 0) {
+        _lf_statistics_release(statistics, _lf_statistics_clock());
+    }
+    lf_mutex_unlock(&mutex);
+}
+
+/**
+ * Wait on the specified condition variable until it is signaled or, if
+ * wakeup_time is not FOREVER, until that time. Condition waits release the
+ * mutex, so the time waiting is not counted as time holding it. Waits are
+ * counted only if the worker acquired the mutex with _LF_LOCK_MUTEX(), so
+ * that its acquisition time is known.
+ */
+int _lf_statistics_cond_wait(lf_cond_t* condition, instant_t wakeup_time) {
+    worker_statistics_t* statistics = _lf_this_worker_statistics;
+    if (statistics == NULL || statistics->lock_depth == 0) {
+        return (wakeup_time == FOREVER) ? lf_cond_wait(condition, &mutex)
+                : lf_cond_timedwait(condition, &mutex, wakeup_time);
+    }
+    instant_t start = _lf_statistics_clock();
+    _lf_statistics_release(statistics, start);
+    int result = (wakeup_time == FOREVER) ? lf_cond_wait(condition, &mutex)
+            : lf_cond_timedwait(condition, &mutex, wakeup_time);
+    statistics->lock_acquired_time = _lf_statistics_clock();
+    statistics->condition_waits++;
+    statistics->condition_wait_time += statistics->lock_acquired_time - start;
+    return result;
+}
+
+/** Signal or broadcast the specified condition variable, counting it if the caller is a worker. */
+int _lf_statistics_signal(lf_cond_t* condition, bool broadcast) {
+    if (_lf_this_worker_statistics != NULL) {
+        _lf_this_worker_statistics->signals++;
+    }
+    return broadcast ? lf_cond_broadcast(condition) : lf_cond_signal(condition);
+}
+
+/**
+ * Count a reaction that the calling worker executes directly in
+ * schedule_output_reactions() rather than putting it on the reaction queue.
+ */
+void _lf_count_inline_reaction() {
+    if (_lf_this_worker_statistics != NULL) {
+        _lf_this_worker_statistics->inline_reactions++;
+    }
+}
+
+/**
+ * Report the contention statistics of each worker on stdout.
+ */
+void _lf_print_worker_statistics() {
+    info_print("---- Scheduler statistics per worker (times in nanoseconds):");
+    for (unsigned int i = 0; i < _lf_worker_statistics_size; i++) {
+        worker_statistics_t* statistics = &_lf_worker_statistics[i];
+        info_print("----   Worker %u: %llu mutex acquisitions, waited %lld (max %lld), held %lld (max %lld).",
+                i + 1, statistics->lock_acquisitions,
+                statistics->lock_wait_time, statistics->max_lock_wait_time,
+                statistics->lock_hold_time, statistics->max_lock_hold_time);
+        info_print("----   Worker %u: %llu condition waits for %lld, %llu futile wakeups, %llu signals sent.",
+                i + 1, statistics->condition_waits, statistics->condition_wait_time,
+                statistics->futile_wakeups, statistics->signals);
+        info_print("----   Worker %u: %llu reactions from the reaction queue, %llu executed inline.",
+                i + 1, statistics->queued_reactions, statistics->inline_reactions);
+    }
+}
+
+#define _LF_LOCK_MUTEX() _lf_statistics_lock_mutex()
+#define _LF_UNLOCK_MUTEX() _lf_statistics_unlock_mutex()
+#define _LF_COND_WAIT(condition) _lf_statistics_cond_wait(condition, FOREVER)
+#define _LF_COND_TIMEDWAIT(condition, time) _lf_statistics_cond_wait(condition, time)
+#define _LF_COND_SIGNAL(condition) _lf_statistics_signal(condition, false)
+#define _LF_COND_BROADCAST(condition) _lf_statistics_signal(condition, true)
+#else
+#define _LF_LOCK_MUTEX() lf_mutex_lock(&mutex)
+#define _LF_UNLOCK_MUTEX() lf_mutex_unlock(&mutex)
+#define _LF_COND_WAIT(condition) lf_cond_wait(condition, &mutex)
+#define _LF_COND_TIMEDWAIT(condition, time) lf_cond_timedwait(condition, &mutex, time)
+#define _LF_COND_SIGNAL(condition) lf_cond_signal(condition)
+#define _LF_COND_BROADCAST(condition) lf_cond_broadcast(condition)
+#endif
+
 /**
  * Enqueue network input control reactions that determine if the trigger for a
  * given network input port is going to be present at the current logical time
@@ -209,9 +380,9 @@ void _lf_increment_global_tag_barrier_already_locked(tag_t future_tag) {
  * will freeze advancement of tag.
  */
 void _lf_increment_global_tag_barrier(tag_t future_tag) {
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     _lf_increment_global_tag_barrier_already_locked(future_tag);
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -238,7 +409,7 @@ void _lf_decrement_global_tag_barrier_locked() {
         // When the semaphore reaches zero, reset the horizon to forever.
         _lf_global_tag_advancement_barrier.horizon = FOREVER_TAG;
         // Notify waiting threads that the semaphore has reached zero.
-        lf_cond_broadcast(&global_tag_barrier_requestors_reached_zero);
+        _LF_COND_BROADCAST(&global_tag_barrier_requestors_reached_zero);
     }
     DEBUG_PRINT("Barrier is at tag (%lld, %u).",
                  _lf_global_tag_advancement_barrier.horizon.time,
@@ -288,7 +459,7 @@ int _lf_wait_on_global_tag_barrier(tag_t proposed_tag) {
         result = 1;
         LOG_PRINT("Waiting on barrier for tag (%lld, %u).", proposed_tag.time - start_time, proposed_tag.microstep);
         // Wait until no requestor remains for the barrier on logical time
-        lf_cond_wait(&global_tag_barrier_requestors_reached_zero, &mutex);
+        _LF_COND_WAIT(&global_tag_barrier_requestors_reached_zero);
         
         // The stop tag may have changed during the wait.
         if (_lf_is_tag_after_stop_tag(proposed_tag)) {
@@ -305,11 +476,11 @@ int _lf_wait_on_global_tag_barrier(tag_t proposed_tag) {
  */
 trigger_handle_t _lf_schedule_token(void* action, interval_t extra_delay, lf_token_t* token) {
     trigger_t* trigger = _lf_action_to_trigger(action);
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     int return_value = _lf_schedule(trigger, extra_delay, token);
     // Notify the main thread in case it is waiting for physical time to elapse.
-    lf_cond_broadcast(&event_q_changed);
-    lf_mutex_unlock(&mutex);
+    _LF_COND_BROADCAST(&event_q_changed);
+    _LF_UNLOCK_MUTEX();
     return return_value;
 }
 
@@ -328,7 +499,7 @@ trigger_handle_t _lf_schedule_copy(void* action, interval_t offset, void* value,
         error_print("schedule: Invalid trigger or element size.");
         return -1;
     }
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     // Initialize token with an array size of length and a reference count of 0.
     lf_token_t* token = _lf_initialize_token(trigger->token, length);
     // Copy the value into the newly allocated memory.
@@ -336,8 +507,8 @@ trigger_handle_t _lf_schedule_copy(void* action, interval_t offset, void* value,
     // The schedule function will increment the reference count.
     trigger_handle_t result = _lf_schedule(trigger, offset, token);
     // Notify the main thread in case it is waiting for physical time to elapse.
-    lf_cond_signal(&event_q_changed);
-    lf_mutex_unlock(&mutex);
+    _LF_COND_SIGNAL(&event_q_changed);
+    _LF_UNLOCK_MUTEX();
     return result;
 }
 
@@ -348,14 +519,16 @@ trigger_handle_t _lf_schedule_copy(void* action, interval_t offset, void* value,
 trigger_handle_t _lf_schedule_value(void* action, interval_t extra_delay, void* value, size_t length) {
     trigger_t* trigger = _lf_action_to_trigger(action);
 
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     lf_token_t* token = create_token(trigger->element_size);
     token->value = value;
     token->length = length;
+    // The runtime is now responsible for freeing the value.
+    _lf_charge_payload(token);
     int return_value = _lf_schedule(trigger, extra_delay, token);
     // Notify the main thread in case it is waiting for physical time to elapse.
-    lf_cond_signal(&event_q_changed);
-    lf_mutex_unlock(&mutex);
+    _LF_COND_SIGNAL(&event_q_changed);
+    _LF_UNLOCK_MUTEX();
     return return_value;
 }
 
@@ -369,6 +542,31 @@ trigger_handle_t _lf_schedule_value(void* action, interval_t extra_delay, void*
  */
 void logical_tag_complete(tag_t tag_to_send);
 
+#if defined(FEDERATED) && defined(LF_FEDERATED_BATCHING)
+/**
+ * Send the messages to other federates that have been batched during the
+ * current tag. The caller must not hold the mutex lock.
+ * This is defined in federate.c.
+ */
+void _lf_flush_outbound_batches();
+#endif
+
+#if defined(FEDERATED) && defined(LF_FEDERATED_ABSENT_HORIZON)
+/**
+ * Return the earliest tag after the current tag at which this federate may
+ * produce an output, or NEVER_TAG if there is none. The caller must hold the
+ * mutex lock. This is defined in federate.c.
+ */
+tag_t _lf_port_absent_horizon();
+
+/**
+ * Declare the network output ports that were absent at the current tag absent
+ * until the specified tag returned by _lf_port_absent_horizon().
+ * The caller must not hold the mutex lock. This is defined in federate.c.
+ */
+void _lf_send_port_absent_horizons(tag_t earliest);
+#endif
+
 /** 
  * Synchronize the start with other federates via the RTI.
  * This assumes that a connection to the RTI is already made 
@@ -457,7 +655,7 @@ bool wait_until(instant_t logical_time_ns, lf_cond_t* condition) {
         // lf_cond_timedwait returns 0 if it is awakened before the timeout.
         // Hence, we want to run it repeatedly until either it returns non-zero or the
         // current physical time matches or exceeds the logical time.
-        if (lf_cond_timedwait(condition, &mutex, unadjusted_wait_until_time_ns) != LF_TIMEOUT) {
+        if (_LF_COND_TIMEDWAIT(condition, unadjusted_wait_until_time_ns) != LF_TIMEOUT) {
             DEBUG_PRINT("-------- wait_until interrupted before timeout.");
 
             // Wait did not time out, which means that there
@@ -699,7 +897,7 @@ void _lf_next() {
  * all federates stop at the same logical time.
  */
 void request_stop() {
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 #ifdef FEDERATED
     _lf_fd_send_stop_request_to_rti();
     // Do not set stop_requested
@@ -712,13 +910,13 @@ void request_stop() {
     // In a non-federated program, the stop_tag will be the next microstep
     _lf_set_stop_tag((tag_t) {.time = current_tag.time, .microstep = current_tag.microstep+1});
     // In case any thread is waiting on a condition, notify all.
-    lf_cond_broadcast(&reaction_q_changed);
+    _LF_COND_BROADCAST(&reaction_q_changed);
     // We signal instead of broadcast under the assumption that only
     // one worker thread can call wait_until at a given time because
     // the call to wait_until is protected by a mutex lock
-    lf_cond_signal(&event_q_changed);
+    _LF_COND_SIGNAL(&event_q_changed);
 #endif
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -734,6 +932,58 @@ bool _lf_has_precedence_over(reaction_t* r1, reaction_t* r2) {
     return false;
 }
 
+/**
+ * Return the id of the specified reaction in _lf_reaction_table,
+ * registering the reaction if it has not been seen before.
+ * This function assumes the mutex is held.
+ * @param reaction The reaction.
+ */
+static size_t _lf_reaction_id(reaction_t* reaction) {
+    if (reaction->id == 0) {
+        if (_lf_reaction_table.size >= _lf_reaction_table.capacity) {
+            size_t capacity = (_lf_reaction_table.capacity == 0) ? 64 : 2 * _lf_reaction_table.capacity;
+            _lf_reaction_table.index = (index_t*)realloc(
+                    _lf_reaction_table.index, capacity * sizeof(index_t));
+            _lf_reaction_table.chain_id = (unsigned long long*)realloc(
+                    _lf_reaction_table.chain_id, capacity * sizeof(unsigned long long));
+            _lf_reaction_table.reaction = (reaction_t**)realloc(
+                    _lf_reaction_table.reaction, capacity * sizeof(reaction_t*));
+            _lf_reaction_table.capacity = capacity;
+        }
+        reaction->id = _lf_reaction_table.size++;
+        _lf_reaction_table.index[reaction->id] = reaction->index;
+        _lf_reaction_table.chain_id[reaction->id] = reaction->chain_id;
+        _lf_reaction_table.reaction[reaction->id] = reaction;
+    }
+    return reaction->id;
+}
+
+/**
+ * Put the specified reaction on the executing queue.
+ * This function assumes the mutex is held.
+ * @param reaction The reaction.
+ */
+static void _lf_insert_executing_reaction(reaction_t* reaction) {
+    pqueue_insert(executing_q, reaction);
+    _lf_executing_reaction_ids[_lf_executing_reaction_ids_size++] = _lf_reaction_id(reaction);
+}
+
+/**
+ * Remove the specified reaction from the executing queue.
+ * This function assumes the mutex is held.
+ * @param reaction The reaction.
+ */
+static void _lf_remove_executing_reaction(reaction_t* reaction) {
+    pqueue_remove(executing_q, reaction);
+    for (size_t i = 0; i < _lf_executing_reaction_ids_size; i++) {
+        if (_lf_executing_reaction_ids[i] == reaction->id) {
+            _lf_executing_reaction_ids[i] =
+                    _lf_executing_reaction_ids[--_lf_executing_reaction_ids_size];
+            break;
+        }
+    }
+}
+
 /**
  * If the reaction is blocked by a currently executing
  * reaction, return true. Otherwise, return false.
@@ -750,10 +1000,17 @@ bool _lf_is_blocked_by_executing_reaction(reaction_t* reaction) {
     if (reaction == NULL) {
         return false;
     }
-    for (size_t i = 1; i < executing_q->size; i++) {
-        reaction_t* running = (reaction_t*) executing_q->d[i];
-        if (_lf_has_precedence_over(running, reaction)) {
-            DEBUG_PRINT("Reaction %s is blocked by reaction %s.", reaction->name, running->name);
+    size_t id = _lf_reaction_id(reaction);
+    index_t level = LEVEL(_lf_reaction_table.index[id]);
+    unsigned long long chain_id = _lf_reaction_table.chain_id[id];
+    // Scan the ids of the executing reactions, which is equivalent to calling
+    // _lf_has_precedence_over() on each reaction in the executing_q.
+    for (size_t i = 0; i < _lf_executing_reaction_ids_size; i++) {
+        size_t running = _lf_executing_reaction_ids[i];
+        if (LEVEL(_lf_reaction_table.index[running]) < level
+                && OVERLAPPING(_lf_reaction_table.chain_id[running], chain_id)) {
+            DEBUG_PRINT("Reaction %s is blocked by reaction %s.",
+                    reaction->name, _lf_reaction_table.reaction[running]->name);
             return true;
         }
     }
@@ -856,7 +1113,7 @@ bool _lf_advancing_time = false;
  */
 void _lf_enqueue_reaction(reaction_t* reaction) {
     // Acquire the mutex lock.
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     // Do not enqueue this reaction twice.
     if (reaction != NULL && pqueue_find_equal_same_priority(reaction_q, reaction) == NULL) {
         DEBUG_PRINT("Enqueing downstream reaction %s.", reaction->name);
@@ -867,7 +1124,7 @@ void _lf_enqueue_reaction(reaction_t* reaction) {
         // which calls the _lf_notify_workers() function defined below.
         // lf_cond_signal(&reaction_q_changed);
     }
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -885,7 +1142,7 @@ void _lf_notify_workers_locked() {
         ) {
             // FIXME: In applications without parallelism, this notification
             // proves very expensive. Perhaps we should be checking execution times.
-            lf_cond_signal(&reaction_q_changed);
+            _LF_COND_SIGNAL(&reaction_q_changed);
             DEBUG_PRINT("Notify another worker of a reaction on the reaction queue.");
         }
     }
@@ -899,9 +1156,9 @@ void _lf_notify_workers_locked() {
  * This function acquires the mutex lock.
  */
 void _lf_notify_workers() {
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
     _lf_notify_workers_locked();
-    lf_mutex_unlock(&mutex);
+    _LF_UNLOCK_MUTEX();
 }
 
 /**
@@ -1014,10 +1271,21 @@ bool _lf_logical_tag_completed = false;
 void* worker(void* arg) {
     // Keep track of whether we have decremented the idle thread count.
     bool have_been_busy = false;
-    lf_mutex_lock(&mutex);
+    _LF_LOCK_MUTEX();
 
     int worker_number = ++worker_thread_count;
     LOG_PRINT("Worker thread %d started.", worker_number);
+#ifdef LF_SCHEDULER_STATISTICS
+    worker_statistics_t* statistics = &_lf_worker_statistics[worker_number - 1];
+    _lf_this_worker_statistics = statistics;
+    // Count the acquisition of the mutex above, whose wait could not be
+    // timed before the worker number was known, and its hold from here.
+    statistics->lock_acquisitions = 1;
+    statistics->lock_depth = 1;
+    statistics->lock_acquired_time = _lf_statistics_clock();
+    // Whether this worker has just been woken up on reaction_q_changed.
+    bool woken_up = false;
+#endif
 
     // Iterate until the stop_tag is reached or reaction queue is empty
     while (true) {
@@ -1026,6 +1294,12 @@ void* worker(void* arg) {
         // that it depends on).
         // print_snapshot(); // This is quite verbose (but very useful in debugging reaction deadlocks).
         reaction_t* current_reaction_to_execute = first_ready_reaction();
+#ifdef LF_SCHEDULER_STATISTICS
+        if (woken_up && current_reaction_to_execute == NULL) {
+            statistics->futile_wakeups++;
+        }
+        woken_up = false;
+#endif
         if (current_reaction_to_execute == NULL) {
             // There are no reactions ready to run.
             // If we were previously busy, count this thread as idle now.
@@ -1045,6 +1319,27 @@ void* worker(void* arg) {
                 	// Block other worker threads from doing that.
                     _lf_advancing_time = true;
 
+#if defined(FEDERATED) && defined(LF_FEDERATED_ABSENT_HORIZON)
+                    tag_t absent_horizon = _lf_port_absent_horizon();
+#endif
+#if defined(FEDERATED) && (defined(LF_FEDERATED_ABSENT_HORIZON) || defined(LF_FEDERATED_BATCHING))
+                    // Sending to another federate may block until it reads earlier messages,
+                    // which its listener thread may not do until that federate releases
+                    // its mutex lock, so release this one. No other worker advances
+                    // time meanwhile because _lf_advancing_time is set.
+                    _LF_UNLOCK_MUTEX();
+#endif
+#if defined(FEDERATED) && defined(LF_FEDERATED_ABSENT_HORIZON)
+                    // Spare downstream federates port absent messages at the coming tags.
+                    _lf_send_port_absent_horizons(absent_horizon);
+#endif
+#if defined(FEDERATED) && defined(LF_FEDERATED_BATCHING)
+                    // Send the messages to other federates batched during this tag.
+                    _lf_flush_outbound_batches();
+#endif
+#if defined(FEDERATED) && (defined(LF_FEDERATED_ABSENT_HORIZON) || defined(LF_FEDERATED_BATCHING))
+                    _LF_LOCK_MUTEX();
+#endif
                     // If this is not the very first step, notify that the previous step is complete
                     // and check against the stop tag to see whether this is the last step.
                     if (_lf_logical_tag_completed) {
@@ -1057,8 +1352,8 @@ void* worker(void* arg) {
                             // Also, notify the RTI that there will be no more events (if centralized coord).
                             // False argument means don't wait for a reply.
                             send_next_event_tag(FOREVER_TAG, false);
-                            lf_cond_broadcast(&reaction_q_changed);
-                            lf_cond_signal(&event_q_changed);
+                            _LF_COND_BROADCAST(&reaction_q_changed);
+                            _LF_COND_SIGNAL(&event_q_changed);
                             break;
                         }
                     }
@@ -1082,8 +1377,11 @@ void* worker(void* arg) {
                 	// Just wait for work on the reaction queue.
                     DEBUG_PRINT("Worker %d: Waiting for items on the reaction queue.", worker_number);
                     tracepoint_worker_wait_starts(worker_number);
-                    lf_cond_wait(&reaction_q_changed, &mutex);
+                    _LF_COND_WAIT(&reaction_q_changed);
                     tracepoint_worker_wait_ends(worker_number);
+#ifdef LF_SCHEDULER_STATISTICS
+                    woken_up = true;
+#endif
                     DEBUG_PRINT("Worker %d: Done waiting.", worker_number);
                 }
             } else {
@@ -1104,8 +1402,11 @@ void* worker(void* arg) {
                 // lf_clock_gettime(CLOCK_REALTIME, &physical_time);
                 // physical_time.tv_nsec += MAX_STALL_INTERVAL;
                 // lf_cond_wait(&reaction_q_changed, &mutex, &physical_time);
-                lf_cond_wait(&reaction_q_changed, &mutex);
+                _LF_COND_WAIT(&reaction_q_changed);
                 tracepoint_worker_wait_ends(worker_number);
+#ifdef LF_SCHEDULER_STATISTICS
+                woken_up = true;
+#endif
                 DEBUG_PRINT("Worker %d: Done waiting.", worker_number);
             }
         } else {
@@ -1117,6 +1418,10 @@ void* worker(void* arg) {
                     current_reaction_to_execute->chain_id,
                     current_reaction_to_execute->deadline);
 
+#ifdef LF_SCHEDULER_STATISTICS
+            statistics->queued_reactions++;
+#endif
+            _lf_live_metrics_reaction_queue_size(pqueue_size(reaction_q));
             // This thread will no longer be idle.
             if (!have_been_busy) {
                 number_of_idle_threads--;
@@ -1125,7 +1430,7 @@ void* worker(void* arg) {
 
             // Push the reaction on the executing queue in order to prevent any
             // reactions that may depend on it from executing before this reaction is finished.
-            pqueue_insert(executing_q, current_reaction_to_execute);
+            _lf_insert_executing_reaction(current_reaction_to_execute);
 
             // If there are additional reactions on the reaction_q, notify one other
             // idle thread, if there is one, so that it can attempt to execute
@@ -1133,7 +1438,7 @@ void* worker(void* arg) {
             _lf_notify_workers_locked();
 
             // Unlock the mutex to run the reaction.
-            lf_mutex_unlock(&mutex);
+            _LF_UNLOCK_MUTEX();
 
             bool violation = false;
             // If the reaction violates the STP offset,
@@ -1183,6 +1488,8 @@ void* worker(void* arg) {
                 if (physical_time > current_tag.time + current_reaction_to_execute->deadline) {
                     // Deadline violation has occurred.
                     violation = true;
+                    _lf_metrics_deadline_violation(current_reaction_to_execute, physical_time);
+                    _LF_LIVE_METRICS_ADD(deadline_violations, 1);
                     // Invoke the local handler, if there is one.
                     reaction_function_t handler = current_reaction_to_execute->deadline_violation_handler;
                     if (handler != NULL) {
@@ -1200,13 +1507,13 @@ void* worker(void* arg) {
             if (violation) {
                 // Need to acquire the mutex lock to remove this from the executing queue
                 // and to obtain the next reaction to execute.
-                lf_mutex_lock(&mutex);
+                _LF_LOCK_MUTEX();
 
                 // The reaction is not going to be executed. However,
                 // this thread holds the mutex lock, so if this is the last
                 // reaction of the current time step, this thread will also
                 // be the one to advance time.
-                pqueue_remove(executing_q, current_reaction_to_execute);
+                _lf_remove_executing_reaction(current_reaction_to_execute);
             } else {
                 // Invoke the reaction function.
                 LOG_PRINT("Worker %d: Invoking reaction %s at elapsed tag (%lld, %d).",
@@ -1214,22 +1521,29 @@ void* worker(void* arg) {
 						current_reaction_to_execute->name,
                         current_tag.time - start_time,
                         current_tag.microstep);
+#ifdef _LF_TIME_REACTIONS
+                instant_t reaction_start_time = get_physical_time();
+#endif
                 tracepoint_reaction_starts(current_reaction_to_execute, worker_number);
+                _LF_LIVE_METRICS_ADD(reactions, 1);
                 current_reaction_to_execute->function(current_reaction_to_execute->self);
                 tracepoint_reaction_ends(current_reaction_to_execute, worker_number);
+#ifdef _LF_TIME_REACTIONS
+                _lf_record_execution_time(current_reaction_to_execute, reaction_start_time);
+#endif
 
                 // If the reaction produced outputs, put the resulting triggered
                 // reactions into the queue or execute them immediately.
                 schedule_output_reactions(current_reaction_to_execute, worker_number);
 
                 // Reacquire the mutex lock.
-                lf_mutex_lock(&mutex);
+                _LF_LOCK_MUTEX();
 
                 // Remove the reaction from the executing queue.
                 // This thread holds the mutex lock, so if this is the last
                 // reaction of the current time step, this thread will also
                 // be the one to advance time.
-                pqueue_remove(executing_q, current_reaction_to_execute);
+                _lf_remove_executing_reaction(current_reaction_to_execute);
             }
             // Reset the is_STP_violated because it has been passed
             // down the chain
@@ -1244,8 +1558,8 @@ void* worker(void* arg) {
 
     DEBUG_PRINT("Worker %d: Stop requested. Exiting.", worker_number);
     // Signal the main thread.
-    lf_cond_signal(&executing_q_emptied);
-    lf_mutex_unlock(&mutex);
+    _LF_COND_SIGNAL(&executing_q_emptied);
+    _LF_UNLOCK_MUTEX();
     // timeout has been requested.
     return NULL;
 }
@@ -1275,6 +1589,11 @@ lf_thread_t* _lf_thread_ids;
 void start_threads() {
     LOG_PRINT("Starting %u worker threads.", _lf_number_of_threads);
     _lf_thread_ids = (lf_thread_t*)malloc(_lf_number_of_threads * sizeof(lf_thread_t));
+#ifdef LF_SCHEDULER_STATISTICS
+    _lf_worker_statistics_size = _lf_number_of_threads;
+    _lf_worker_statistics = (worker_statistics_t*)_lf_calloc(LF_MEMORY_STATISTICS,
+            _lf_number_of_threads, sizeof(worker_statistics_t));
+#endif
     number_of_idle_threads = (int)_lf_number_of_threads; // Sign is checked when 
                                                          // reading the argument
                                                          // from the command
@@ -1313,6 +1632,9 @@ int lf_reactor_c_main(int argc, char* argv[]) {
     // pthreads. Maybe it has been fixed?
     // The one and only mutex lock.
     lf_mutex_init(&mutex);
+#ifdef _LF_PAYLOAD_POOL
+    lf_mutex_init(&_lf_payload_pool_mutex);
+#endif
 
     // Initialize condition variables used for notification between threads.
     lf_cond_init(&event_q_changed);
@@ -1336,7 +1658,7 @@ int lf_reactor_c_main(int argc, char* argv[]) {
 
     if (process_args(default_argc, default_argv)
             && process_args(argc, argv)) {
-        lf_mutex_lock(&mutex); // Sets start_time
+        _LF_LOCK_MUTEX(); // Sets start_time
         initialize();
 
         transfer_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
@@ -1345,13 +1667,18 @@ int lf_reactor_c_main(int argc, char* argv[]) {
         // Create a queue on which to put reactions that are currently executing.
         executing_q = pqueue_init(_lf_number_of_threads, in_reverse_order, get_reaction_index,
             get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+        _lf_executing_reaction_ids = (size_t*)calloc(_lf_number_of_threads, sizeof(size_t));
+#ifdef _LF_FIXED_CAPACITY_QUEUES
+        pqueue_set_fixed_capacity(transfer_q, 1);
+        pqueue_set_fixed_capacity(executing_q, 1);
+#endif
 
         // Call the following function only once, rather than per worker thread (although 
         // it can be probably called in that manner as well).
         _lf_initialize_start_tag();
 
         start_threads();
-        lf_mutex_unlock(&mutex);
+        _LF_UNLOCK_MUTEX();
         DEBUG_PRINT("Waiting for worker threads to exit.");
 
         // Wait for the worker threads to exit.
@@ -1372,6 +1699,9 @@ int lf_reactor_c_main(int argc, char* argv[]) {
         if (ret == 0) {
             LOG_PRINT("---- All worker threads exited successfully.");
         }
+#ifdef LF_SCHEDULER_STATISTICS
+        _lf_print_worker_statistics();
+#endif
         
         free(_lf_thread_ids);
         return ret;
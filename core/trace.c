@@ -33,46 +33,242 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "util.h"
 #include "platform.h"
 
-/** Macro to use when access to trace file fails. */
-#define _LF_TRACE_FAILURE(trace_file) \
+// Unless disabled, the trace file is written through a memory mapping
+// on platforms that support it.
+#if !defined(_WIN32) && !defined(LF_TRACE_NO_MMAP)
+#define _LF_TRACE_MMAP
+#include <sys/mman.h>   // Defines mmap() and msync().
+#include <unistd.h>     // Defines ftruncate() and sysconf().
+#include <fcntl.h>      // Defines posix_fallocate().
+#endif
+
+/** Macro to use when access to trace file fails. The file has already been closed. */
+#define _LF_TRACE_FAILURE() \
     do { \
-        fprintf(stderr, "WARNING: Access to trace file failed.\n"); \
-        fclose(trace_file); \
-        trace_file = NULL; \
         lf_mutex_unlock(&_lf_trace_mutex); \
         return -1; \
     } while(0)
 
+/**
+ * Atomic operations used by the trace buffers.
+ * On compilers without the GCC/Clang builtins, this falls back on volatile
+ * accesses, which are sufficient on x86 with MSVC's default semantics.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define _LF_TRACE_LOAD_ACQUIRE(pointer) __atomic_load_n(pointer, __ATOMIC_ACQUIRE)
+#define _LF_TRACE_STORE_RELEASE(pointer, value) __atomic_store_n(pointer, value, __ATOMIC_RELEASE)
+#define _LF_TRACE_FETCH_ADD(pointer, value) __atomic_fetch_add(pointer, value, __ATOMIC_RELAXED)
+#else
+#define _LF_TRACE_LOAD_ACQUIRE(pointer) (*(volatile size_t*)(pointer))
+#define _LF_TRACE_STORE_RELEASE(pointer, value) (*(volatile size_t*)(pointer) = (value))
+#define _LF_TRACE_FETCH_ADD(pointer, value) ((*(pointer) += (value)) - (value))
+#endif
+
+/** How often the flush thread looks for trace records to write if it is not notified. */
+#define _LF_TRACE_FLUSH_INTERVAL MSEC(10)
+
 // Mutex used to prevent collisions between threads writing to the file.
 lf_mutex_t _lf_trace_mutex;
-// Condition variable used to indicate when flushing a buffer is finished.
-lf_cond_t _lf_flush_finished;
-// Condition variable used to indicate when a new trace needs to be flushed.
+// Condition variable used to indicate when a trace buffer should be flushed.
 lf_cond_t _lf_flush_needed;
 // The thread that flushes to a file.
 lf_thread_t _lf_flush_trace_thread;
 
 /**
- * Array of buffers into which traces are written.
- * When each buffer gets full, the trace is flushed to the trace file.
- * We use a double buffering strategy. When a buffer becomes full,
- * tracing continues in a new buffer while a separate thread writes
- * the old buffer to the file.
+ * A single-producer, single-consumer ring buffer of trace records.
+ * Each thread that records traces gets its own buffer and is its only
+ * producer. The flush thread is the only consumer. The producer only
+ * writes head and the consumer only writes tail, so neither needs a lock.
+ * If the buffer is full, the producer drops the record and counts it
+ * rather than waiting for the flush thread.
  */
-trace_record_t** _lf_trace_buffer = NULL;
-int* _lf_trace_buffer_size = NULL;
-trace_record_t** _lf_trace_buffer_to_flush = NULL;
-int* _lf_trace_buffer_size_to_flush = NULL;
+typedef struct trace_buffer_t {
+    trace_record_t* records;
+    size_t head;     // Number of records ever written. Written only by the producer.
+    size_t tail;     // Number of records ever flushed. Written only by the consumer.
+    size_t dropped;  // Number of records dropped because the buffer was full.
+    instant_t previous_logical_time;   // Logical time of the last record flushed. Used by the consumer.
+    instant_t previous_physical_time;  // Physical time of the last record flushed. Used by the consumer.
+} trace_buffer_t;
+
+/** Array of trace buffers allocated when tracing starts. */
+trace_buffer_t* _lf_trace_buffers = NULL;
 
 /** The number of trace buffers allocated when tracing starts. */
 int _lf_number_of_trace_buffers;
 
+/** The number of trace buffers that threads have claimed so far. */
+int _lf_trace_buffers_claimed = 0;
+
+/** Number of records dropped because all trace buffers were claimed by other threads. */
+size_t _lf_trace_unbuffered_dropped = 0;
+
+/**
+ * Buffer returned to threads that find all trace buffers claimed.
+ * Its records pointer is NULL.
+ */
+trace_buffer_t _lf_trace_no_buffer;
+
+/** The trace buffer of the calling thread, or NULL if it has not claimed one yet. */
+static _LF_THREAD_LOCAL trace_buffer_t* _lf_trace_thread_buffer = NULL;
+
 /** Marker that tracing is stopping or has stopped. */
 int _lf_trace_stop = 1;
 
 /** The file into which traces are written. */
 FILE* _lf_trace_file;
 
+/** If non-NULL, the name of the trace file to use instead of the one given to start_trace(). */
+char* _lf_trace_file_name = NULL;
+
+/**
+ * Number of records each trace buffer holds. When tracing starts,
+ * this is rounded up to a power of two so that indexing is a mask.
+ */
+size_t _lf_trace_buffer_capacity = TRACE_BUFFER_CAPACITY;
+
+/** Bit mask of the event types to record, with bit i for the trace_event_t value i. */
+unsigned int _lf_trace_event_mask = ~0u;
+
+/**
+ * If non-NULL, a comma-separated list of the reactors whose reactions and
+ * calls to schedule() are recorded. A reactor is selected if its name or
+ * that of a reactor containing it is in the list.
+ */
+char* _lf_trace_reactor_filter = NULL;
+
+/** If greater than 1, record only one of every this many tags. */
+unsigned int _lf_trace_sample_period = 1;
+
+/**
+ * If positive, record a tag only if at least this much physical time
+ * has elapsed since the start of the last recorded tag.
+ * This takes precedence over _lf_trace_sample_period.
+ */
+interval_t _lf_trace_sample_interval = 0LL;
+
+/**
+ * Whether the current tag is being recorded. This is written only by
+ * _lf_trace_sample_tag(), which runs between tags while the workers
+ * are not executing reactions, so the workers can read it without
+ * synchronization. The first tag is always recorded.
+ */
+bool _lf_trace_tag_sampled = true;
+
+/** Number of tags to skip before recording the next one when sampling one in N tags. */
+unsigned int _lf_trace_tags_until_sample = 0;
+
+/** Physical time at the start of the last recorded tag when sampling by time. */
+instant_t _lf_trace_last_sampled_time = NEVER;
+
+/** Names used to select event types on the command line, indexed by trace_event_t. */
+static const char* _lf_trace_event_identifiers[] = {
+        "reaction_starts",
+        "reaction_ends",
+        "schedule_called",
+        "user_event",
+        "user_value",
+        "worker_wait_starts",
+        "worker_wait_ends",
+        "worker_advancing_time_starts",
+        "worker_advancing_time_ends"
+};
+
+/** Size of the open-addressing hash set of reactors selected by _lf_trace_reactor_filter. */
+#define _LF_TRACE_SELECTED_REACTORS_SIZE (2 * TRACE_OBJECT_TABLE_SIZE)
+
+/** Hash set of the self structs of the reactors selected by _lf_trace_reactor_filter. */
+void* _lf_trace_selected_reactors[_LF_TRACE_SELECTED_REACTORS_SIZE];
+
+/** Return the hash of the specified pointer, to be reduced modulo a table size. */
+static inline size_t trace_pointer_hash(void* pointer) {
+    return ((size_t)pointer >> 3) * 2654435761u;
+}
+
+/**
+ * Return the slot in _lf_trace_selected_reactors that holds the specified
+ * reactor or the empty slot where it belongs.
+ */
+static inline void** trace_selected_reactor_slot(void* reactor) {
+    size_t slot = trace_pointer_hash(reactor) % _LF_TRACE_SELECTED_REACTORS_SIZE;
+    while (_lf_trace_selected_reactors[slot] != NULL && _lf_trace_selected_reactors[slot] != reactor) {
+        slot = (slot + 1) % _LF_TRACE_SELECTED_REACTORS_SIZE;
+    }
+    return &_lf_trace_selected_reactors[slot];
+}
+
+/**
+ * Return true if the reactor with the specified name is selected by _lf_trace_reactor_filter.
+ */
+static bool trace_reactor_name_selected(const char* name) {
+    const char* start = _lf_trace_reactor_filter;
+    while (*start != '\0') {
+        size_t length = strcspn(start, ",");
+        if (length > 0 && strncmp(name, start, length) == 0
+                && (name[length] == '\0' || name[length] == '.')) {
+            return true;
+        }
+        start += length;
+        if (*start == ',') start++;
+    }
+    return false;
+}
+
+/**
+ * Set the event types to record from a comma-separated list of the names in
+ * _lf_trace_event_identifiers or "all".
+ * @param spec The list.
+ * @return true if successful, false if the list has an unknown name.
+ */
+bool _lf_trace_set_events(char* spec) {
+    unsigned int mask = 0u;
+    int number_of_event_types = sizeof(_lf_trace_event_identifiers) / sizeof(char*);
+    const char* start = spec;
+    while (*start != '\0') {
+        size_t length = strcspn(start, ",");
+        bool found = (length == 3 && strncmp(start, "all", 3) == 0);
+        if (found) {
+            mask = ~0u;
+        }
+        for (int i = 0; i < number_of_event_types && !found; i++) {
+            if (strlen(_lf_trace_event_identifiers[i]) == length
+                    && strncmp(start, _lf_trace_event_identifiers[i], length) == 0) {
+                mask |= 1u << i;
+                found = true;
+            }
+        }
+        if (!found) {
+            error_print("Unknown trace event type: %.*s", (int)length, start);
+            return false;
+        }
+        start += length;
+        if (*start == ',') start++;
+    }
+    _lf_trace_event_mask = mask;
+    return true;
+}
+
+/**
+ * Decide whether to record the tag that is about to start.
+ * This is called once per tag from _lf_start_time_step().
+ */
+void _lf_trace_sample_tag() {
+    if (_lf_trace_sample_interval > 0LL) {
+        instant_t now = get_physical_time();
+        _lf_trace_tag_sampled = (_lf_trace_last_sampled_time == NEVER
+                || now - _lf_trace_last_sampled_time >= _lf_trace_sample_interval);
+        if (_lf_trace_tag_sampled) {
+            _lf_trace_last_sampled_time = now;
+        }
+    } else if (_lf_trace_sample_period > 1) {
+        _lf_trace_tag_sampled = (_lf_trace_tags_until_sample == 0);
+        if (_lf_trace_tag_sampled) {
+            _lf_trace_tags_until_sample = _lf_trace_sample_period;
+        }
+        _lf_trace_tags_until_sample--;
+    }
+}
+
 /**
  * Table of pointers to a description of the object.
  */
@@ -97,6 +293,10 @@ int _lf_register_trace_event(void* pointer1, void* pointer2, _lf_trace_object_t
     _lf_trace_object_descriptions[_lf_trace_object_descriptions_size].type = type;
     _lf_trace_object_descriptions[_lf_trace_object_descriptions_size].description = description;
     _lf_trace_object_descriptions_size++;
+    if (_lf_trace_reactor_filter != NULL && type == trace_reactor && pointer1 != NULL
+            && trace_reactor_name_selected(description)) {
+        *trace_selected_reactor_slot(pointer1) = pointer1;
+    }
     lf_mutex_unlock(&_lf_trace_mutex);
     return 1;
 }
@@ -115,6 +315,232 @@ int register_user_trace_event(char* description) {
 /** Indicator that the trace header information has been written to the file. */
 bool _lf_trace_header_written = false;
 
+/**
+ * Maximum size of an encoded trace record: the event type byte and up to
+ * eight varints of at most ten bytes each.
+ */
+#define _LF_TRACE_MAX_ENCODED_RECORD_SIZE (1 + 8 * 10)
+
+/** Size of the open-addressing hash table from object pointers to object indices. */
+#define _LF_TRACE_OBJECT_INDEX_SIZE (2 * TRACE_OBJECT_TABLE_SIZE)
+
+/** Entry in the hash table from object pointers to object indices. */
+typedef struct trace_object_index_t {
+    void* key;        // The reactor or user pointer, or the trigger pointer for a trigger.
+    bool is_trigger;  // Whether the key is a trigger.
+    int index;        // 1 + the position of the object in the object table.
+} trace_object_index_t;
+
+/**
+ * Hash table from object pointers to object indices. This is built when the
+ * header is written and used only by the flush thread.
+ */
+trace_object_index_t _lf_trace_object_index[_LF_TRACE_OBJECT_INDEX_SIZE];
+
+/**
+ * Buffer into which the flush thread encodes records before writing them to the file.
+ * This is not used if the file is memory mapped.
+ */
+unsigned char* _lf_trace_encoding_buffer = NULL;
+
+/** Room needed to encode the records of one trace buffer plus the header of the block holding them. */
+#define _LF_TRACE_MAX_ENCODED_BLOCK_SIZE (_lf_trace_buffer_capacity * _LF_TRACE_MAX_ENCODED_RECORD_SIZE + 21)
+
+/**
+ * Size of the segments of the trace file that are mapped into memory at a time.
+ * Each segment is allocated in the file before it is mapped.
+ */
+#define _LF_TRACE_SEGMENT_SIZE (4 * 1024 * 1024)
+
+#ifdef _LF_TRACE_MMAP
+/**
+ * State of the memory-mapped trace file. The flush thread encodes records
+ * directly into the mapped segment rather than into a buffer that is then
+ * copied to the file. When a segment is full, the next one is allocated
+ * and mapped, and write-back of the full one is started.
+ */
+typedef struct trace_writer_t {
+    unsigned char* segment;  // The mapped segment or NULL if none is mapped.
+    size_t segment_offset;   // Offset in the file of the start of the segment (page aligned).
+    size_t segment_size;     // Size of the mapped segment.
+    size_t offset;           // Offset in the file of the next byte to write.
+} trace_writer_t;
+
+trace_writer_t _lf_trace_writer = {NULL, 0, 0, 0};
+
+/**
+ * Unmap the current segment of the trace file, if any, after
+ * starting write-back of its pages.
+ */
+static void trace_unmap_segment() {
+    if (_lf_trace_writer.segment != NULL) {
+        msync(_lf_trace_writer.segment, _lf_trace_writer.segment_size, MS_ASYNC);
+        munmap(_lf_trace_writer.segment, _lf_trace_writer.segment_size);
+        _lf_trace_writer.segment = NULL;
+    }
+}
+
+/**
+ * Allocate and map a segment of the trace file with room for at least
+ * the specified number of bytes at the current offset.
+ * @return true if successful.
+ */
+static bool trace_map_segment(size_t size) {
+    trace_unmap_segment();
+    // Mappings must start on a page boundary, so the new segment overlaps
+    // the partially written last page of the previous one.
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = _lf_trace_writer.offset - _lf_trace_writer.offset % page_size;
+    size_t segment_size = _LF_TRACE_SEGMENT_SIZE;
+    if (_lf_trace_writer.offset - start + size > segment_size) {
+        segment_size = (_lf_trace_writer.offset - start + size + page_size - 1) / page_size * page_size;
+    }
+    int fd = fileno(_lf_trace_file);
+#ifdef __linux__
+    // Allocate the blocks now so that running out of disk space is reported
+    // here rather than as SIGBUS when writing to the mapping.
+    if (posix_fallocate(fd, (off_t)start, (off_t)segment_size) != 0) return false;
+#else
+    if (ftruncate(fd, (off_t)(start + segment_size)) != 0) return false;
+#endif
+    void* segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)start);
+    if (segment == MAP_FAILED) return false;
+    madvise(segment, segment_size, MADV_SEQUENTIAL);
+    _lf_trace_writer.segment = (unsigned char*)segment;
+    _lf_trace_writer.segment_offset = start;
+    _lf_trace_writer.segment_size = segment_size;
+    return true;
+}
+#endif // _LF_TRACE_MMAP
+
+/**
+ * Close the trace file. If it is memory mapped, this trims the file to
+ * the bytes actually written.
+ */
+static void close_trace_file() {
+    if (_lf_trace_file == NULL) return;
+#ifdef _LF_TRACE_MMAP
+    trace_unmap_segment();
+    if (ftruncate(fileno(_lf_trace_file), (off_t)_lf_trace_writer.offset) != 0) {
+        fprintf(stderr, "WARNING: Failed to truncate the trace file.\n");
+    }
+#endif
+    fclose(_lf_trace_file);
+    _lf_trace_file = NULL;
+}
+
+/**
+ * Return a pointer to memory into which to write the specified number
+ * of bytes for the trace file. Follow this with trace_commit().
+ * This is called only by the flush thread or after it has exited.
+ * @return A pointer or NULL if the trace file could not be extended, in which
+ *  case a warning has been printed and the file has been closed.
+ */
+static unsigned char* trace_reserve(size_t size) {
+#ifdef _LF_TRACE_MMAP
+    if (_lf_trace_writer.segment == NULL
+            || _lf_trace_writer.offset + size
+                    > _lf_trace_writer.segment_offset + _lf_trace_writer.segment_size) {
+        if (!trace_map_segment(size)) {
+            fprintf(stderr, "WARNING: Failed to map the trace file with error code %d.\n", errno);
+            close_trace_file();
+            return NULL;
+        }
+    }
+    return &_lf_trace_writer.segment[_lf_trace_writer.offset - _lf_trace_writer.segment_offset];
+#else
+    return _lf_trace_encoding_buffer;
+#endif
+}
+
+/**
+ * Write the specified number of bytes, which have been written to the
+ * memory returned by trace_reserve(), to the trace file.
+ * @return true if successful. Otherwise, a warning has been printed
+ *  and the file has been closed.
+ */
+static bool trace_commit(size_t size) {
+#ifdef _LF_TRACE_MMAP
+    _lf_trace_writer.offset += size;
+#else
+    if (fwrite(_lf_trace_encoding_buffer, 1, size, _lf_trace_file) != size) {
+        fprintf(stderr, "WARNING: Access to trace file failed.\n");
+        close_trace_file();
+        return false;
+    }
+#endif
+    return true;
+}
+
+/**
+ * Write the specified data to the trace file.
+ * @return true if successful. Otherwise, a warning has been printed
+ *  and the file has been closed.
+ */
+static bool trace_write(const void* data, size_t size) {
+#ifdef _LF_TRACE_MMAP
+    unsigned char* out = trace_reserve(size);
+    if (out == NULL) return false;
+    memcpy(out, data, size);
+    return trace_commit(size);
+#else
+    if (fwrite(data, 1, size, _lf_trace_file) != size) {
+        fprintf(stderr, "WARNING: Access to trace file failed.\n");
+        close_trace_file();
+        return false;
+    }
+    return true;
+#endif
+}
+
+/**
+ * Encode the specified unsigned value as a varint.
+ * @param out Where to write the encoding, which takes at most ten bytes.
+ * @return The number of bytes written.
+ */
+static size_t trace_encode_unsigned(unsigned char* out, unsigned long long value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+    return size;
+}
+
+/**
+ * Encode the specified signed value as a zigzag varint.
+ * @param out Where to write the encoding, which takes at most ten bytes.
+ * @return The number of bytes written.
+ */
+static size_t trace_encode_signed(unsigned char* out, long long value) {
+    return trace_encode_unsigned(out,
+            ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+/**
+ * Return the slot in the object index for the specified key.
+ * This is either the slot holding the key or the empty slot where it belongs.
+ */
+static trace_object_index_t* trace_object_slot(void* key, bool is_trigger) {
+    size_t slot = (trace_pointer_hash(key) + is_trigger) % _LF_TRACE_OBJECT_INDEX_SIZE;
+    while (_lf_trace_object_index[slot].key != NULL
+            && (_lf_trace_object_index[slot].key != key
+                    || _lf_trace_object_index[slot].is_trigger != is_trigger)) {
+        slot = (slot + 1) % _LF_TRACE_OBJECT_INDEX_SIZE;
+    }
+    return &_lf_trace_object_index[slot];
+}
+
+/**
+ * Return 1 + the position in the object table of the object with the specified key,
+ * or 0 if the key is NULL or the object was not registered before the header was written.
+ */
+static int trace_object_index(void* key, bool is_trigger) {
+    if (key == NULL) return 0;
+    return trace_object_slot(key, is_trigger)->index;
+}
+
 /**
  * Write the trace header information.
  * See trace.h.
@@ -123,186 +549,196 @@ bool _lf_trace_header_written = false;
 int write_trace_header() {
     if (_lf_trace_file != NULL) {
         lf_mutex_lock(&_lf_trace_mutex);
-        // The first item in the header is the start time.
+        unsigned char encoded[20];
+        // The first items in the header identify the format.
+        if (!trace_write(TRACE_FORMAT_MAGIC, 4)) _LF_TRACE_FAILURE();
+        encoded[0] = TRACE_FORMAT_VERSION;
+        if (!trace_write(encoded, 1)) _LF_TRACE_FAILURE();
+
+        // The next item in the header is the start time.
         // This is both the starting physical time and the starting logical time.
+        // Records encode their times relative to this.
         instant_t start_time = get_start_time();
-        // printf("DEBUG: Start time written to trace file is %lld.\n", start_time);
-        size_t items_written = fwrite(
-                &start_time,
-                sizeof(instant_t),
-                1,
-                _lf_trace_file
-        );
-        if (items_written != 1) _LF_TRACE_FAILURE(_lf_trace_file);
-
-        // The next item in the header is the size of the
-        // _lf_trace_object_descriptions table.
-        // printf("DEBUG: Table size written to trace file is %d.\n", _lf_trace_object_descriptions_size);
-        items_written = fwrite(
-                &_lf_trace_object_descriptions_size,
-                sizeof(int),
-                1,
-                _lf_trace_file
-        );
-        if (items_written != 1) _LF_TRACE_FAILURE(_lf_trace_file);
+        for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
+            _lf_trace_buffers[i].previous_logical_time = start_time;
+            _lf_trace_buffers[i].previous_physical_time = start_time;
+        }
+        // The size of the _lf_trace_object_descriptions table follows.
+        size_t size = trace_encode_signed(encoded, start_time);
+        size += trace_encode_unsigned(&encoded[size], _lf_trace_object_descriptions_size);
+        if (!trace_write(encoded, size)) _LF_TRACE_FAILURE();
+
+        // Index the table so that records can refer to objects by position.
+        for (int i = 0; i < _lf_trace_object_descriptions_size; i++) {
+            bool is_trigger = (_lf_trace_object_descriptions[i].type == trace_trigger);
+            void* key = is_trigger ?
+                    _lf_trace_object_descriptions[i].trigger : _lf_trace_object_descriptions[i].pointer;
+            trace_object_index_t* slot = trace_object_slot(key, is_trigger);
+            if (key != NULL && slot->key == NULL) {
+                slot->key = key;
+                slot->is_trigger = is_trigger;
+                slot->index = i + 1;
+            }
+        }
 
         // Next we write the table.
         for (int i = 0; i < _lf_trace_object_descriptions_size; i++) {
-            // printf("DEBUG: Object pointer: %p.\n", _lf_trace_object_descriptions[i].pointer);
-            // Write the pointer to the self struct.
-            items_written = fwrite(
-                        &_lf_trace_object_descriptions[i].pointer,
-                        sizeof(void*),
-                        1,
-                        _lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(_lf_trace_file);
-
-            // Write the pointer to the trigger_t struct.
-            items_written = fwrite(
-                        &_lf_trace_object_descriptions[i].trigger,
-                        sizeof(trigger_t*),
-                        1,
-                        _lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(_lf_trace_file);
-
-            // Write the object type.
-            items_written = fwrite(
-                        &_lf_trace_object_descriptions[i].type, // Write the pointer value.
-                        sizeof(_lf_trace_object_t),
-                        1,
-                        _lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(_lf_trace_file);
+            // Write the object type and, for a trigger, its reactor.
+            encoded[0] = (unsigned char)_lf_trace_object_descriptions[i].type;
+            size = 1;
+            if (_lf_trace_object_descriptions[i].type == trace_trigger) {
+                size += trace_encode_unsigned(&encoded[size],
+                        trace_object_index(_lf_trace_object_descriptions[i].pointer, false));
+            }
+            if (!trace_write(encoded, size)) _LF_TRACE_FAILURE();
 
             // Write the description.
-            int description_size = strlen(_lf_trace_object_descriptions[i].description);
-            // printf("DEBUG: Object description: %s.\n", _lf_trace_object_descriptions[i].description);
-            items_written = fwrite(
-                        _lf_trace_object_descriptions[i].description,
-                        sizeof(char),
-                        description_size + 1, // Include null terminator.
-                        _lf_trace_file
-            );
-            if (items_written != description_size + 1) _LF_TRACE_FAILURE(_lf_trace_file);
+            size_t description_size = strlen(_lf_trace_object_descriptions[i].description);
+            if (!trace_write(
+                    _lf_trace_object_descriptions[i].description,
+                    description_size + 1 // Include null terminator.
+            )) _LF_TRACE_FAILURE();
         }
         lf_mutex_unlock(&_lf_trace_mutex);
     }
     return _lf_trace_object_descriptions_size;
 }
 
+/**
+ * Encode the specified trace record into the specified buffer.
+ * Times are encoded relative to those of the previous record from the same
+ * trace buffer, which are updated.
+ * @param out Where to write the encoding, which takes at most
+ *  _LF_TRACE_MAX_ENCODED_RECORD_SIZE bytes.
+ * @param record The record.
+ * @param buffer The trace buffer the record came from.
+ * @return The number of bytes written.
+ */
+static size_t trace_encode_record(unsigned char* out, trace_record_t* record, trace_buffer_t* buffer) {
+    unsigned char flags = (unsigned char)record->event_type & TRACE_RECORD_EVENT_TYPE_MASK;
+    if (record->pointer != NULL) flags |= TRACE_RECORD_HAS_POINTER;
+    if (record->microstep != 0) flags |= TRACE_RECORD_HAS_MICROSTEP;
+    if (record->trigger != NULL) flags |= TRACE_RECORD_HAS_TRIGGER;
+    if (record->extra_delay != 0) flags |= TRACE_RECORD_HAS_EXTRA_DELAY;
+    out[0] = flags;
+    size_t size = 1;
+    if (flags & TRACE_RECORD_HAS_POINTER) {
+        size += trace_encode_unsigned(&out[size], trace_object_index(record->pointer, false));
+    }
+    size += trace_encode_signed(&out[size], record->reaction_number);
+    size += trace_encode_signed(&out[size], record->worker);
+    size += trace_encode_signed(&out[size], record->logical_time - buffer->previous_logical_time);
+    buffer->previous_logical_time = record->logical_time;
+    if (flags & TRACE_RECORD_HAS_MICROSTEP) {
+        size += trace_encode_unsigned(&out[size], record->microstep);
+    }
+    size += trace_encode_signed(&out[size], record->physical_time - buffer->previous_physical_time);
+    buffer->previous_physical_time = record->physical_time;
+    if (flags & TRACE_RECORD_HAS_TRIGGER) {
+        size += trace_encode_unsigned(&out[size], trace_object_index(record->trigger, true));
+    }
+    if (flags & TRACE_RECORD_HAS_EXTRA_DELAY) {
+        size += trace_encode_signed(&out[size], record->extra_delay);
+    }
+    return size;
+}
+
+/**
+ * Write the records in the specified trace buffer to the trace file.
+ * This is called only by the flush thread, which is the only consumer of the buffer.
+ * Each contiguous run of records is encoded and written as one
+ * TRACE_BLOCK_RECORDS block.
+ * @param buffer The trace buffer.
+ * @return The number of records written.
+ */
+static size_t flush_trace_buffer(trace_buffer_t* buffer) {
+    size_t tail = buffer->tail;
+    size_t head = _LF_TRACE_LOAD_ACQUIRE(&buffer->head);
+    size_t written = 0;
+    while (tail != head && _lf_trace_file != NULL) {
+        size_t start = tail & (_lf_trace_buffer_capacity - 1);
+        size_t count = head - tail;
+        if (start + count > _lf_trace_buffer_capacity) {
+            // Write up to the end of the array. The rest wraps around to the start.
+            count = _lf_trace_buffer_capacity - start;
+        }
+        // Write first the block type, the buffer, and the number of records.
+        unsigned char* out = trace_reserve(_LF_TRACE_MAX_ENCODED_BLOCK_SIZE);
+        if (out == NULL) break;
+        out[0] = TRACE_BLOCK_RECORDS;
+        size_t size = 1;
+        size += trace_encode_unsigned(&out[size], (unsigned long long)(buffer - _lf_trace_buffers));
+        size += trace_encode_unsigned(&out[size], count);
+        // Encode the contents.
+        for (size_t i = start; i < start + count; i++) {
+            size += trace_encode_record(&out[size], &buffer->records[i], buffer);
+        }
+        trace_commit(size);
+        tail += count;
+        written += count;
+        // Release the space to the producer only after the records have been copied out.
+        _LF_TRACE_STORE_RELEASE(&buffer->tail, tail);
+    }
+    return written;
+}
+
 /**
  * Thread that actually flushes the buffers to a file.
+ * Producers do not wait for this thread. It is notified when a buffer
+ * becomes half full and otherwise polls the buffers periodically.
  */
 void* flush_trace(void* args) {
     lf_mutex_lock(&_lf_trace_mutex);
     while (_lf_trace_file != NULL) {
-        // Look for a buffer to flush.
-        int worker = -1;
-        for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
-            if (_lf_trace_buffer_size_to_flush && _lf_trace_buffer_size_to_flush[i] > 0) {
-                // Found one.
-                worker = i;
-                break;
-            }
-        }
-        if (worker < 0) {
-            // There is no trace ready to flush.
-            if (_lf_trace_stop != 0) {
-                // Tracing has stopped.
-                lf_mutex_unlock(&_lf_trace_mutex);
-                return NULL;
-            }
-            // Wait for notification that there is a buffer ready to flush
-            // (or that tracing is being stopped).
-            lf_cond_wait(&_lf_flush_needed, &_lf_trace_mutex);
-            continue;
-        }
+        // Read the stop marker before draining so that all records
+        // written before stop_trace() was called are flushed.
+        int stopping = _lf_trace_stop;
+
         // Unlock the mutex to write to the file.
         lf_mutex_unlock(&_lf_trace_mutex);
 
         // If the trace header has not been written, write it now.
         // This is deferred to here so that user trace objects can be
         // registered in startup reactions.
-        if (!_lf_trace_header_written) {
-            write_trace_header();
-            _lf_trace_header_written = true;
+        size_t written = 0;
+        for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
+            if (_lf_trace_buffers[i].tail != _LF_TRACE_LOAD_ACQUIRE(&_lf_trace_buffers[i].head)) {
+                if (!_lf_trace_header_written) {
+                    write_trace_header();
+                    _lf_trace_header_written = true;
+                }
+                written += flush_trace_buffer(&_lf_trace_buffers[i]);
+            }
         }
 
-        // Write first the length of the array.
-        size_t items_written = fwrite(
-                &_lf_trace_buffer_size_to_flush[worker],
-                sizeof(int),
-                1,
-                _lf_trace_file
-        );
-        if (items_written != 1) {
-            fprintf(stderr, "WARNING: Access to trace file failed.\n");
-            fclose(_lf_trace_file);
-            _lf_trace_file = NULL;
-        } else {
-            // Write the contents.
-            items_written = fwrite(
-                    _lf_trace_buffer_to_flush[worker],
-                    sizeof(trace_record_t),
-                    _lf_trace_buffer_size_to_flush[worker],
-                    _lf_trace_file
-            );
-            if (items_written != _lf_trace_buffer_size_to_flush[worker]) {
-                fprintf(stderr, "WARNING: Access to trace file failed.\n");
-                fclose(_lf_trace_file);
-                _lf_trace_file = NULL;
+        lf_mutex_lock(&_lf_trace_mutex);
+        if (written == 0) {
+            if (stopping) {
+                // Tracing has stopped and everything has been written.
+                break;
             }
+            // Wait for notification that a buffer is filling up
+            // (or that tracing is being stopped).
+            lf_cond_timedwait(&_lf_flush_needed, &_lf_trace_mutex,
+                    get_physical_time() + _LF_TRACE_FLUSH_INTERVAL);
         }
-        // Acquire the mutex to update the size.
-        lf_mutex_lock(&_lf_trace_mutex);
-        _lf_trace_buffer_size_to_flush[worker] = 0;
-        // There may be more than one worker thread blocked waiting for a flush,
-        // so broadcast rather than just signal.
-        lf_cond_broadcast(&_lf_flush_finished);
     }
+    lf_mutex_unlock(&_lf_trace_mutex);
     return NULL;
 }
 
 /**
- * Flush trace so far to the trace file. This version assumes the mutex
- * is already held.
- * @param worker The worker thread or 0 for the main (or only) thread.
+ * Claim a trace buffer for the calling thread.
+ * @return The claimed buffer or &_lf_trace_no_buffer if all buffers are claimed.
  */
-void flush_trace_to_file_locked(int worker) {
-    if (_lf_trace_file != NULL) {
-        // printf("DEBUG: Writing %d trace records.\n", _lf_trace_buffer_size[worker]);
-
-        // If the previous flush for this worker is not finished, wait for it to finish.
-        while (_lf_trace_buffer_size_to_flush[worker] != 0) {
-            lf_cond_wait(&_lf_flush_finished, &_lf_trace_mutex);
-        }
-        _lf_trace_buffer_size_to_flush[worker] = _lf_trace_buffer_size[worker];
-
-        // Swap the double buffer.
-        trace_record_t* tmp = _lf_trace_buffer[worker];
-        _lf_trace_buffer[worker] = _lf_trace_buffer_to_flush[worker];
-        _lf_trace_buffer_to_flush[worker] = tmp;
-
-        _lf_trace_buffer_size[worker] = 0;
-        lf_cond_signal(&_lf_flush_needed);
-    }
-}
-
-/**
- * Flush trace so far to the trace file. We use double buffering, so unless
- * the flush thread is busy flushing the previous buffer for this worker, this
- * returns immediately.
- * @param worker The worker thread or 0 for the main (or only) thread.
- */
-void flush_trace_to_file(int worker) {
-    if (_lf_trace_file != NULL) {
-        // printf("DEBUG: Writing %d trace records.\n", _lf_trace_buffer_size[worker]);
-        lf_mutex_lock(&_lf_trace_mutex);
-        flush_trace_to_file_locked(worker);
-        lf_mutex_unlock(&_lf_trace_mutex);
+static trace_buffer_t* claim_trace_buffer() {
+    int index = _LF_TRACE_FETCH_ADD(&_lf_trace_buffers_claimed, 1);
+    if (index < _lf_number_of_trace_buffers) {
+        _lf_trace_thread_buffer = &_lf_trace_buffers[index];
+    } else {
+        _lf_trace_thread_buffer = &_lf_trace_no_buffer;
     }
+    return _lf_trace_thread_buffer;
 }
 
 /**
@@ -311,10 +747,13 @@ void flush_trace_to_file(int worker) {
  */
 void start_trace(char* filename) {
     lf_mutex_init(&_lf_trace_mutex);
-    lf_cond_init(&_lf_flush_finished);
     lf_cond_init(&_lf_flush_needed);
-    // FIXME: location of trace file should be customizable.
-    _lf_trace_file = fopen(filename, "w");
+    // The command line can override the file name chosen by the code generator.
+    if (_lf_trace_file_name != NULL) {
+        filename = _lf_trace_file_name;
+    }
+    // Open for reading too because a shared, writable mapping requires it.
+    _lf_trace_file = fopen(filename, "w+");
     if (_lf_trace_file == NULL) {
         fprintf(stderr, "WARNING: Failed to open log file with error code %d."
                 "No log will be written.\n", errno);
@@ -324,24 +763,31 @@ void start_trace(char* filename) {
     // write_trace_header();
     _lf_trace_header_written = false;
 
-    // Allocate an array of arrays of trace records, one per worker thread plus one
-    // for the 0 thread (the main thread, or in an unthreaded program, the only
-    // thread).
-    _lf_number_of_trace_buffers = _lf_number_of_threads + 1;
-    _lf_trace_buffer = (trace_record_t**)malloc(sizeof(trace_record_t*) * _lf_number_of_trace_buffers);
+    // Allocate one trace buffer per worker thread plus one for the main thread
+    // (or, in an unthreaded program, the only thread) and a few for other threads
+    // that may call schedule(). Each thread claims a buffer the first time it
+    // records a trace.
+    size_t capacity = 2;
+    while (capacity < _lf_trace_buffer_capacity) capacity <<= 1;
+    _lf_trace_buffer_capacity = capacity;
+    _lf_number_of_trace_buffers = _lf_number_of_threads + 1 + TRACE_EXTERNAL_THREAD_BUFFERS;
+    _lf_trace_buffers = (trace_buffer_t*)_lf_calloc(LF_MEMORY_TRACE_BUFFERS,
+            _lf_number_of_trace_buffers, sizeof(trace_buffer_t));
     for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
-        _lf_trace_buffer[i] = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_BUFFER_CAPACITY);
+        _lf_trace_buffers[i].records = (trace_record_t*)_lf_malloc(LF_MEMORY_TRACE_BUFFERS,
+                sizeof(trace_record_t) * _lf_trace_buffer_capacity);
     }
-    // Array of counters that track the size of each trace record (per thread).
-    _lf_trace_buffer_size = (int*)calloc(sizeof(int), _lf_number_of_trace_buffers);
-
-    // Allocate memory for double buffering.
-    _lf_trace_buffer_to_flush = (trace_record_t**)malloc(sizeof(trace_record_t*) * _lf_number_of_trace_buffers);
-    for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
-        _lf_trace_buffer_to_flush[i] = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_BUFFER_CAPACITY);
+#ifndef _LF_TRACE_MMAP
+    _lf_trace_encoding_buffer = (unsigned char*)_lf_malloc(LF_MEMORY_TRACE_BUFFERS,
+            _LF_TRACE_MAX_ENCODED_BLOCK_SIZE);
+#endif
+
+    // The start tag is recorded, and sampling counts from there.
+    _lf_trace_tag_sampled = true;
+    if (_lf_trace_sample_period > 1) {
+        _lf_trace_tags_until_sample = _lf_trace_sample_period - 1;
     }
-    // Array of counters that track the size of each trace record (per thread).
-    _lf_trace_buffer_size_to_flush = (int*)calloc(sizeof(int), _lf_number_of_trace_buffers);
+    _lf_trace_last_sampled_time = get_physical_time();
 
     _lf_trace_stop = 0;
 
@@ -381,30 +827,57 @@ void tracepoint(
         trigger_t* trigger,
         interval_t extra_delay
 ) {
-    // printf("DEBUG: Creating trace record.\n");
-    // Flush the buffer if it is full.
-    int index = (worker >= 0) ? worker : 0;
-    if (_lf_trace_buffer_size[index] >= TRACE_BUFFER_CAPACITY) {
-        // No more room in the buffer. Write the buffer to the file.
-        flush_trace_to_file(index);
-    }
-    // The above flush_trace_to_file resets the write pointer.
-    int i = _lf_trace_buffer_size[index];
+    // Filter before touching the buffer so that unwanted events cost little.
+    if (!_lf_trace_tag_sampled) {
+        return;
+    }
+    if ((_lf_trace_event_mask & (1u << event_type)) == 0) {
+        return;
+    }
+    if (_lf_trace_reactor_filter != NULL && event_type <= schedule_called
+            && *trace_selected_reactor_slot(pointer) == NULL) {
+        return;
+    }
+    trace_buffer_t* buffer = _lf_trace_thread_buffer;
+    if (buffer == NULL) {
+        buffer = claim_trace_buffer();
+    }
+    if (buffer->records == NULL) {
+        // This thread did not get a buffer.
+        _LF_TRACE_FETCH_ADD(&_lf_trace_unbuffered_dropped, 1);
+        return;
+    }
+    // This thread is the only one that writes head.
+    size_t head = buffer->head;
+    size_t size = head - _LF_TRACE_LOAD_ACQUIRE(&buffer->tail);
+    if (size >= _lf_trace_buffer_capacity) {
+        // No more room in the buffer. Drop the record rather than wait for the flush thread.
+        buffer->dropped++;
+        return;
+    }
     // Write to memory buffer.
-    _lf_trace_buffer[index][i].event_type = event_type;
-    _lf_trace_buffer[index][i].pointer = pointer;
-    _lf_trace_buffer[index][i].reaction_number = reaction_number;
-    _lf_trace_buffer[index][i].worker = worker;
-    _lf_trace_buffer[index][i].logical_time = get_logical_time();
-    _lf_trace_buffer[index][i].microstep = get_microstep();
+    trace_record_t* record = &buffer->records[head & (_lf_trace_buffer_capacity - 1)];
+    record->event_type = event_type;
+    record->pointer = pointer;
+    record->reaction_number = reaction_number;
+    record->worker = worker;
+    record->logical_time = get_logical_time();
+    record->microstep = get_microstep();
     if (physical_time != NULL) {
-        _lf_trace_buffer[index][i].physical_time = *physical_time;
+        record->physical_time = *physical_time;
     } else {
-        _lf_trace_buffer[index][i].physical_time = get_physical_time();
+        record->physical_time = get_physical_time();
+    }
+    record->trigger = trigger;
+    record->extra_delay = extra_delay;
+    // Publish the record to the flush thread.
+    _LF_TRACE_STORE_RELEASE(&buffer->head, head + 1);
+    if (size + 1 >= _lf_trace_buffer_capacity / 2) {
+        // Wake up the flush thread early rather than waiting for it to poll.
+        // Signaling does not require holding the mutex and is cheap if the
+        // flush thread is busy rather than waiting.
+        lf_cond_signal(&_lf_flush_needed);
     }
-    _lf_trace_buffer_size[index]++;
-    _lf_trace_buffer[index][i].trigger = trigger;
-    _lf_trace_buffer[index][i].extra_delay = extra_delay;
 }
 
 /**
@@ -512,20 +985,9 @@ void stop_trace() {
         // Trace was already stopped. Nothing to do.
         return;
     }
+    // The flush thread drains all the buffers once it sees the stop marker.
+    // The trace file does not guarantee any ordering between buffers.
     lf_mutex_lock(&_lf_trace_mutex);
-    // In multithreaded execution, thread 0 invokes wrapup reactions, so we
-    // put that trace last. However, it could also include some startup events.
-    // In any case, the trace file does not guarantee any ordering.
-    for (int i = 1; i < _lf_number_of_trace_buffers; i++) {
-        // Flush the buffer if it has data.
-        // printf("DEBUG: Trace buffer %d has %d records.\n", i, _lf_trace_buffer_size[i]);
-        if (_lf_trace_buffer_size && _lf_trace_buffer_size[i] > 0) {
-            flush_trace_to_file_locked(i);
-        }
-    }
-    if (_lf_trace_buffer_size && _lf_trace_buffer_size[0] > 0) {
-        flush_trace_to_file_locked(0);
-    }
     _lf_trace_stop = 1;
     // Wake up the trace_flush thread.
     lf_cond_signal(&_lf_flush_needed);
@@ -535,7 +997,24 @@ void stop_trace() {
     void* flush_trace_thread_exit_status;
     lf_thread_join(_lf_flush_trace_thread, &flush_trace_thread_exit_status);
 
-    fclose(_lf_trace_file);
-    _lf_trace_file = NULL;
+    // Report records that could not be buffered.
+    size_t dropped = _lf_trace_unbuffered_dropped;
+    for (int i = 0; i < _lf_number_of_trace_buffers; i++) {
+        dropped += _lf_trace_buffers[i].dropped;
+    }
+    if (dropped > 0) {
+        warning_print("Tracing dropped %zu records because trace buffers were full. "
+                "Consider increasing --trace-buffer-capacity.", dropped);
+        // Record the loss in the trace file too. The flush thread has exited,
+        // so this thread can write to the file.
+        if (_lf_trace_file != NULL && _lf_trace_header_written) {
+            unsigned char encoded[11];
+            encoded[0] = TRACE_BLOCK_DROPPED;
+            size_t size = 1 + trace_encode_unsigned(&encoded[1], dropped);
+            trace_write(encoded, size);
+        }
+    }
+
+    close_trace_file();
     DEBUG_PRINT("Stopped tracing.");
 }
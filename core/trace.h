@@ -31,18 +31,42 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
  * See: https://github.com/icyphy/lingua-franca/wiki/Tracing#TracingInC
  *
- * The trace file is named trace.lft and is a binary file with the following format:
+ * The trace file is named trace.lft and is a binary file with the following format.
+ * Unsigned integers are encoded as varints: seven bits per byte, least significant
+ * group first, with the high bit set on every byte but the last. Signed integers
+ * are zigzag encoded ((n << 1) ^ (n >> 63)) and then encoded as varints.
  *
  * Header:
- * * instant_t: The start time. This is both the starting physical time and the starting logical time.
- * * int: Size N of the table mapping pointers to descriptions.
- * This is followed by N records each of which has:
- * * A pointer value (the key).
+ * * The four bytes of TRACE_FORMAT_MAGIC followed by a byte giving TRACE_FORMAT_VERSION.
+ * * signed: The start time. This is both the starting physical time and the starting logical time.
+ * * unsigned: Size N of the table of trace objects.
+ * This is followed by N objects each of which has:
+ * * A byte giving the object type (see _lf_trace_object_t).
+ * * unsigned: For a trigger, 1 + the index of the object for its reactor, or 0 if unknown.
  * * A null-terminated string (the description).
+ * Records refer to objects by 1 + their position in this table, with 0 meaning none or unknown.
  *
- * Traces:
- * A sequence of traces, each of which begins with an int giving the length of the trace
- * followed by binary representations of the trace_record struct written using fwrite().
+ * Blocks:
+ * A sequence of blocks, each of which begins with a byte giving the block type.
+ * A TRACE_BLOCK_RECORDS block has:
+ * * unsigned: The index of the trace buffer (one per thread) the records came from.
+ * * unsigned: The number of records M.
+ * * M records, each of which has:
+ *   * A byte with the event type in the low four bits and the TRACE_RECORD_HAS_* flags.
+ *   * unsigned: The object for the pointer, if TRACE_RECORD_HAS_POINTER is set.
+ *   * signed: The reaction number.
+ *   * signed: The worker.
+ *   * signed: The logical time minus that of the previous record from the same buffer
+ *     (or minus the start time for the first record).
+ *   * unsigned: The microstep, if TRACE_RECORD_HAS_MICROSTEP is set.
+ *   * signed: The physical time minus that of the previous record from the same buffer
+ *     (or minus the start time for the first record).
+ *   * unsigned: The object for the trigger, if TRACE_RECORD_HAS_TRIGGER is set.
+ *   * signed: The extra delay, if TRACE_RECORD_HAS_EXTRA_DELAY is set.
+ * A TRACE_BLOCK_DROPPED block, written when tracing stops, has:
+ * * unsigned: The number of records that were dropped because trace buffers were full.
+ *
+ * The trace_to_chrome program in util/tracing converts trace files for viewing.
  */
 #ifndef TRACE_H
 #define TRACE_H
@@ -64,6 +88,32 @@ typedef enum {
     worker_advancing_time_ends
 } trace_event_t;
 
+/** Magic number at the start of a trace file. */
+#define TRACE_FORMAT_MAGIC "LFTR"
+
+/** Version of the trace file format. Increment this when the format changes. */
+#define TRACE_FORMAT_VERSION 2
+
+/** Block types in a trace file. */
+#define TRACE_BLOCK_RECORDS 1
+#define TRACE_BLOCK_DROPPED 2
+
+/** Flags in the first byte of an encoded trace record. */
+#define TRACE_RECORD_EVENT_TYPE_MASK 0x0f
+#define TRACE_RECORD_HAS_POINTER 0x10
+#define TRACE_RECORD_HAS_MICROSTEP 0x20
+#define TRACE_RECORD_HAS_TRIGGER 0x40
+#define TRACE_RECORD_HAS_EXTRA_DELAY 0x80
+
+/**
+ * Identifier for what is in the object table.
+ */
+typedef enum {
+    trace_reactor,   // Self struct.
+    trace_trigger,   // Timer or action (argument to schedule()).
+    trace_user       // User-defined trace object.
+} _lf_trace_object_t;
+
 #ifdef LINGUA_FRANCA_TRACE
 
 /**
@@ -81,8 +131,23 @@ static const char* trace_event_names[] = {
         "Worker advancing time ends"
 };
 
-// FIXME: Target property should specify the capacity of the trace buffer.
+/**
+ * Default number of records in the trace buffer of each thread.
+ * This can be changed with the --trace-buffer-capacity command-line option.
+ */
+#ifndef TRACE_BUFFER_CAPACITY
 #define TRACE_BUFFER_CAPACITY 2048
+#endif
+
+/**
+ * Number of trace buffers reserved for threads other than the worker
+ * threads and the main thread, such as threads that call schedule()
+ * for physical actions or threads that receive messages for a federate.
+ * Records from further threads are dropped.
+ */
+#ifndef TRACE_EXTERNAL_THREAD_BUFFERS
+#define TRACE_EXTERNAL_THREAD_BUFFERS 16
+#endif
 
 /** Size of the table of trace objects. */
 #define TRACE_OBJECT_TABLE_SIZE 1024
@@ -99,15 +164,6 @@ typedef struct trace_record_t {
     interval_t extra_delay;
 } trace_record_t;
 
-/**
- * Identifier for what is in the object table.
- */
-typedef enum {
-    trace_reactor,   // Self struct.
-    trace_trigger,   // Timer or action (argument to schedule()).
-    trace_user       // User-defined trace object.
-} _lf_trace_object_t;
-
 /**
  * Struct for table of pointers to a description of the object.
  */
@@ -122,6 +178,21 @@ struct object_description_t {
 extern object_description_t _lf_trace_object_descriptions[];
 extern int _lf_trace_object_descriptions_size;
 
+/** Tracing options set from the command line. See process_args(). */
+extern char* _lf_trace_file_name;
+extern size_t _lf_trace_buffer_capacity;
+extern char* _lf_trace_reactor_filter;
+extern unsigned int _lf_trace_sample_period;
+extern interval_t _lf_trace_sample_interval;
+
+/**
+ * Set the event types to record from a comma-separated list of
+ * event type names, such as "reaction_starts,reaction_ends", or "all".
+ * @param spec The list.
+ * @return true if successful, false if the list has an unknown name.
+ */
+bool _lf_trace_set_events(char* spec);
+
 /**
  * Register a trace object.
  * @param pointer1 Pointer that identifies the object, typically to a reactor self struct.
@@ -238,6 +309,15 @@ void tracepoint_worker_advancing_time_starts(int worker);
  */
 void tracepoint_worker_advancing_time_ends(int worker);
 
+/**
+ * Decide whether to record the tag that is about to start.
+ * This is called once per tag from _lf_start_time_step(), so all the
+ * workers either record a whole tag or none of it. If sampling is
+ * enabled with _lf_trace_sample_period or _lf_trace_sample_interval,
+ * tracepoints of unsampled tags return without recording anything.
+ */
+void _lf_trace_sample_tag();
+
 void stop_trace();
 
 #else
@@ -255,6 +335,8 @@ void stop_trace();
 #define tracepoint_worker_advancing_time_starts(...);
 #define tracepoint_worker_advancing_time_ends(...);
 
+#define _lf_trace_sample_tag(...)
+
 #define start_trace(...)
 #define stop_trace(...)
 
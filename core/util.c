@@ -32,6 +32,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "util.h"
+#include "platform.h"   // Defines _LF_MEMORY_ADD() and _LF_MEMORY_CAS().
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -199,3 +200,212 @@ void register_print_function(print_message_function_t* function, int log_level)
     print_message_function = function;
     print_message_level = log_level;
 }
+
+/** Memory usage per category, indexed by lf_memory_category_t. */
+lf_memory_usage_t _lf_memory_usage[LF_MEMORY_NUMBER_OF_CATEGORIES];
+
+/** Names of the memory categories used when reporting, indexed by lf_memory_category_t. */
+static const char* _lf_memory_category_names[LF_MEMORY_NUMBER_OF_CATEGORIES] = {
+    "queues",
+    "tokens",
+    "payloads",
+    "events",
+    "trace buffers",
+    "federate buffers",
+    "statistics"
+};
+
+/**
+ * Record that the specified number of bytes has been allocated for
+ * the specified category in the specified number of objects.
+ * This function is thread safe.
+ */
+void _lf_memory_allocated(lf_memory_category_t category, size_t bytes, size_t objects) {
+    lf_memory_usage_t* usage = &_lf_memory_usage[category];
+    size_t current = _LF_MEMORY_ADD(&usage->bytes, bytes);
+    if (objects > 0) {
+        _LF_MEMORY_ADD(&usage->objects, objects);
+        _LF_MEMORY_ADD(&usage->allocations, objects);
+    }
+    size_t peak = usage->peak_bytes;
+    while (current > peak && !_LF_MEMORY_CAS(&usage->peak_bytes, peak, current)) {
+        peak = usage->peak_bytes;
+    }
+}
+
+/**
+ * Record that the specified number of bytes in the specified number
+ * of objects has been released for the specified category.
+ * This function is thread safe.
+ */
+void _lf_memory_freed(lf_memory_category_t category, size_t bytes, size_t objects) {
+    lf_memory_usage_t* usage = &_lf_memory_usage[category];
+    _LF_MEMORY_SUB(&usage->bytes, bytes);
+    if (objects > 0) {
+        _LF_MEMORY_SUB(&usage->objects, objects);
+    }
+}
+
+/**
+ * Allocate memory using malloc() and charge it to the specified category.
+ */
+void* _lf_malloc(lf_memory_category_t category, size_t size) {
+    void* result = malloc(size);
+    if (result != NULL) {
+        _lf_memory_allocated(category, size, 1);
+    }
+    return result;
+}
+
+/**
+ * Allocate zeroed memory using calloc() and charge it to the specified category.
+ */
+void* _lf_calloc(lf_memory_category_t category, size_t count, size_t size) {
+    void* result = calloc(count, size);
+    if (result != NULL) {
+        _lf_memory_allocated(category, count * size, 1);
+    }
+    return result;
+}
+
+/**
+ * Resize memory using realloc(), adjusting the bytes charged to the
+ * specified category.
+ */
+void* _lf_realloc(lf_memory_category_t category, void* pointer, size_t old_size, size_t new_size) {
+    void* result = realloc(pointer, new_size);
+    if (result != NULL) {
+        if (pointer == NULL) {
+            _lf_memory_allocated(category, new_size, 1);
+        } else if (new_size >= old_size) {
+            _lf_memory_allocated(category, new_size - old_size, 0);
+        } else {
+            _lf_memory_freed(category, old_size - new_size, 0);
+        }
+    }
+    return result;
+}
+
+/**
+ * Free memory using free() and credit the specified category.
+ */
+void _lf_free(lf_memory_category_t category, void* pointer, size_t size) {
+    if (pointer == NULL) return;
+    free(pointer);
+    _lf_memory_freed(category, size, 1);
+}
+
+/**
+ * Return the current memory usage for the specified category.
+ */
+lf_memory_usage_t lf_get_memory_usage(lf_memory_category_t category) {
+    return _lf_memory_usage[category];
+}
+
+/**
+ * Report the memory usage of each category and the total on stdout.
+ */
+void lf_print_memory_usage() {
+    size_t total_bytes = 0;
+    size_t total_objects = 0;
+    info_print("---- Memory usage (bytes, peak bytes, live allocations, total allocations):");
+    for (int i = 0; i < LF_MEMORY_NUMBER_OF_CATEGORIES; i++) {
+        lf_memory_usage_t usage = lf_get_memory_usage((lf_memory_category_t)i);
+        info_print("----   %-16s %12zu %12zu %10zu %10zu",
+                _lf_memory_category_names[i],
+                usage.bytes, usage.peak_bytes, usage.objects, usage.allocations);
+        total_bytes += usage.bytes;
+        total_objects += usage.objects;
+    }
+    info_print("----   %-16s %12zu %12s %10zu", "total", total_bytes, "", total_objects);
+}
+
+/**
+ * Return the index of the bucket for the specified value in an lf_histogram_t.
+ */
+static int lf_histogram_bucket(unsigned long long value) {
+    if (value < (1ULL << LF_HISTOGRAM_SUB_BUCKET_BITS)) {
+        return (int)value;
+    }
+    int exponent;
+#if defined(__GNUC__) || defined(__clang__)
+    exponent = 63 - __builtin_clzll(value);
+#else
+    exponent = LF_HISTOGRAM_SUB_BUCKET_BITS;
+    while ((value >> (exponent + 1)) != 0) exponent++;
+#endif
+    if (exponent >= LF_HISTOGRAM_MAX_EXPONENT) {
+        return LF_HISTOGRAM_BUCKETS - 1;
+    }
+    int shift = exponent - LF_HISTOGRAM_SUB_BUCKET_BITS;
+    return ((shift + 1) << LF_HISTOGRAM_SUB_BUCKET_BITS)
+            + (int)((value >> shift) & ((1ULL << LF_HISTOGRAM_SUB_BUCKET_BITS) - 1));
+}
+
+/**
+ * Return the largest value that falls in the specified bucket of an lf_histogram_t.
+ */
+static long long lf_histogram_bucket_limit(int bucket) {
+    if (bucket < (1 << LF_HISTOGRAM_SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> LF_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    long long sub_bucket = (bucket & ((1 << LF_HISTOGRAM_SUB_BUCKET_BITS) - 1)) + (1 << LF_HISTOGRAM_SUB_BUCKET_BITS);
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+/**
+ * Record a value in the specified histogram. Negative values are recorded as 0.
+ */
+void lf_histogram_record(lf_histogram_t* histogram, long long value) {
+    if (value < 0LL) {
+        value = 0LL;
+    }
+    histogram->counts[lf_histogram_bucket((unsigned long long)value)]++;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->total++;
+    histogram->sum += value;
+}
+
+/**
+ * Record a value in the specified histogram like lf_histogram_record(),
+ * but safely even if other threads record values in it at the same time.
+ */
+void lf_histogram_record_concurrent(lf_histogram_t* histogram, long long value) {
+    if (value < 0LL) {
+        value = 0LL;
+    }
+    _LF_MEMORY_ADD(&histogram->counts[lf_histogram_bucket((unsigned long long)value)], 1);
+    long long max = histogram->max;
+    while (value > max && !_LF_MEMORY_CAS(&histogram->max, max, value)) {
+        max = histogram->max;
+    }
+    _LF_MEMORY_ADD(&histogram->sum, value);
+    _LF_MEMORY_ADD(&histogram->total, 1);
+}
+
+/**
+ * Return an upper bound, within the histogram's precision, of the specified
+ * percentile of the values recorded in the specified histogram, or 0 if it is empty.
+ */
+long long lf_histogram_percentile(lf_histogram_t* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0LL;
+    }
+    // The rank of the value to report, counting from 1.
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * histogram->total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    unsigned long long count = 0;
+    for (int i = 0; i < LF_HISTOGRAM_BUCKETS; i++) {
+        count += histogram->counts[i];
+        if (count >= rank) {
+            long long limit = lf_histogram_bucket_limit(i);
+            return (limit < histogram->max) ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
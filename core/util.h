@@ -34,6 +34,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define UTIL_H
 
 #include <stdarg.h>   // Defines va_list
+#include <stddef.h>   // Defines size_t
 
 /**
  * Holds generic statistical data
@@ -211,4 +212,143 @@ typedef void(print_message_function_t)(char*, va_list);
  */
 void register_print_function(print_message_function_t* function, int log_level);
 
+/**
+ * Categories of memory tracked by the runtime's memory accounting.
+ * Every allocation made through _lf_malloc() and friends is charged
+ * to one of these categories.
+ */
+typedef enum lf_memory_category_t {
+    LF_MEMORY_QUEUES,           // Priority queues and their backing arrays.
+    LF_MEMORY_TOKENS,           // lf_token_t structs, including recycled ones.
+    LF_MEMORY_PAYLOADS,         // Token payloads that the runtime is responsible for freeing.
+    LF_MEMORY_EVENTS,           // Blocks of event_t structs.
+    LF_MEMORY_TRACE_BUFFERS,    // Trace record buffers.
+    LF_MEMORY_FEDERATE_BUFFERS, // Buffers used by the federated runtime.
+    LF_MEMORY_STATISTICS,       // Histograms and other runtime statistics.
+    LF_MEMORY_NUMBER_OF_CATEGORIES
+} lf_memory_category_t;
+
+/**
+ * Memory usage of one category as reported by lf_get_memory_usage().
+ */
+typedef struct lf_memory_usage_t {
+    size_t bytes;           // Bytes currently allocated.
+    size_t peak_bytes;      // Largest value that bytes has had.
+    size_t objects;         // Number of allocations currently live.
+    size_t allocations;     // Total number of allocations made since startup.
+} lf_memory_usage_t;
+
+/**
+ * Record that the specified number of bytes has been allocated for
+ * the specified category in the specified number of objects.
+ * This is used for memory that is allocated elsewhere but that the
+ * runtime becomes responsible for, such as payloads passed to
+ * schedule_value(). This function is thread safe.
+ * @param category The category to charge.
+ * @param bytes The number of bytes.
+ * @param objects The number of objects, or 0 if an existing object grew.
+ */
+void _lf_memory_allocated(lf_memory_category_t category, size_t bytes, size_t objects);
+
+/**
+ * Record that the specified number of bytes in the specified number
+ * of objects has been released for the specified category.
+ * This function is thread safe.
+ * @param category The category to credit.
+ * @param bytes The number of bytes.
+ * @param objects The number of objects, or 0 if an existing object shrank.
+ */
+void _lf_memory_freed(lf_memory_category_t category, size_t bytes, size_t objects);
+
+/**
+ * Allocate memory using malloc() and charge it to the specified category.
+ * @return A pointer to the memory or NULL if allocation failed.
+ */
+void* _lf_malloc(lf_memory_category_t category, size_t size);
+
+/**
+ * Allocate zeroed memory using calloc() and charge it to the specified category.
+ * @return A pointer to the memory or NULL if allocation failed.
+ */
+void* _lf_calloc(lf_memory_category_t category, size_t count, size_t size);
+
+/**
+ * Resize memory using realloc(), adjusting the bytes charged to the
+ * specified category. The object count is not changed.
+ * @param old_size The size that was charged for the memory being resized.
+ * @return A pointer to the memory or NULL if allocation failed, in which
+ *  case the original memory is left untouched.
+ */
+void* _lf_realloc(lf_memory_category_t category, void* pointer, size_t old_size, size_t new_size);
+
+/**
+ * Free memory using free() and credit the specified category with the
+ * specified size, which must match the size that was charged for it.
+ */
+void _lf_free(lf_memory_category_t category, void* pointer, size_t size);
+
+/**
+ * Return the current memory usage for the specified category.
+ * The returned values are a snapshot and may be slightly inconsistent
+ * with each other if other threads are allocating memory concurrently.
+ */
+lf_memory_usage_t lf_get_memory_usage(lf_memory_category_t category);
+
+/**
+ * Report the memory usage of each category and the total on stdout.
+ */
+void lf_print_memory_usage();
+
+/**
+ * Number of bits of a value that select the sub-bucket within each
+ * power of two in an lf_histogram_t. With 5 bits, recorded values are
+ * rounded by at most 1/32, or about 3%.
+ */
+#define LF_HISTOGRAM_SUB_BUCKET_BITS 5
+
+/**
+ * Values of 2^LF_HISTOGRAM_MAX_EXPONENT or more are counted in the last
+ * bucket of an lf_histogram_t. For times in nanoseconds, this is about 18 minutes.
+ * The maximum is always kept exactly.
+ */
+#define LF_HISTOGRAM_MAX_EXPONENT 40
+
+/** Number of buckets in an lf_histogram_t. */
+#define LF_HISTOGRAM_BUCKETS \
+        ((LF_HISTOGRAM_MAX_EXPONENT - LF_HISTOGRAM_SUB_BUCKET_BITS + 1) << LF_HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * Histogram of non-negative values, such as durations in nanoseconds, with
+ * buckets that are linear up to 2^LF_HISTOGRAM_SUB_BUCKET_BITS and then
+ * subdivide each power of two into 2^LF_HISTOGRAM_SUB_BUCKET_BITS buckets,
+ * as in an HDR histogram. This bounds the relative error of reported
+ * percentiles with a fixed amount of memory. A zeroed struct is an empty
+ * histogram. A histogram is not thread safe, so each one should have a
+ * single writer at a time.
+ */
+typedef struct lf_histogram_t {
+    unsigned long long counts[LF_HISTOGRAM_BUCKETS];
+    unsigned long long total;   // Number of recorded values.
+    long long max;              // Largest recorded value.
+    long long sum;              // Sum of the recorded values.
+} lf_histogram_t;
+
+/**
+ * Record a value in the specified histogram. Negative values are recorded as 0.
+ */
+void lf_histogram_record(lf_histogram_t* histogram, long long value);
+
+/**
+ * Record a value in the specified histogram like lf_histogram_record(),
+ * but safely even if other threads record values in it at the same time.
+ */
+void lf_histogram_record_concurrent(lf_histogram_t* histogram, long long value);
+
+/**
+ * Return an upper bound, within the histogram's precision, of the specified
+ * percentile of the values recorded in the specified histogram, or 0 if it is empty.
+ * @param percentile The percentile, for example 99.9.
+ */
+long long lf_histogram_percentile(lf_histogram_t* histogram, double percentile);
+
 #endif /* UTIL_H */
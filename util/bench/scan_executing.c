@@ -0,0 +1,209 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone microbenchmark of the scan that the threaded scheduler performs
+ * to decide whether a reaction is blocked by an executing reaction (see
+ * _lf_is_blocked_by_executing_reaction() in reactor_threaded.c). It times two
+ * versions of the scan over the same randomly chosen reactions:
+ *
+ * - "struct": follows a pointer to each executing reaction_t and reads its
+ *   index and chain_id, as the scheduler did when it scanned executing_q.
+ * - "table": reads the ids of the executing reactions from a dense array and
+ *   the index and chain_id from the arrays of the reaction table.
+ *
+ * Each reaction_t is allocated in a separate block the size of a typical
+ * reactor self struct, as in generated code, so the "struct" scan touches a
+ * different cache line for each executing reaction. The chain IDs are chosen
+ * so that no executing reaction blocks the reaction being checked, so each
+ * scan visits every executing reaction.
+ *
+ * Usage: scan_executing [-r <reactions>] [-e <executing>] [-n <scans>]
+ *
+ * Without -e, the scans are timed for 4, 16, and 64 executing reactions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util.c"       // Defines error_print() and friends.
+#include "reactor.h"    // Defines reaction_t, LEVEL(), and OVERLAPPING().
+
+/** Size of the block in which each reaction_t is allocated. */
+#define SELF_STRUCT_SIZE 512
+
+/** Return a monotonic time in nanoseconds. */
+long long monotonic_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** Copies of the fields of each reaction read by the "table" scan. */
+index_t* table_index;
+unsigned long long* table_chain_id;
+
+/** The "struct" scan: return true if one of the executing reactions blocks the reaction. */
+bool blocked_by_struct(reaction_t* reaction, reaction_t** executing, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (LEVEL(executing[i]->index) < LEVEL(reaction->index)
+                && OVERLAPPING(executing[i]->chain_id, reaction->chain_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** The "table" scan: return true if one of the executing reactions blocks the reaction. */
+bool blocked_by_table(size_t id, size_t* executing, size_t size) {
+    index_t level = LEVEL(table_index[id]);
+    unsigned long long chain_id = table_chain_id[id];
+    for (size_t i = 0; i < size; i++) {
+        if (LEVEL(table_index[executing[i]]) < level
+                && OVERLAPPING(table_chain_id[executing[i]], chain_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Time the specified number of scans of each kind with the specified number of
+ * executing reactions, chosen at random for each scan, and print the results.
+ */
+void run(reaction_t** reactions, size_t number_of_reactions, size_t executing, long scans) {
+    reaction_t** executing_reactions = (reaction_t**)malloc(executing * sizeof(reaction_t*));
+    size_t* executing_ids = (size_t*)malloc(executing * sizeof(size_t));
+    // Draw the same sequence of reactions for both kinds of scan.
+    size_t* draws = (size_t*)malloc((executing + 1) * scans * sizeof(size_t));
+    reaction_t** drawn_reactions = (reaction_t**)malloc((executing + 1) * scans * sizeof(reaction_t*));
+    if (executing_reactions == NULL || executing_ids == NULL
+            || draws == NULL || drawn_reactions == NULL) {
+        error_print_and_exit("Out of memory.");
+    }
+    // Executing reactions have odd ids and checked reactions even ids.
+    size_t* d = draws;
+    for (long i = 0; i < scans; i++) {
+        for (size_t j = 0; j <= executing; j++) {
+            size_t id = 2 + (size_t)rand() % (number_of_reactions - 2);
+            *d = (j < executing) ? (id | 1) : (id & ~(size_t)1);
+            drawn_reactions[d - draws] = reactions[*d];
+            d++;
+        }
+    }
+    long blocked = 0;
+    reaction_t** drawn_reaction = drawn_reactions;
+    long long start = monotonic_time();
+    for (long i = 0; i < scans; i++) {
+        for (size_t j = 0; j < executing; j++) {
+            executing_reactions[j] = *drawn_reaction++;
+        }
+        blocked += blocked_by_struct(*drawn_reaction++, executing_reactions, executing);
+    }
+    long long struct_time = monotonic_time() - start;
+    size_t* draw = draws;
+    start = monotonic_time();
+    for (long i = 0; i < scans; i++) {
+        for (size_t j = 0; j < executing; j++) {
+            executing_ids[j] = *draw++;
+        }
+        blocked += blocked_by_table(*draw++, executing_ids, executing);
+    }
+    long long table_time = monotonic_time() - start;
+    if (blocked != 0) {
+        error_print_and_exit("A reaction was unexpectedly blocked.");
+    }
+    printf("%10zu %12.1f %12.1f %8.2fx\n", executing,
+            (double)struct_time / scans, (double)table_time / scans,
+            (double)struct_time / table_time);
+    free(executing_reactions);
+    free(executing_ids);
+    free(draws);
+    free(drawn_reactions);
+}
+
+/** Print a usage message. */
+void usage() {
+    printf("\nUsage: scan_executing [-r <reactions>] [-e <executing>] [-n <scans>]\n\n");
+    printf("Times the scan for executing reactions that block a reaction, reading\n");
+    printf("reaction_t structs and reading the reaction table. The defaults are\n");
+    printf("10000 reactions, 4, 16, and 64 executing reactions, and 1000000 scans.\n\n");
+}
+
+int main(int argc, char* argv[]) {
+    size_t number_of_reactions = 10000;
+    size_t executing = 0;
+    long scans = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            number_of_reactions = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            executing = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            scans = atol(argv[++i]);
+        } else {
+            usage();
+            exit(1);
+        }
+    }
+    if (number_of_reactions < 4 || scans <= 0) {
+        usage();
+        exit(1);
+    }
+    // As in the reaction table, id 0 is not used.
+    reaction_t** reactions = (reaction_t**)calloc(number_of_reactions, sizeof(reaction_t*));
+    table_index = (index_t*)malloc(number_of_reactions * sizeof(index_t));
+    table_chain_id = (unsigned long long*)malloc(number_of_reactions * sizeof(unsigned long long));
+    if (reactions == NULL || table_index == NULL || table_chain_id == NULL) {
+        error_print_and_exit("Out of memory.");
+    }
+    srand(1);
+    for (size_t id = 1; id < number_of_reactions; id++) {
+        reaction_t* reaction = (reaction_t*)calloc(1, SELF_STRUCT_SIZE);
+        if (reaction == NULL) {
+            error_print_and_exit("Out of memory.");
+        }
+        // Reactions with odd ids have chain IDs in the low 32 bits and those
+        // with even ids in the high 32 bits, so they never block each other.
+        reaction->index = (index_t)(rand() % 0x8000);
+        reaction->chain_id = 1ULL << (rand() % 32 + ((id % 2 == 0) ? 32 : 0));
+        reaction->id = id;
+        reactions[id] = reaction;
+        table_index[id] = reaction->index;
+        table_chain_id[id] = reaction->chain_id;
+    }
+    printf("%10s %12s %12s %9s\n", "executing", "struct(ns)", "table(ns)", "speedup");
+    if (executing > 0) {
+        run(reactions, number_of_reactions, executing, scans);
+    } else {
+        run(reactions, number_of_reactions, 4, scans);
+        run(reactions, number_of_reactions, 16, scans);
+        run(reactions, number_of_reactions, 64, scans);
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program that periodically prints the live metrics (see live_metrics.h)
+ * of a running Lingua Franca program compiled with LF_LIVE_METRICS defined.
+ * Each line gives the current tag, the rates at which tags, reactions, and
+ * messages to and from other federates have been processed since the previous
+ * line, and the latest values of the other counters. The program being monitored
+ * is not stopped or slowed down.
+ *
+ * Usage: monitor_metrics [-i <interval in msec>] [-n <count>] <pid | metrics file>
+ *
+ * Given a process ID, the metrics file is found in LF_LIVE_METRICS_DIRECTORY.
+ * This program exits when the monitored program terminates or after printing
+ * the given number of lines.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>     // Defines kill().
+#include <sys/mman.h>   // Defines mmap().
+#include <fcntl.h>      // Defines open().
+#include <unistd.h>     // Defines close().
+#include "util.c"           // Defines error_print() and friends.
+#include "live_metrics.h"   // Defines the layout of the metrics file.
+
+/** Number of lines after which the column headings are repeated. */
+#define HEADING_INTERVAL 20
+
+/** Return the current time of a monotonic clock in nanoseconds. */
+long long monotonic_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** Sleep for the specified number of milliseconds. */
+void sleep_msec(long msec) {
+    struct timespec duration = {msec / 1000, (msec % 1000) * 1000000L};
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR);
+}
+
+/**
+ * Map the specified metrics file and wait until the program writing it has
+ * initialized it. This exits if the file cannot be opened or is not a live
+ * metrics file of the supported version.
+ */
+lf_live_metrics_t* map_metrics_file(char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        error_print_and_exit("Failed to open metrics file %s: %s. "
+                "Is the program running and compiled with LF_LIVE_METRICS defined?", path, strerror(errno));
+    }
+    // The program extends the file before mapping it, so a short file is still being created.
+    long long deadline = monotonic_time() + 1000000000LL;
+    while (lseek(fd, 0, SEEK_END) < (off_t)sizeof(lf_live_metrics_t)) {
+        if (monotonic_time() > deadline) {
+            error_print_and_exit("Metrics file %s is too short.", path);
+        }
+        sleep_msec(10);
+    }
+    void* mapping = mmap(NULL, sizeof(lf_live_metrics_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error_print_and_exit("Failed to map metrics file %s: %s.", path, strerror(errno));
+    }
+    volatile lf_live_metrics_t* metrics = (volatile lf_live_metrics_t*)mapping;
+    while (memcmp((const void*)metrics->magic, LF_LIVE_METRICS_MAGIC, sizeof(metrics->magic)) != 0) {
+        if (monotonic_time() > deadline) {
+            error_print_and_exit("%s is not a Lingua Franca live metrics file.", path);
+        }
+        sleep_msec(10);
+    }
+    if (metrics->version != LF_LIVE_METRICS_VERSION) {
+        error_print_and_exit("Unsupported live metrics version %u. Expected version %d.",
+                metrics->version, LF_LIVE_METRICS_VERSION);
+    }
+    return (lf_live_metrics_t*)mapping;
+}
+
+/** Print the column headings. */
+void print_headings() {
+    printf("%14s %12s %10s %12s %8s %15s %9s %9s %9s %10s %10s %10s %11s\n",
+            "elapsed(ms)", "microstep", "tags/s", "reactions/s", "events",
+            "reactions(max)", "deadline", "STP", "tokens", "memory(KB)", "sent/s", "recv/s", "compressed");
+}
+
+/**
+ * Print one line for the specified current snapshot of the metrics,
+ * computing rates from the specified previous snapshot.
+ * @param elapsed The physical time in nanoseconds between the two snapshots.
+ */
+void print_metrics(lf_live_metrics_t* current, lf_live_metrics_t* previous, long long elapsed) {
+    double seconds = (elapsed > 0) ? elapsed / 1e9 : 1.0;
+    char queue[32];
+    snprintf(queue, sizeof(queue), "%llu(%llu)",
+            (unsigned long long)current->reaction_queue_size,
+            (unsigned long long)current->max_reaction_queue_size);
+    // Size of the compressed payloads relative to their original size.
+    char compressed[32] = "-";
+    if (current->bytes_compressed > 0) {
+        snprintf(compressed, sizeof(compressed), "%.1f%%",
+                100.0 * current->bytes_after_compression / current->bytes_compressed);
+    }
+    printf("%14.3f %12u %10.0f %12.0f %8llu %15s %9llu %9llu %9llu %10llu %10.0f %10.0f %11s\n",
+            (current->current_time - current->start_time) / 1e6,
+            current->current_microstep,
+            (current->tags - previous->tags) / seconds,
+            (current->reactions - previous->reactions) / seconds,
+            (unsigned long long)current->event_queue_size,
+            queue,
+            (unsigned long long)current->deadline_violations,
+            (unsigned long long)current->STP_violations,
+            (unsigned long long)current->live_tokens,
+            (unsigned long long)(current->memory_bytes / 1024),
+            (current->messages_sent - previous->messages_sent) / seconds,
+            (current->messages_received - previous->messages_received) / seconds,
+            compressed);
+    fflush(stdout);
+}
+
+/** Print a usage message. */
+void usage() {
+    printf("\nUsage: monitor_metrics [-i <interval in msec>] [-n <count>] <pid | metrics file>\n\n");
+    printf("Periodically prints the live metrics of a running Lingua Franca program\n");
+    printf("compiled with LF_LIVE_METRICS defined. The default interval is 1000 msec.\n");
+    printf("Without -n, this prints until the program terminates.\n\n");
+}
+
+int main(int argc, char* argv[]) {
+    char* target = NULL;
+    long interval = 1000;
+    long count = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            interval = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (argv[i][0] != '-' && target == NULL) {
+            target = argv[i];
+        } else {
+            usage();
+            exit(1);
+        }
+    }
+    if (target == NULL || interval <= 0) {
+        usage();
+        exit(1);
+    }
+    char path[256];
+    char* end;
+    long pid = strtol(target, &end, 10);
+    if (*end == '\0') {
+        snprintf(path, sizeof(path), LF_LIVE_METRICS_FILE_FORMAT, pid);
+    } else {
+        snprintf(path, sizeof(path), "%s", target);
+    }
+
+    lf_live_metrics_t* metrics = map_metrics_file(path);
+    pid = (long)metrics->pid;
+    info_print("Monitoring process %ld through %s.", pid, path);
+
+    lf_live_metrics_t previous, current;
+    memcpy(&previous, metrics, sizeof(previous));
+    long long previous_time = monotonic_time();
+    for (long line = 0; count < 0 || line < count; line++) {
+        sleep_msec(interval);
+        memcpy(&current, metrics, sizeof(current));
+        long long now = monotonic_time();
+        if (line % HEADING_INTERVAL == 0) {
+            print_headings();
+        }
+        print_metrics(&current, &previous, now - previous_time);
+        if (!current.running) {
+            info_print("Process %ld has terminated after %llu tags and %llu reactions.",
+                    pid, (unsigned long long)current.tags, (unsigned long long)current.reactions);
+            break;
+        }
+        if (kill((pid_t)pid, 0) != 0 && errno == ESRCH) {
+            warning_print("Process %ld has exited without terminating normally.", pid);
+            break;
+        }
+        previous = current;
+        previous_time = now;
+    }
+    munmap(metrics, sizeof(lf_live_metrics_t));
+    return 0;
+}
@@ -0,0 +1,608 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2021, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program to convert a Lingua Franca trace file (see trace.h) into
+ * the JSON trace event format that chrome://tracing and https://ui.perfetto.dev
+ * display. Each worker gets one track showing the reactions it executed and the
+ * time it spent waiting for reactions or advancing time. Other threads that
+ * recorded events, such as threads calling schedule() for physical actions, get
+ * a track of their own. Calls to schedule() are shown as instant events with a
+ * flow arrow to the first reaction of the same reactor that started at the
+ * resulting tag.
+ *
+ * Usage: trace_to_chrome [-o <output file>] <trace file>
+ *
+ * By default, the output file has the name of the trace file with the
+ * extension .lft replaced by .json.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "util.c"   // Defines error_print() and friends.
+#include "tag.h"    // Defines instant_t and related types.
+#include "trace.h"  // Defines the trace file format.
+
+/** Thread id of the track for the thread that recorded trace buffer i if it is not a worker. */
+#define OTHER_THREAD_TID(i) (1000 + (i))
+
+/** Kinds of spans that are built from a pair of start and end records. */
+typedef enum {
+    reaction_span,
+    wait_span,
+    advancing_time_span,
+    NUMBER_OF_SPAN_KINDS
+} span_kind_t;
+
+/** An entry in the table of trace objects. */
+typedef struct trace_object_t {
+    _lf_trace_object_t type;
+    int reactor;        // For a trigger, 1 + the index of its reactor, or 0 if unknown.
+    char* description;
+} trace_object_t;
+
+/** A decoded trace record, with absolute times. */
+typedef struct decoded_record_t {
+    trace_event_t event_type;
+    int buffer;         // Index of the trace buffer, one per thread.
+    int pointer;        // 1 + the index of the object, or 0 if none.
+    int reaction_number;
+    int worker;
+    instant_t logical_time;
+    microstep_t microstep;
+    instant_t physical_time;
+    int trigger;        // 1 + the index of the trigger object, or 0 if none.
+    interval_t extra_delay;
+} decoded_record_t;
+
+/** State of each trace buffer seen in the file. */
+typedef struct buffer_state_t {
+    instant_t previous_logical_time;
+    instant_t previous_physical_time;
+    int worker;         // The worker that owns the buffer, or -1 if none is known.
+    int pending[NUMBER_OF_SPAN_KINDS]; // Index of an unmatched start record, or -1.
+} buffer_state_t;
+
+/** The contents of the trace file and the position of the decoder. */
+unsigned char* trace_data = NULL;
+size_t trace_size = 0;
+size_t trace_position = 0;
+
+/** The start time recorded in the header. */
+instant_t trace_start_time;
+
+/** The table of trace objects. */
+trace_object_t* trace_objects = NULL;
+size_t trace_objects_size = 0;
+
+/** All records in the file in the order in which they appear. */
+decoded_record_t* records = NULL;
+size_t records_size = 0;
+size_t records_capacity = 0;
+
+/** Per-buffer state, indexed by the buffer index. */
+buffer_state_t* buffers = NULL;
+size_t buffers_size = 0;
+
+/** Number of records that the runtime reported as dropped. */
+unsigned long long dropped_records = 0;
+
+/** The output file. */
+FILE* output_file = NULL;
+
+/** Whether an event has already been written, so the next one needs a separator. */
+bool output_started = false;
+
+/**
+ * Read an unsigned varint from the trace data.
+ * Exit with an error if the file ends in the middle of it.
+ */
+unsigned long long decode_unsigned() {
+    unsigned long long result = 0;
+    int shift = 0;
+    while (true) {
+        if (trace_position >= trace_size || shift > 63) {
+            error_print_and_exit("Trace file is truncated or corrupt at byte %zu.", trace_position);
+        }
+        unsigned char byte = trace_data[trace_position++];
+        result |= (unsigned long long)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return result;
+        }
+        shift += 7;
+    }
+}
+
+/** Read a zigzag encoded signed varint from the trace data. */
+long long decode_signed() {
+    unsigned long long value = decode_unsigned();
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+/** Read a byte from the trace data. */
+unsigned char decode_byte() {
+    if (trace_position >= trace_size) {
+        error_print_and_exit("Trace file is truncated at byte %zu.", trace_position);
+    }
+    return trace_data[trace_position++];
+}
+
+/** Read the whole of the specified file into trace_data. */
+void read_trace_file(char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        error_print_and_exit("Failed to open trace file %s.", filename);
+    }
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    if (size < 0) {
+        error_print_and_exit("Failed to read trace file %s.", filename);
+    }
+    trace_size = (size_t)size;
+    trace_data = (unsigned char*)malloc(trace_size + 1);
+    if (trace_data == NULL || fread(trace_data, 1, trace_size, file) != trace_size) {
+        error_print_and_exit("Failed to read trace file %s.", filename);
+    }
+    fclose(file);
+}
+
+/** Decode the header of the trace file, including the table of trace objects. */
+void read_header() {
+    size_t magic_length = strlen(TRACE_FORMAT_MAGIC);
+    if (trace_size < magic_length + 1 || memcmp(trace_data, TRACE_FORMAT_MAGIC, magic_length) != 0) {
+        error_print_and_exit("Not a Lingua Franca trace file.");
+    }
+    trace_position = magic_length;
+    int version = decode_byte();
+    if (version != TRACE_FORMAT_VERSION) {
+        error_print_and_exit("Unsupported trace file version %d. Expected version %d.",
+                version, TRACE_FORMAT_VERSION);
+    }
+    trace_start_time = decode_signed();
+    trace_objects_size = decode_unsigned();
+    if (trace_objects_size > trace_size) {
+        error_print_and_exit("Trace file is corrupt: its object table is too large.");
+    }
+    trace_objects = (trace_object_t*)calloc(trace_objects_size + 1, sizeof(trace_object_t));
+    for (size_t i = 0; i < trace_objects_size; i++) {
+        trace_objects[i].type = (_lf_trace_object_t)decode_byte();
+        if (trace_objects[i].type == trace_trigger) {
+            trace_objects[i].reactor = (int)decode_unsigned();
+        }
+        char* description = (char*)&trace_data[trace_position];
+        void* end = memchr(description, '\0', trace_size - trace_position);
+        if (end == NULL) {
+            error_print_and_exit("Trace file is truncated in the object table.");
+        }
+        trace_objects[i].description = description;
+        trace_position = (unsigned char*)end - trace_data + 1;
+    }
+}
+
+/** Return the state of the specified buffer, creating it if needed. */
+buffer_state_t* buffer_state(size_t index) {
+    if (index >= buffers_size) {
+        size_t new_size = index + 1;
+        buffers = (buffer_state_t*)realloc(buffers, new_size * sizeof(buffer_state_t));
+        for (size_t i = buffers_size; i < new_size; i++) {
+            buffers[i].previous_logical_time = trace_start_time;
+            buffers[i].previous_physical_time = trace_start_time;
+            buffers[i].worker = -1;
+            for (int kind = 0; kind < NUMBER_OF_SPAN_KINDS; kind++) {
+                buffers[i].pending[kind] = -1;
+            }
+        }
+        buffers_size = new_size;
+    }
+    return &buffers[index];
+}
+
+/** Decode all the blocks that follow the header into records. */
+void read_blocks() {
+    while (trace_position < trace_size) {
+        unsigned char block_type = decode_byte();
+        if (block_type == TRACE_BLOCK_DROPPED) {
+            dropped_records += decode_unsigned();
+            continue;
+        } else if (block_type != TRACE_BLOCK_RECORDS) {
+            error_print_and_exit("Unknown block type %d at byte %zu.", block_type, trace_position - 1);
+        }
+        size_t index = decode_unsigned();
+        unsigned long long count = decode_unsigned();
+        if (index > trace_size || count > trace_size) {
+            error_print_and_exit("Trace file is corrupt at byte %zu.", trace_position);
+        }
+        buffer_state_t* buffer = buffer_state(index);
+        for (unsigned long long i = 0; i < count; i++) {
+            if (records_size == records_capacity) {
+                records_capacity = (records_capacity == 0) ? 1024 : 2 * records_capacity;
+                records = (decoded_record_t*)realloc(records, records_capacity * sizeof(decoded_record_t));
+                if (records == NULL) {
+                    error_print_and_exit("Out of memory decoding trace records.");
+                }
+            }
+            decoded_record_t* record = &records[records_size++];
+            unsigned char flags = decode_byte();
+            record->event_type = (trace_event_t)(flags & TRACE_RECORD_EVENT_TYPE_MASK);
+            record->buffer = (int)index;
+            record->pointer = (flags & TRACE_RECORD_HAS_POINTER) ? (int)decode_unsigned() : 0;
+            record->reaction_number = (int)decode_signed();
+            record->worker = (int)decode_signed();
+            buffer->previous_logical_time += decode_signed();
+            record->logical_time = buffer->previous_logical_time;
+            record->microstep = (flags & TRACE_RECORD_HAS_MICROSTEP) ? (microstep_t)decode_unsigned() : 0;
+            buffer->previous_physical_time += decode_signed();
+            record->physical_time = buffer->previous_physical_time;
+            record->trigger = (flags & TRACE_RECORD_HAS_TRIGGER) ? (int)decode_unsigned() : 0;
+            record->extra_delay = (flags & TRACE_RECORD_HAS_EXTRA_DELAY) ? decode_signed() : 0LL;
+            if (record->pointer > (int)trace_objects_size || record->trigger > (int)trace_objects_size) {
+                error_print_and_exit("Trace record refers to an unknown object at byte %zu.", trace_position);
+            }
+            // Calls to schedule() record worker 0 whichever thread makes them,
+            // so only the other events identify the worker that owns a buffer.
+            if (record->worker >= 0 && record->event_type != schedule_called) {
+                buffer->worker = record->worker;
+            }
+        }
+    }
+}
+
+/** Return the description of the object with the specified 1-based index, or NULL. */
+char* object_description(int object) {
+    return (object > 0) ? trace_objects[object - 1].description : NULL;
+}
+
+/** Return the thread id of the track for records from the specified buffer. */
+int buffer_tid(int buffer) {
+    return (buffers[buffer].worker >= 0) ? buffers[buffer].worker : OTHER_THREAD_TID(buffer);
+}
+
+/** Return the time of the specified record in microseconds since the start, as used by the output format. */
+double record_timestamp(decoded_record_t* record) {
+    return (record->physical_time - trace_start_time) / 1000.0;
+}
+
+/** Write the specified string as a JSON string literal. */
+void write_json_string(const char* string) {
+    fputc('"', output_file);
+    for (const char* c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output_file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(output_file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, output_file);
+        }
+    }
+    fputc('"', output_file);
+}
+
+/** Start a new event object in the output, up to and including the opening brace. */
+void start_event() {
+    fprintf(output_file, output_started ? ",\n{" : "\n{");
+    output_started = true;
+}
+
+/**
+ * Write a complete event for a span from the start record to the end record.
+ * @param name The name of the span.
+ * @param category The category of the span.
+ */
+void write_span(const char* name, const char* category, decoded_record_t* start, decoded_record_t* end) {
+    start_event();
+    fprintf(output_file, "\"name\":");
+    write_json_string(name);
+    fprintf(output_file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"logical_time\":%lld,\"microstep\":%u}}",
+            category, buffer_tid(start->buffer), record_timestamp(start),
+            (end->physical_time - start->physical_time) / 1000.0,
+            (long long)(start->logical_time - trace_start_time), start->microstep);
+}
+
+/** Write a complete event for the reaction that starts and ends with the specified records. */
+void write_reaction_span(decoded_record_t* start, decoded_record_t* end) {
+    char name[256];
+    char* reactor = object_description(start->pointer);
+    if (reactor != NULL) {
+        snprintf(name, sizeof(name), "%s reaction %d", reactor, start->reaction_number);
+    } else {
+        snprintf(name, sizeof(name), "reaction %d", start->reaction_number);
+    }
+    write_span(name, "reaction", start, end);
+}
+
+/**
+ * Match the specified start or end record of a span with its counterpart
+ * from the same thread and write the span once both ends are known.
+ * Ends without a start, which occur where sampling or dropping records
+ * skipped part of the trace, are ignored.
+ */
+void match_span(size_t index, span_kind_t kind, bool is_start) {
+    decoded_record_t* record = &records[index];
+    int* pending = &buffers[record->buffer].pending[kind];
+    if (is_start) {
+        *pending = (int)index;
+        return;
+    }
+    if (*pending < 0) {
+        return;
+    }
+    decoded_record_t* start = &records[*pending];
+    *pending = -1;
+    if (kind == reaction_span) {
+        if (start->pointer == record->pointer && start->reaction_number == record->reaction_number) {
+            write_reaction_span(start, record);
+        }
+    } else if (kind == wait_span) {
+        write_span("Waiting for reactions", "worker", start, record);
+    } else {
+        write_span("Advancing time", "worker", start, record);
+    }
+}
+
+/** Compare records by reactor, tag, and physical time, for sorting reaction starts. */
+int compare_reaction_starts(const void* a, const void* b) {
+    decoded_record_t* first = &records[*(const size_t*)a];
+    decoded_record_t* second = &records[*(const size_t*)b];
+    if (first->pointer != second->pointer) {
+        return (first->pointer < second->pointer) ? -1 : 1;
+    }
+    if (first->logical_time != second->logical_time) {
+        return (first->logical_time < second->logical_time) ? -1 : 1;
+    }
+    if (first->microstep != second->microstep) {
+        return (first->microstep < second->microstep) ? -1 : 1;
+    }
+    if (first->physical_time != second->physical_time) {
+        return (first->physical_time < second->physical_time) ? -1 : 1;
+    }
+    return 0;
+}
+
+/** Indices of the reaction start records sorted with compare_reaction_starts(). */
+size_t* reaction_starts_sorted = NULL;
+size_t reaction_starts_size = 0;
+
+/** Sort the reaction start records so that schedule() calls can find their reactions. */
+void sort_reaction_starts() {
+    reaction_starts_sorted = (size_t*)malloc((records_size + 1) * sizeof(size_t));
+    for (size_t i = 0; i < records_size; i++) {
+        if (records[i].event_type == reaction_starts) {
+            reaction_starts_sorted[reaction_starts_size++] = i;
+        }
+    }
+    qsort(reaction_starts_sorted, reaction_starts_size, sizeof(size_t), compare_reaction_starts);
+}
+
+/**
+ * Return the first reaction of the reactor that the specified call to schedule()
+ * triggers, or NULL if the trace does not have it. This is the first reaction of
+ * that reactor to start at the tag that the call produces and no earlier in
+ * physical time than the call itself.
+ */
+decoded_record_t* scheduled_reaction(decoded_record_t* schedule) {
+    if (schedule->pointer == 0) {
+        return NULL;
+    }
+    instant_t time = schedule->logical_time + schedule->extra_delay;
+    // Binary search for the first start of this reactor at or after the tag of the call.
+    size_t low = 0;
+    size_t high = reaction_starts_size;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        decoded_record_t* candidate = &records[reaction_starts_sorted[middle]];
+        if (candidate->pointer < schedule->pointer
+                || (candidate->pointer == schedule->pointer
+                && (candidate->logical_time < time
+                || (candidate->logical_time == time && candidate->microstep < schedule->microstep
+                        && schedule->extra_delay == 0LL)))) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (size_t i = low; i < reaction_starts_size; i++) {
+        decoded_record_t* candidate = &records[reaction_starts_sorted[i]];
+        if (candidate->pointer != schedule->pointer || candidate->logical_time != time) {
+            break;
+        }
+        if (candidate->physical_time >= schedule->physical_time) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+/** Write an instant event for a call to schedule() and a flow arrow to the reaction it triggers. */
+void write_schedule(decoded_record_t* record, int flow_id) {
+    char name[256];
+    char* trigger = object_description(record->trigger);
+    snprintf(name, sizeof(name), "schedule %s", (trigger != NULL) ? trigger : "(unknown trigger)");
+    int tid = buffer_tid(record->buffer);
+    double timestamp = record_timestamp(record);
+    start_event();
+    fprintf(output_file, "\"name\":");
+    write_json_string(name);
+    fprintf(output_file, ",\"cat\":\"schedule\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,"
+            "\"args\":{\"logical_time\":%lld,\"microstep\":%u,\"extra_delay\":%lld}}",
+            tid, timestamp, (long long)(record->logical_time - trace_start_time), record->microstep,
+            (long long)record->extra_delay);
+
+    decoded_record_t* reaction = scheduled_reaction(record);
+    if (reaction == NULL) {
+        return;
+    }
+    start_event();
+    fprintf(output_file, "\"name\":\"schedule\",\"cat\":\"schedule\",\"ph\":\"s\",\"id\":%d,"
+            "\"pid\":0,\"tid\":%d,\"ts\":%.3f}", flow_id, tid, timestamp);
+    start_event();
+    fprintf(output_file, "\"name\":\"schedule\",\"cat\":\"schedule\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%d,"
+            "\"pid\":0,\"tid\":%d,\"ts\":%.3f}", flow_id, buffer_tid(reaction->buffer), record_timestamp(reaction));
+}
+
+/** Write an instant event or a counter value for a user-defined event. */
+void write_user_event(decoded_record_t* record) {
+    char* description = object_description(record->pointer);
+    start_event();
+    fprintf(output_file, "\"name\":");
+    write_json_string((description != NULL) ? description : "user event");
+    if (record->event_type == user_value) {
+        fprintf(output_file, ",\"cat\":\"user\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                record_timestamp(record), (long long)record->extra_delay);
+    } else {
+        fprintf(output_file, ",\"cat\":\"user\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}",
+                buffer_tid(record->buffer), record_timestamp(record));
+    }
+}
+
+/** Write the names of the process and of the thread tracks. */
+void write_track_names() {
+    start_event();
+    fprintf(output_file, "\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"Lingua Franca\"}}");
+    for (size_t i = 0; i < buffers_size; i++) {
+        int tid = buffer_tid((int)i);
+        // Name each track once even if several buffers report the same worker.
+        bool duplicate = false;
+        for (size_t j = 0; j < i; j++) {
+            duplicate = duplicate || (buffer_tid((int)j) == tid);
+        }
+        if (duplicate) {
+            continue;
+        }
+        start_event();
+        if (buffers[i].worker >= 0) {
+            fprintf(output_file, "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                    "\"args\":{\"name\":\"Worker %d\"}}", tid, buffers[i].worker);
+        } else {
+            fprintf(output_file, "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                    "\"args\":{\"name\":\"Thread %zu\"}}", tid, i);
+        }
+        start_event();
+        fprintf(output_file, "\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                "\"args\":{\"sort_index\":%d}}", tid, tid);
+    }
+}
+
+/** Write all the decoded records as trace events. */
+void write_events() {
+    fprintf(output_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    write_track_names();
+    int flow_id = 0;
+    for (size_t i = 0; i < records_size; i++) {
+        decoded_record_t* record = &records[i];
+        switch (record->event_type) {
+            case reaction_starts:
+            case reaction_ends:
+                match_span(i, reaction_span, record->event_type == reaction_starts);
+                break;
+            case worker_wait_starts:
+            case worker_wait_ends:
+                match_span(i, wait_span, record->event_type == worker_wait_starts);
+                break;
+            case worker_advancing_time_starts:
+            case worker_advancing_time_ends:
+                match_span(i, advancing_time_span, record->event_type == worker_advancing_time_starts);
+                break;
+            case schedule_called:
+                write_schedule(record, flow_id++);
+                break;
+            case user_event:
+            case user_value:
+                write_user_event(record);
+                break;
+            default:
+                warning_print("Ignoring trace record with unknown event type %d.", record->event_type);
+        }
+    }
+    fprintf(output_file, "\n],\"otherData\":{\"dropped_records\":%llu}}\n", dropped_records);
+}
+
+/** Print a usage message. */
+void usage() {
+    printf("\nUsage: trace_to_chrome [-o <output file>] <trace file>\n\n");
+    printf("Converts a Lingua Franca trace file into JSON for chrome://tracing or\n");
+    printf("https://ui.perfetto.dev. By default, the output file name is that of\n");
+    printf("the trace file with the extension .lft replaced by .json.\n\n");
+}
+
+int main(int argc, char* argv[]) {
+    char* input_name = NULL;
+    char* output_name = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_name = argv[++i];
+        } else if (argv[i][0] != '-' && input_name == NULL) {
+            input_name = argv[i];
+        } else {
+            usage();
+            exit(1);
+        }
+    }
+    if (input_name == NULL) {
+        usage();
+        exit(1);
+    }
+    char* default_output_name = NULL;
+    if (output_name == NULL) {
+        size_t length = strlen(input_name);
+        if (length > 4 && strcmp(&input_name[length - 4], ".lft") == 0) {
+            length -= 4;
+        }
+        default_output_name = (char*)malloc(length + 6);
+        memcpy(default_output_name, input_name, length);
+        strcpy(&default_output_name[length], ".json");
+        output_name = default_output_name;
+    }
+
+    read_trace_file(input_name);
+    read_header();
+    read_blocks();
+    sort_reaction_starts();
+
+    output_file = fopen(output_name, "w");
+    if (output_file == NULL) {
+        error_print_and_exit("Failed to open output file %s.", output_name);
+    }
+    write_events();
+    fclose(output_file);
+
+    info_print("Converted %zu records from %s into %s.", records_size, input_name, output_name);
+    if (dropped_records > 0) {
+        warning_print("The trace is missing %llu records that were dropped while tracing.", dropped_records);
+    }
+
+    free(default_output_name);
+    free(reaction_starts_sorted);
+    free(records);
+    free(buffers);
+    free(trace_objects);
+    free(trace_data);
+    return 0;
+}